@@ -0,0 +1,717 @@
+
+#include "adaptive_hash.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "frozen_table.h"
+#include "linked_lists.h"
+#include "trace.h"
+
+// Keys in the array representation
+#ifndef SMALL_KEYS
+#define SMALL_KEYS 8
+#endif
+// Operations between looks at the workload
+#ifndef WINDOW
+#define WINDOW 1024
+#endif
+// Bins every operation moves while we migrate, for every bin of the new
+// representation that each old bin stands for. A migration then takes
+// the same number of operations whether we grow or shrink.
+#ifndef MIGRATE_BINS
+#define MIGRATE_BINS 8
+#endif
+// Smaller tables are not worth freezing
+#ifndef FREEZE_MIN_KEYS
+#define FREEZE_MIN_KEYS 1024
+#endif
+// Reads without writes, for every key, before we freeze. Building a
+// frozen table costs about as much as a dozen lookups per key, so we wait
+// until the reads have paid for it. Thawing rebuilds the table again, so
+// every time a write thaws a table that stayed frozen for fewer reads
+// than it waited, we wait twice as long next time, up to
+// MAX_FREEZE_READS. When a freeze lasts, we halve it again.
+#ifndef FREEZE_READS
+#define FREEZE_READS 16
+#endif
+#ifndef MAX_FREEZE_READS
+#define MAX_FREEZE_READS 1024
+#endif
+
+#define MIN_OPEN_SIZE 16
+#define MIN_CHAINED_SIZE 8
+
+enum bin_state { BIN_EMPTY = 0, BIN_DELETED = 1, BIN_LIVE = 3 };
+
+struct small_keys {
+  unsigned int keys[SMALL_KEYS];
+  unsigned int n;
+};
+
+struct open_bins {
+  unsigned int *keys;
+  uint8_t *states;
+  size_t size;
+  size_t used;   // Bins that are live or deleted
+  size_t active; // Live bins
+};
+
+struct chained_bins {
+  struct link **bins;
+  size_t size;
+  size_t used;
+};
+
+struct rep {
+  enum representation kind;
+  union {
+    struct small_keys small;
+    struct open_bins open;
+    struct chained_bins chained;
+    struct frozen_table *frozen;
+  };
+};
+
+// The operations since we last looked at the workload
+struct workload {
+  size_t reads;
+  size_t inserts;
+  size_t deletes;
+};
+
+struct hash_table {
+  struct rep rep; // Where new keys go
+  struct rep old; // Where keys move from, while migrating
+  bool migrating;
+  size_t next_bin; // The next bin of old to move
+  size_t step;     // Bins of old to move every operation
+  size_t keys;
+  struct workload workload;
+  size_t quiet_windows; // Windows without writes, or frozen, in a row
+  size_t freeze_reads;  // Quiet reads per key before we freeze
+  const struct allocator *allocator;
+};
+
+// Open tables get a quarter full when we build them, and we rebuild them
+// at half full or an eighth full, counting tombstones as full.
+static size_t
+open_size(size_t keys)
+{
+  size_t size = MIN_OPEN_SIZE;
+  while (keys > size / 4)
+    size *= 2;
+  return size;
+}
+
+// Chained tables get half full, and we resize them at full or a quarter
+// full.
+static size_t
+chained_size(size_t keys)
+{
+  size_t size = MIN_CHAINED_SIZE;
+  while (keys > size / 2)
+    size *= 2;
+  return size;
+}
+
+// The bin holding key, with *found set, or else the first bin without a
+// key in its probe sequence
+static size_t
+open_find(struct open_bins *open, unsigned int key, bool *found)
+{
+  size_t mask = open->size - 1, free = open->size;
+  for (size_t bin = key & mask;; bin = (bin + 1) & mask) {
+    enum bin_state state = open->states[bin];
+    if (state == BIN_EMPTY) {
+      *found = false;
+      return free < open->size ? free : bin;
+    }
+    if (state == BIN_LIVE && open->keys[bin] == key) {
+      *found = true;
+      return bin;
+    }
+    if (state == BIN_DELETED && free == open->size)
+      free = bin;
+  }
+}
+
+static inline LIST
+chained_bin(struct chained_bins *chained, unsigned int key)
+{
+  return chained->bins + (key & (chained->size - 1));
+}
+
+// Representations other than frozen start empty
+static void
+rep_init(struct hash_table *table, struct rep *rep, enum representation kind,
+         size_t size)
+{
+  assert(kind != REP_FROZEN); // Frozen tables come from freeze
+  const struct allocator *allocator = table->allocator;
+  rep->kind = kind;
+  switch (kind) {
+  case REP_SMALL:
+    rep->small.n = 0;
+    break;
+  case REP_OPEN:
+    rep->open = (struct open_bins){
+        .keys = allocate(allocator, size * sizeof *rep->open.keys),
+        .states = allocate_zeroed(allocator, size * sizeof *rep->open.states),
+        .size = size,
+        .used = 0,
+        .active = 0};
+    break;
+  case REP_CHAINED:
+    rep->chained = (struct chained_bins){
+        .bins = allocate_zeroed(allocator, size * sizeof *rep->chained.bins),
+        .size = size,
+        .used = 0};
+    break;
+  case REP_FROZEN:
+    break;
+  }
+}
+
+static void
+rep_free(struct hash_table *table, struct rep *rep)
+{
+  const struct allocator *allocator = table->allocator;
+  switch (rep->kind) {
+  case REP_SMALL:
+    break;
+  case REP_OPEN:
+    deallocate(allocator, rep->open.states,
+               rep->open.size * sizeof *rep->open.states);
+    deallocate(allocator, rep->open.keys,
+               rep->open.size * sizeof *rep->open.keys);
+    break;
+  case REP_CHAINED:
+    for (size_t bin = 0; bin < rep->chained.size; bin++) {
+      free_list_with_allocator(rep->chained.bins + bin, allocator);
+    }
+    deallocate(allocator, rep->chained.bins,
+               rep->chained.size * sizeof *rep->chained.bins);
+    break;
+  case REP_FROZEN:
+    delete_frozen_table(rep->frozen);
+    break;
+  }
+}
+
+static bool
+rep_contains(struct rep *rep, unsigned int key)
+{
+  bool found = false;
+  switch (rep->kind) {
+  case REP_SMALL:
+    for (unsigned int i = 0; i < rep->small.n && !found; i++) {
+      found = rep->small.keys[i] == key;
+    }
+    break;
+  case REP_OPEN:
+    open_find(&rep->open, key, &found);
+    break;
+  case REP_CHAINED:
+    found = contains_element(chained_bin(&rep->chained, key), key);
+    break;
+  case REP_FROZEN:
+    found = frozen_contains_key(rep->frozen, key);
+    break;
+  }
+  return found;
+}
+
+// Add a key that isn't in the table. The array must have room, and the
+// representation can't be frozen.
+static void
+rep_add(struct hash_table *table, struct rep *rep, unsigned int key)
+{
+  assert(rep->kind != REP_FROZEN);
+  bool found;
+  switch (rep->kind) {
+  case REP_SMALL:
+    rep->small.keys[rep->small.n++] = key;
+    break;
+  case REP_OPEN: {
+    struct open_bins *open = &rep->open;
+    size_t bin = open_find(open, key, &found);
+    if (open->states[bin] == BIN_EMPTY)
+      open->used++; // We are using a new bin
+    open->keys[bin] = key;
+    open->states[bin] = BIN_LIVE;
+    open->active++;
+    break;
+  }
+  case REP_CHAINED:
+    add_element_with_allocator(chained_bin(&rep->chained, key), key,
+                               table->allocator);
+    rep->chained.used++;
+    break;
+  case REP_FROZEN:
+    break;
+  }
+}
+
+// Returns whether key was there. The representation can't be frozen.
+static bool
+rep_remove(struct hash_table *table, struct rep *rep, unsigned int key)
+{
+  assert(rep->kind != REP_FROZEN);
+  bool found = false;
+  switch (rep->kind) {
+  case REP_SMALL:
+    for (unsigned int i = 0; i < rep->small.n; i++) {
+      if (rep->small.keys[i] == key) {
+        rep->small.keys[i] = rep->small.keys[--rep->small.n];
+        return true;
+      }
+    }
+    break;
+  case REP_OPEN: {
+    size_t bin = open_find(&rep->open, key, &found);
+    if (found) {
+      rep->open.states[bin] = BIN_DELETED;
+      rep->open.active--;
+    }
+    break;
+  }
+  case REP_CHAINED:
+    found = delete_element_with_allocator(chained_bin(&rep->chained, key),
+                                          key, table->allocator);
+    if (found)
+      rep->chained.used--;
+    break;
+  case REP_FROZEN:
+    break;
+  }
+  return found;
+}
+
+static size_t
+rep_bins(struct rep *rep)
+{
+  switch (rep->kind) {
+  case REP_SMALL:
+    return SMALL_KEYS;
+  case REP_OPEN:
+    return rep->open.size;
+  case REP_CHAINED:
+    return rep->chained.size;
+  case REP_FROZEN:
+    return rep->frozen->no_slots;
+  }
+  return 0;
+}
+
+static void
+rep_visit_bins(struct rep *rep, size_t begin, size_t end,
+               void (*f)(unsigned int key, void *data), void *data)
+{
+  for (size_t bin = begin; bin < end; bin++) {
+    switch (rep->kind) {
+    case REP_SMALL:
+      if (bin < rep->small.n)
+        f(rep->small.keys[bin], data);
+      break;
+    case REP_OPEN:
+      if (rep->open.states[bin] == BIN_LIVE)
+        f(rep->open.keys[bin], data);
+      break;
+    case REP_CHAINED:
+      for (struct link *link = rep->chained.bins[bin]; link;
+           link = link->next) {
+        f(link->key, data);
+      }
+      break;
+    case REP_FROZEN:
+      if (frozen_slot_has_key(rep->frozen, bin))
+        f(rep->frozen->slots[bin], data);
+      break;
+    }
+  }
+}
+
+static void
+rep_memory(struct rep *rep, struct memory_usage *usage)
+{
+  switch (rep->kind) {
+  case REP_SMALL:
+    break; // The array is in the table
+  case REP_OPEN:
+    usage->bins +=
+        rep->open.size * (sizeof *rep->open.keys + sizeof *rep->open.states);
+    break;
+  case REP_CHAINED:
+    usage->bins += rep->chained.size * sizeof *rep->chained.bins;
+    usage->nodes += rep->chained.used * sizeof(struct link);
+    break;
+  case REP_FROZEN:
+    usage->bins += frozen_table_memory(rep->frozen);
+    break;
+  }
+}
+
+static void
+add_to_rep(unsigned int key, void *data)
+{
+  struct hash_table *table = data;
+  rep_add(table, &table->rep, key);
+}
+
+// Move the keys in a bin of the old representation to the new one. Old
+// open bins become tombstones, so probes through them still work.
+static void
+move_bin(struct hash_table *table, size_t bin)
+{
+  struct rep *old = &table->old, *rep = &table->rep;
+  if (old->kind == REP_OPEN) {
+    if (old->open.states[bin] == BIN_LIVE) {
+      rep_add(table, rep, old->open.keys[bin]);
+      old->open.states[bin] = BIN_DELETED;
+      old->open.active--;
+    }
+  } else if (old->kind == REP_CHAINED && rep->kind == REP_CHAINED) {
+    // Chained to chained moves the links themselves
+    LIST list = old->chained.bins + bin;
+    while (*list) {
+      struct link *link = *list;
+      *list = link->next;
+      LIST to = chained_bin(&rep->chained, link->key);
+      link->next = *to;
+      *to = link;
+      old->chained.used--;
+      rep->chained.used++;
+    }
+  } else if (old->kind == REP_CHAINED) {
+    LIST list = old->chained.bins + bin;
+    for (struct link *link = *list; link; link = link->next) {
+      rep_add(table, rep, link->key);
+      old->chained.used--;
+    }
+    free_list_with_allocator(list, table->allocator);
+  } else {
+    // We move the array and frozen tables all at once, so their keys can
+    // stay where they are until we free them.
+    rep_visit_bins(old, bin, bin + 1, add_to_rep, table);
+  }
+}
+
+// Move bins from the old representation, and free it once it is empty
+static void
+migrate(struct hash_table *table, size_t bins)
+{
+  if (!table->migrating)
+    return;
+  size_t old_bins = rep_bins(&table->old);
+  size_t end = (bins < old_bins - table->next_bin) ? table->next_bin + bins
+                                                   : old_bins;
+  for (; table->next_bin < end; table->next_bin++) {
+    move_bin(table, table->next_bin);
+  }
+  if (table->next_bin == old_bins) {
+    rep_free(table, &table->old);
+    table->migrating = false;
+  }
+}
+
+static void
+finish_migration(struct hash_table *table)
+{
+  migrate(table, SIZE_MAX);
+}
+
+// Start moving the keys to a new representation, which can be the same
+// kind with another size. We finish any migration we are already in first.
+static void
+start_migration(struct hash_table *table, enum representation kind,
+                size_t size)
+{
+  finish_migration(table);
+  table->old = table->rep;
+  rep_init(table, &table->rep, kind, size);
+  table->migrating = true;
+  table->next_bin = 0;
+  size_t old_bins = rep_bins(&table->old), new_bins = rep_bins(&table->rep);
+  table->step = MIGRATE_BINS * ((old_bins + new_bins - 1) / new_bins);
+  if (kind == REP_SMALL || table->old.kind == REP_SMALL ||
+      table->old.kind == REP_FROZEN)
+    finish_migration(table);
+}
+
+// Whether the table has been quiet for freeze_reads reads per key
+static bool
+quiet_enough(struct hash_table *table)
+{
+  return table->quiet_windows * WINDOW >= table->freeze_reads * table->keys;
+}
+
+static void
+freeze(struct hash_table *table)
+{
+  finish_migration(table);
+  // freeze_table gets the keys through for_each_key, from the current
+  // representation
+  struct frozen_table *frozen =
+      freeze_table_with_allocator(table, table->allocator);
+  rep_free(table, &table->rep);
+  table->rep.kind = REP_FROZEN;
+  table->rep.frozen = frozen;
+  table->quiet_windows = 0;
+}
+
+static void
+thaw(struct hash_table *table)
+{
+  if (!quiet_enough(table)) {
+    if (table->freeze_reads < MAX_FREEZE_READS)
+      table->freeze_reads *= 2;
+  } else if (table->freeze_reads > FREEZE_READS) {
+    table->freeze_reads /= 2;
+  }
+  table->quiet_windows = 0;
+  start_migration(table, REP_OPEN, open_size(table->keys));
+}
+
+// Resize, or shrink to the array, when the load says so. We leave the new
+// representation alone while we migrate, since it was sized so it can
+// take the keys arriving until we are done.
+static void
+check_load(struct hash_table *table)
+{
+  if (table->migrating)
+    return;
+  struct rep *rep = &table->rep;
+  switch (rep->kind) {
+  case REP_OPEN:
+    if (table->keys <= SMALL_KEYS / 2)
+      start_migration(table, REP_SMALL, 0);
+    else if (rep->open.used > rep->open.size / 2 ||
+             (rep->open.size > MIN_OPEN_SIZE &&
+              rep->open.active < rep->open.size / 8))
+      start_migration(table, REP_OPEN, open_size(table->keys));
+    break;
+  case REP_CHAINED:
+    if (table->keys <= SMALL_KEYS / 2)
+      start_migration(table, REP_SMALL, 0);
+    else if (rep->chained.used == rep->chained.size ||
+             (rep->chained.size > MIN_CHAINED_SIZE &&
+              rep->chained.used < rep->chained.size / 4))
+      start_migration(table, REP_CHAINED, chained_size(table->keys));
+    break;
+  default:
+    break;
+  }
+}
+
+// Every WINDOW operations, pick the representation for the workload.
+// Open addressing suits lookups and insertions, chaining suits churn
+// that leaves tombstones, and a table nobody writes to can be frozen.
+// The thresholds for chaining and back are far apart, so a workload near
+// one of them doesn't make us switch back and forth.
+static void
+observe(struct hash_table *table)
+{
+  struct workload *workload = &table->workload;
+  size_t deletes = workload->deletes,
+         writes = workload->inserts + workload->deletes;
+  if (workload->reads + writes < WINDOW)
+    return;
+  *workload = (struct workload){.reads = 0, .inserts = 0, .deletes = 0};
+  table->quiet_windows = writes == 0 ? table->quiet_windows + 1 : 0;
+  if (table->migrating)
+    return; // The new representation hasn't settled yet
+
+  struct rep *rep = &table->rep;
+  if (rep->kind == REP_SMALL || rep->kind == REP_FROZEN)
+    return;
+  if (table->keys >= FREEZE_MIN_KEYS && quiet_enough(table)) {
+    freeze(table);
+  } else if (rep->kind == REP_OPEN) {
+    size_t tombstones = rep->open.used - rep->open.active;
+    if (4 * deletes >= WINDOW && 4 * tombstones >= rep->open.active)
+      start_migration(table, REP_CHAINED, chained_size(table->keys));
+  } else if (rep->kind == REP_CHAINED) {
+    if (16 * deletes < WINDOW)
+      start_migration(table, REP_OPEN, open_size(table->keys));
+  }
+}
+
+// After every operation. Since loads only change with writes, but
+// migrations end with any operation, we look at the load every time.
+static void
+settle(struct hash_table *table)
+{
+  check_load(table);
+  observe(table);
+}
+
+struct hash_table *
+new_table_with_allocator(size_t keys, const struct allocator *allocator)
+{
+  struct hash_table *table = allocate(allocator, sizeof *table);
+  table->allocator = allocator;
+  table->migrating = false;
+  table->keys = 0;
+  table->workload = (struct workload){.reads = 0, .inserts = 0, .deletes = 0};
+  table->quiet_windows = 0;
+  table->freeze_reads = FREEZE_READS;
+  if (keys <= SMALL_KEYS)
+    rep_init(table, &table->rep, REP_SMALL, 0);
+  else
+    rep_init(table, &table->rep, REP_OPEN, open_size(keys));
+  TRACE(TRACE_NEW_TABLE, table, keys, false);
+  return table;
+}
+
+struct hash_table *
+new_table_with_capacity(size_t keys)
+{
+  return new_table_with_allocator(keys, NULL);
+}
+
+struct hash_table *
+new_table()
+{
+  return new_table_with_capacity(0);
+}
+
+void
+delete_table(struct hash_table *table)
+{
+  TRACE(TRACE_DELETE_TABLE, table, 0, false);
+  if (table->migrating)
+    rep_free(table, &table->old);
+  rep_free(table, &table->rep);
+  deallocate(table->allocator, table, sizeof *table);
+}
+
+// The API functions are traced, so internally we use this instead.
+static bool
+has_key(struct hash_table *table, unsigned int key)
+{
+  return rep_contains(&table->rep, key) ||
+         (table->migrating && rep_contains(&table->old, key));
+}
+
+bool
+contains_key(struct hash_table *table, unsigned int key)
+{
+  table->workload.reads++;
+  migrate(table, table->step);
+  bool found = has_key(table, key);
+  settle(table);
+  TRACE(TRACE_CONTAINS, table, key, found);
+  return found;
+}
+
+bool
+try_insert(struct hash_table *table, unsigned int key)
+{
+  TRACE(TRACE_INSERT, table, key, false);
+  table->workload.inserts++;
+  migrate(table, table->step);
+  if (has_key(table, key)) {
+    settle(table);
+    return false;
+  }
+
+  if (table->rep.kind == REP_FROZEN)
+    thaw(table);
+  else if (table->rep.kind == REP_SMALL && table->rep.small.n == SMALL_KEYS)
+    start_migration(table, REP_OPEN, open_size(table->keys + 1));
+  rep_add(table, &table->rep, key);
+  table->keys++;
+  settle(table);
+  return true;
+}
+
+void
+insert_key(struct hash_table *table, unsigned int key)
+{
+  try_insert(table, key);
+}
+
+bool
+erase(struct hash_table *table, unsigned int key)
+{
+  TRACE(TRACE_DELETE, table, key, false);
+  table->workload.deletes++;
+  migrate(table, table->step);
+  if (table->rep.kind == REP_FROZEN) {
+    if (!rep_contains(&table->rep, key)) {
+      settle(table);
+      return false;
+    }
+    thaw(table);
+  }
+
+  bool found = rep_remove(table, &table->rep, key) ||
+               (table->migrating && rep_remove(table, &table->old, key));
+  if (found)
+    table->keys--;
+  settle(table);
+  return found;
+}
+
+void
+delete_key(struct hash_table *table, unsigned int key)
+{
+  erase(table, key);
+}
+
+size_t
+no_keys(struct hash_table *table)
+{
+  return table->keys;
+}
+
+size_t
+no_bins(struct hash_table *table)
+{
+  return rep_bins(&table->rep) +
+         (table->migrating ? rep_bins(&table->old) : 0);
+}
+
+void
+for_each_key_in_bins(struct hash_table *table, size_t begin, size_t end,
+                     void (*f)(unsigned int key, void *data), void *data)
+{
+  size_t bins = rep_bins(&table->rep);
+  if (begin < bins)
+    rep_visit_bins(&table->rep, begin, end < bins ? end : bins, f, data);
+  if (table->migrating && end > bins)
+    rep_visit_bins(&table->old, begin > bins ? begin - bins : 0, end - bins,
+                   f, data);
+}
+
+void
+for_each_key(struct hash_table *table, void (*f)(unsigned int key, void *data),
+             void *data)
+{
+  for_each_key_in_bins(table, 0, no_bins(table), f, data);
+}
+
+struct memory_usage
+table_memory_usage(struct hash_table *table)
+{
+  struct memory_usage usage = {.table = sizeof *table};
+  rep_memory(&table->rep, &usage);
+  if (table->migrating)
+    rep_memory(&table->old, &usage);
+  usage.total = usage.table + usage.bins + usage.nodes + usage.subtables;
+  return usage;
+}
+
+enum representation
+table_representation(struct hash_table *table)
+{
+  return table->rep.kind;
+}
+
+bool
+is_migrating(struct hash_table *table)
+{
+  return table->migrating;
+}
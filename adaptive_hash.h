@@ -0,0 +1,82 @@
+
+#ifndef ADAPTIVE_HASH_H
+#define ADAPTIVE_HASH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "allocator.h"
+
+// A table that picks its representation from the workload it sees, rather
+// than having it fixed by which backend we link:
+//
+// - A small table is an array of up to SMALL_KEYS keys that we scan.
+// - Larger tables use open addressing with linear probing.
+// - When deletions leave many tombstones, we switch to chaining, where a
+//   deletion frees its link and leaves nothing behind.
+// - When chained tables see few deletions again, we go back to open
+//   addressing.
+// - A large table that sees FREEZE_READS reads per key without a write is
+//   frozen into a frozen_table, which has no empty bins. The next write
+//   thaws it, and if that came soon, we wait longer before freezing again.
+//
+// We count reads and writes, and every WINDOW operations we look at them,
+// the load and the tombstones to decide. Moving between the array, open
+// addressing and chaining, and resizing them, is incremental: every
+// operation moves a few bins from the old representation to the new one,
+// and lookups look in both until they are done. The array is small, so we
+// move it at once, and freezing and thawing also happen at once.
+enum representation { REP_SMALL, REP_OPEN, REP_CHAINED, REP_FROZEN };
+
+struct hash_table; // Forward declaration
+
+struct hash_table *
+new_table(void);
+struct hash_table *
+new_table_with_capacity(size_t keys);
+struct hash_table *
+new_table_with_allocator(size_t keys, const struct allocator *allocator);
+void
+delete_table(struct hash_table *table);
+
+void
+insert_key(struct hash_table *table, unsigned int key);
+bool
+contains_key(struct hash_table *table, unsigned int key);
+void
+delete_key(struct hash_table *table, unsigned int key);
+
+// insert_key and delete_key, telling us what they did: try_insert returns
+// false if the key was already there, and erase whether it was there.
+bool
+try_insert(struct hash_table *table, unsigned int key);
+bool
+erase(struct hash_table *table, unsigned int key);
+
+// Number of keys in the table
+size_t
+no_keys(struct hash_table *table);
+// Call f(key, data) for every key in the table
+void
+for_each_key(struct hash_table *table, void (*f)(unsigned int key, void *data),
+             void *data);
+// Bins and the keys in bins [begin, end). While we migrate, the bins of
+// both representations count.
+size_t
+no_bins(struct hash_table *table);
+void
+for_each_key_in_bins(struct hash_table *table, size_t begin, size_t end,
+                     void (*f)(unsigned int key, void *data), void *data);
+
+// The bytes the table holds
+struct memory_usage
+table_memory_usage(struct hash_table *table);
+
+// The representation new keys go to, and whether keys are still moving
+// there from the previous one
+enum representation
+table_representation(struct hash_table *table);
+bool
+is_migrating(struct hash_table *table);
+
+#endif
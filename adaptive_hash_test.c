@@ -0,0 +1,140 @@
+
+#include "adaptive_hash.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Takes an adaptive table through the phases it adapts to, checking the
+// representation it picks and that it keeps the right keys on the way.
+// no_elements should be a few times the workload window.
+
+static unsigned int
+key(unsigned int i)
+{
+  return i * 2654435761U;
+}
+
+// present[i] says whether key(i) should be in the table
+static void
+check_keys(struct hash_table *table, const bool *present, unsigned int n)
+{
+  size_t count = 0;
+  for (unsigned int i = 0; i < n; i++) {
+    assert(contains_key(table, key(i)) == present[i]);
+    count += present[i];
+  }
+  assert(no_keys(table) == count);
+}
+
+static void
+count_key(unsigned int key, void *data)
+{
+  (*(size_t *)data)++;
+}
+
+int
+main(int argc, const char *argv[])
+{
+  if (argc != 2) {
+    printf("Usage: %s no_elements\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  unsigned int no_elms = atoi(argv[1]);
+  unsigned int range = 3 * no_elms;
+  bool *present = calloc(range, sizeof *present);
+
+  // Small tables are an array until it is full. Calls that change the
+  // table stay out of asserts, which NDEBUG takes out.
+  struct hash_table *table = new_table();
+  unsigned int changed = 0;
+  for (unsigned int i = 0; i < 8; i++) {
+    changed += try_insert(table, key(i));
+    present[i] = true;
+  }
+  assert(changed == 8);
+  assert(table_representation(table) == REP_SMALL);
+  changed = try_insert(table, key(0));
+  assert(!changed);
+  changed = try_insert(table, key(8));
+  assert(changed);
+  present[8] = true;
+  assert(table_representation(table) == REP_OPEN);
+
+  // Growing moves the keys a few bins at a time
+  bool migrated = false;
+  for (unsigned int i = 9; i < no_elms; i++) {
+    insert_key(table, key(i));
+    present[i] = true;
+    migrated |= is_migrating(table);
+  }
+  assert(migrated);
+  check_keys(table, present, range);
+
+  // Churn leaves tombstones, which chaining doesn't have
+  changed = 0;
+  for (unsigned int i = 0; i < 2 * no_elms; i++) {
+    changed += erase(table, key(i));
+    present[i] = false;
+    changed += try_insert(table, key(no_elms + i));
+    present[no_elms + i] = true;
+  }
+  assert(changed == 4 * no_elms);
+  assert(table_representation(table) == REP_CHAINED);
+  check_keys(table, present, range);
+
+  // When we only read, the table goes back to open addressing, and once
+  // the reads have paid for it, it is frozen
+  unsigned int found = 0;
+  for (unsigned int i = 0; i < 20 * no_elms; i++) {
+    found += contains_key(table, key(2 * no_elms + i % no_elms));
+  }
+  assert(found == 20 * no_elms);
+  assert(table_representation(table) == REP_FROZEN);
+  check_keys(table, present, range);
+  size_t visited = 0;
+  for_each_key(table, count_key, &visited);
+  assert(visited == no_keys(table));
+
+  // Writing thaws it
+  changed = try_insert(table, key(2 * no_elms));
+  assert(!changed);
+  assert(table_representation(table) == REP_FROZEN);
+  changed = erase(table, key(2 * no_elms));
+  assert(changed);
+  present[2 * no_elms] = false;
+  assert(table_representation(table) == REP_OPEN);
+  check_keys(table, present, range);
+
+  // Reads with a rare write in between freeze the table a time or two,
+  // but then it waits longer than the reads last, instead of rebuilding
+  // the table twice for every write
+  unsigned int freezes = 0;
+  changed = 0;
+  for (unsigned int cycle = 0; cycle < 10; cycle++) {
+    for (unsigned int i = 0; i < 40 * no_elms; i++) {
+      bool frozen = table_representation(table) == REP_FROZEN;
+      contains_key(table, key(i % range));
+      freezes += !frozen && table_representation(table) == REP_FROZEN;
+    }
+    changed += erase(table, key(2 * no_elms + 1));
+    changed += try_insert(table, key(2 * no_elms + 1));
+  }
+  assert(changed == 20);
+  assert(freezes >= 1 && freezes <= 2);
+  check_keys(table, present, range);
+
+  // And when it empties, it is an array again
+  for (unsigned int i = 0; i < range - 3; i++) {
+    delete_key(table, key(i));
+    present[i] = false;
+  }
+  while (is_migrating(table))
+    contains_key(table, key(0));
+  assert(table_representation(table) == REP_SMALL);
+  check_keys(table, present, range);
+
+  delete_table(table);
+  free(present);
+  return EXIT_SUCCESS;
+}
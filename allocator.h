@@ -0,0 +1,64 @@
+
+#ifndef ALLOCATOR_H
+#define ALLOCATOR_H
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Where a data structure gets its memory from. Structures created with an
+// allocator use it for all their memory and keep a pointer to it, so it
+// must outlive them. realloc and free get the size of the block, so an
+// allocator can keep account of memory without a header on every block.
+// Like with malloc, the structures don't handle failed allocations.
+//
+// A NULL allocator means malloc, realloc and free.
+struct allocator {
+  void *(*alloc)(void *context, size_t size);
+  void *(*realloc)(void *context, void *ptr, size_t old_size,
+                   size_t new_size);
+  void (*free)(void *context, void *ptr, size_t size);
+  void *context;
+};
+
+static inline void *
+allocate(const struct allocator *allocator, size_t size)
+{
+  return allocator ? allocator->alloc(allocator->context, size) : malloc(size);
+}
+static inline void *
+allocate_zeroed(const struct allocator *allocator, size_t size)
+{
+  if (!allocator)
+    return calloc(1, size);
+  return memset(allocator->alloc(allocator->context, size), 0, size);
+}
+static inline void *
+reallocate(const struct allocator *allocator, void *ptr, size_t old_size,
+           size_t new_size)
+{
+  if (!allocator)
+    return realloc(ptr, new_size);
+  if (!ptr)
+    return allocator->alloc(allocator->context, new_size);
+  return allocator->realloc(allocator->context, ptr, old_size, new_size);
+}
+static inline void
+deallocate(const struct allocator *allocator, void *ptr, size_t size)
+{
+  if (!allocator)
+    free(ptr);
+  else if (ptr)
+    allocator->free(allocator->context, ptr, size);
+}
+
+// The memory a hash table holds, in bytes, from table_memory_usage()
+struct memory_usage {
+  size_t table;     // The table itself
+  size_t bins;      // Bin arrays: keys, states, counts, or chain heads
+  size_t nodes;     // Chain links
+  size_t subtables; // The arrays of sub-tables in dynamic_chained_hash
+  size_t total;
+};
+
+#endif
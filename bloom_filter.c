@@ -0,0 +1,80 @@
+
+#include "bloom_filter.h"
+
+#include <stdlib.h>
+
+#define BITS_PER_KEY 10
+#define NO_PROBES 7    // Bits set per key; optimal for 10 bits per key
+#define BLOCK_WORDS 8  // 8 * 64 = 512 bits, one cache line
+#define BLOCK_BITS 512
+
+static inline uint64_t
+mix(uint64_t h)
+{
+  // MurmurHash3's 64-bit finaliser
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+static inline uint64_t *
+key_block(struct bloom_filter *filter, uint64_t h)
+{
+  // Use the high 32 bits to pick a block and keep the low bits for
+  // the bit positions.
+  uint64_t block = ((h >> 32) * filter->no_blocks) >> 32;
+  return filter->blocks + block * BLOCK_WORDS;
+}
+
+struct bloom_filter *
+new_bloom_filter(unsigned int capacity)
+{
+  struct bloom_filter *filter = malloc(sizeof *filter);
+  unsigned long long bits = (unsigned long long)capacity * BITS_PER_KEY;
+  unsigned int no_blocks = (unsigned int)((bits + BLOCK_BITS - 1) / BLOCK_BITS);
+  if (no_blocks == 0)
+    no_blocks = 1;
+  *filter = (struct bloom_filter){
+      .blocks = calloc((size_t)no_blocks * BLOCK_WORDS, sizeof(uint64_t)),
+      .no_blocks = no_blocks};
+  return filter;
+}
+
+void
+free_bloom_filter(struct bloom_filter *filter)
+{
+  free(filter->blocks);
+  free(filter);
+}
+
+void
+bloom_insert(struct bloom_filter *filter, unsigned int key)
+{
+  uint64_t h = mix(key);
+  uint64_t *block = key_block(filter, h);
+  // Nine bits of the rehashed key pick each bit in the block
+  uint64_t bits = mix(h);
+  for (int i = 0; i < NO_PROBES; i++, bits >>= 9) {
+    unsigned int bit = bits & (BLOCK_BITS - 1);
+    block[bit / 64] |= 1ULL << (bit % 64);
+  }
+}
+
+bool
+bloom_may_contain(struct bloom_filter *filter, unsigned int key)
+{
+  uint64_t h = mix(key);
+  uint64_t *block = key_block(filter, h);
+  uint64_t bits = mix(h);
+  bool found = true;
+  for (int i = 0; i < NO_PROBES; i++, bits >>= 9) {
+    unsigned int bit = bits & (BLOCK_BITS - 1);
+    // No early exit; the block is already in cache and the
+    // branch would be unpredictable.
+    found &= (block[bit / 64] >> (bit % 64)) & 1;
+  }
+  return found;
+}
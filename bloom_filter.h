@@ -0,0 +1,25 @@
+
+#ifndef BLOOM_FILTER_H
+#define BLOOM_FILTER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// A blocked Bloom filter. All the bits for a key are set in a single
+// 512-bit block, so a query touches one cache line.
+struct bloom_filter {
+  uint64_t *blocks;
+  unsigned int no_blocks;
+};
+
+struct bloom_filter *
+new_bloom_filter(unsigned int capacity);
+void
+free_bloom_filter(struct bloom_filter *filter);
+
+void
+bloom_insert(struct bloom_filter *filter, unsigned int key);
+bool
+bloom_may_contain(struct bloom_filter *filter, unsigned int key);
+
+#endif
@@ -4,14 +4,25 @@
 #include <stdlib.h>
 
 #include "linked_lists.h"
+#include "parallel.h"
+#include "trace.h"
 
 #define MIN_SIZE 8
 
+// Resizes to at least this many bins move the chains with
+// RESIZE_THREADS threads (0 means one per CPU).
+#ifndef PARALLEL_RESIZE_THRESHOLD
+#define PARALLEL_RESIZE_THRESHOLD (1 << 20)
+#endif
+#ifndef RESIZE_THREADS
+#define RESIZE_THREADS 0
+#endif
+
 LIST
 get_key_bin(struct hash_table *table, unsigned int key)
 {
-  unsigned int mask = table->size - 1;
-  unsigned int index = key & mask;
+  size_t mask = table->size - 1;
+  size_t index = key & mask;
   return table->bins + index;
 }
 
@@ -24,25 +35,62 @@ init_bins(struct hash_table *table)
 }
 
 struct hash_table *
-new_table()
+new_table_with_allocator(size_t keys, const struct allocator *allocator)
 {
-  struct hash_table *table = malloc(sizeof *table);
-  struct link **bins = malloc(MIN_SIZE * sizeof *bins);
-  *table = (struct hash_table){.bins = bins, .size = MIN_SIZE, .used = 0};
+  // We grow when used reaches size
+  size_t size = MIN_SIZE;
+  while (size <= keys)
+    size *= 2;
+
+  struct hash_table *table = allocate(allocator, sizeof *table);
+  struct link **bins = allocate(allocator, size * sizeof *bins);
+  *table = (struct hash_table){.bins = bins,
+                               .size = size,
+                               .used = 0,
+                               .resizes = 0,
+                               .reorder = NO_REORDER,
+                               .allocator = allocator};
   init_bins(table);
+  TRACE(TRACE_NEW_TABLE, table, keys, false);
   return table;
 }
 
+struct hash_table *
+new_table_with_capacity(size_t keys)
+{
+  return new_table_with_allocator(keys, NULL);
+}
+
+struct hash_table *
+new_table()
+{
+  return new_table_with_capacity(0);
+}
+
 void
 free_table(struct hash_table *table)
 {
+  TRACE(TRACE_DELETE_TABLE, table, 0, false);
   for (LIST bin = table->bins; bin < table->bins + table->size; bin++) {
-    free_list(bin);
+    free_list_with_allocator(bin, table->allocator);
   }
-  free(table->bins);
-  free(table);
+  deallocate(table->allocator, table->bins, table->size * sizeof *table->bins);
+  deallocate(table->allocator, table, sizeof *table);
 }
 
+void
+delete_table(struct hash_table *table)
+{
+  free_table(table);
+}
+
+void
+set_reorder(struct hash_table *table, enum reorder reorder)
+{
+  table->reorder = reorder;
+}
+
+// Move the links in old bins [from, to) to their bins in the table.
 static void
 copy_links(struct hash_table *table, LIST from, LIST to)
 {
@@ -59,34 +107,184 @@ copy_links(struct hash_table *table, LIST from, LIST to)
   }
 }
 
+struct migration {
+  struct hash_table *table;
+  LIST old_bins;
+  size_t old_size;
+};
+
+// Bins are indexed by the low bits of the key, so with
+// stride = min(old size, new size), the keys in old bin j move to a new
+// bin congruent to j modulo stride. A thread that handles the residues
+// [begin, end) owns the old and new bins in those classes, and doesn't
+// conflict with the other threads.
 static void
-resize(struct hash_table *table, unsigned int new_size)
+migrate_bins(unsigned int thread, size_t begin, size_t end, void *data)
+{
+  struct migration *migration = data;
+  struct hash_table *table = migration->table;
+  size_t old_size = migration->old_size;
+  size_t stride = old_size < table->size ? old_size : table->size;
+
+  for (size_t bin = begin; bin < table->size; bin += stride) {
+    for (size_t i = bin; i < bin + (end - begin); i++) {
+      table->bins[i] = NULL;
+    }
+  }
+  for (size_t bin = begin; bin < old_size; bin += stride) {
+    copy_links(table, migration->old_bins + bin,
+               migration->old_bins + bin + (end - begin));
+  }
+}
+
+static void
+resize(struct hash_table *table, size_t new_size)
 {
   // remember these so we can copy and free the old bins
-  struct link **old_bins = table->bins, **old_from = old_bins,
-              **old_to = old_from + table->size;
+  struct migration migration = {
+      .table = table, .old_bins = table->bins, .old_size = table->size};
 
   // set up the new table
-  table->bins = malloc(new_size * sizeof *table->bins);
+  table->bins = allocate(table->allocator, new_size * sizeof *table->bins);
   table->size = new_size;
-  init_bins(table);
+  table->resizes++;
 
-  // copy keys
-  copy_links(table, old_from, old_to);
+  // initialise the new bins and copy keys, in parallel for large tables
+  size_t stride = migration.old_size < new_size ? migration.old_size : new_size;
+  unsigned int threads =
+      (new_size >= PARALLEL_RESIZE_THRESHOLD) ? RESIZE_THREADS : 1;
+  parallel_for(threads, stride, migrate_bins, &migration);
 
   // free the old bins memory
-  free(old_bins);
+  deallocate(table->allocator, migration.old_bins,
+             migration.old_size * sizeof *migration.old_bins);
+}
+
+size_t
+no_keys(struct hash_table *table)
+{
+  return table->used;
+}
+
+void
+for_each_key(struct hash_table *table, void (*f)(unsigned int key, void *data),
+             void *data)
+{
+  for (LIST bin = table->bins; bin < table->bins + table->size; bin++) {
+    for (struct link *link = *bin; link; link = link->next) {
+      f(link->key, data);
+    }
+  }
+}
+
+size_t
+no_bins(struct hash_table *table)
+{
+  return table->size;
+}
+
+void
+for_each_key_in_bins(struct hash_table *table, size_t begin, size_t end,
+                     void (*f)(unsigned int key, void *data), void *data)
+{
+  for (LIST bin = table->bins + begin; bin < table->bins + end; bin++) {
+    for (struct link *link = *bin; link; link = link->next) {
+      f(link->key, data);
+    }
+  }
+}
+
+struct memory_usage
+table_memory_usage(struct hash_table *table)
+{
+  struct memory_usage usage = {.table = sizeof *table,
+                               .bins = table->size * sizeof *table->bins,
+                               .nodes = table->used * sizeof(struct link)};
+  usage.total = usage.table + usage.bins + usage.nodes;
+  return usage;
+}
+
+static size_t
+next_scan_bin(void *table, size_t bin)
+{
+  return next_reverse_binary(bin, ((struct hash_table *)table)->size - 1);
+}
+
+static void
+visit_scan_bin(void *table, size_t bin,
+               void (*f)(unsigned int key, void *data), void *data)
+{
+  struct hash_table *t = table;
+  for (struct link *link = t->bins[bin & (t->size - 1)]; link;
+       link = link->next) {
+    f(link->key, data);
+  }
+}
+
+unsigned int
+next_n(struct hash_table *table, struct cursor *cursor, unsigned int *keys,
+       unsigned int n)
+{
+  struct scan_bins bins = {.table = table,
+                           .stamp = table->resizes,
+                           .restart_on_resize = false,
+                           .next = next_scan_bin,
+                           .visit = visit_scan_bin};
+  return scan_next_n(cursor, &bins, keys, n);
+}
+
+// Resizing moves links but doesn't reallocate them, so the link stays
+// valid.
+static struct link *
+add_key(struct hash_table *table, unsigned int key, bool *added)
+{
+  struct link *link = get_or_add_element_with_allocator(
+      get_key_bin(table, key), key, added, table->allocator);
+  if (*added && ++table->used == table->size) {
+    resize(table, 2 * table->size);
+  }
+  return link;
+}
+
+bool
+try_insert(struct hash_table *table, unsigned int key)
+{
+  TRACE(TRACE_INSERT, table, key, false);
+  bool added;
+  struct link *link = add_key(table, key, &added);
+  if (added)
+    link->count = 1;
+  return added;
 }
 
 void
 insert_key(struct hash_table *table, unsigned int key)
 {
-  LIST bin = get_key_bin(table, key);
-  if (!contains_element(bin, key)) {
-    add_element(bin, key);
-    table->used++;
-    if (table->size == table->used) {
-      resize(table, 2 * table->size);
+  try_insert(table, key);
+}
+
+unsigned int *
+find_or_insert(struct hash_table *table, unsigned int key, bool *inserted)
+{
+  TRACE(TRACE_INSERT, table, key, false);
+  return &add_key(table, key, inserted)->count;
+}
+
+unsigned int
+key_count(struct hash_table *table, unsigned int key)
+{
+  struct link *link = get_element(get_key_bin(table, key), key);
+  return link ? link->count : 0;
+}
+
+void
+for_each_key_count(struct hash_table *table,
+                   void (*f)(unsigned int key, unsigned int count, void *data),
+                   void *data)
+{
+  for (LIST bin = table->bins; bin < table->bins + table->size; bin++) {
+    for (struct link *link = *bin; link; link = link->next) {
+      f(link->key, link->count, data);
     }
   }
 }
@@ -94,18 +292,28 @@ insert_key(struct hash_table *table, unsigned int key)
 bool
 contains_key(struct hash_table *table, unsigned int key)
 {
-  return contains_element(get_key_bin(table, key), key);
+  bool found = contains_element_reorder(get_key_bin(table, key), key,
+                                        table->reorder);
+  TRACE(TRACE_CONTAINS, table, key, found);
+  return found;
+}
+
+bool
+erase(struct hash_table *table, unsigned int key)
+{
+  TRACE(TRACE_DELETE, table, key, false);
+  if (!delete_element_with_allocator(get_key_bin(table, key), key,
+                                     table->allocator))
+    return false;
+  table->used--;
+  if (table->size > MIN_SIZE && table->used < table->size / 4) {
+    resize(table, table->size / 2);
+  }
+  return true;
 }
 
 void
 delete_key(struct hash_table *table, unsigned int key)
 {
-  LIST bin = get_key_bin(table, key);
-  if (contains_element(bin, key)) {
-    delete_element(bin, key);
-    table->used--;
-    if (table->size > MIN_SIZE && table->used < table->size / 4) {
-      resize(table, table->size / 2);
-    }
-  }
+  erase(table, key);
 }
@@ -4,18 +4,30 @@
 
 #include <stdbool.h>
 
+#include "allocator.h"
+#include "counting.h"
+#include "cursor.h"
 #include "linked_lists.h"
 
 struct hash_table {
   struct link **bins;
-  unsigned int size;
-  unsigned int used;
+  size_t size;
+  size_t used;
+  size_t resizes;       // Bumped whenever the links move to new bins
+  enum reorder reorder; // How lookups reorganise the chains
+  const struct allocator *allocator;
 };
 
 struct hash_table *
 new_table();
+struct hash_table *
+new_table_with_capacity(size_t keys);
+struct hash_table *
+new_table_with_allocator(size_t keys, const struct allocator *allocator);
 void
 free_table(struct hash_table *table);
+void
+delete_table(struct hash_table *table); // Same as free_table
 
 void
 insert_key(struct hash_table *table, unsigned int key);
@@ -24,4 +36,33 @@ contains_key(struct hash_table *table, unsigned int key);
 void
 delete_key(struct hash_table *table, unsigned int key);
 
+// insert_key and delete_key, telling us what they did: try_insert returns
+// false if the key was already there, and erase whether it was there.
+bool
+try_insert(struct hash_table *table, unsigned int key);
+bool
+erase(struct hash_table *table, unsigned int key);
+
+// Number of keys in the table
+size_t
+no_keys(struct hash_table *table);
+// Call f(key, data) for every key in the table
+void
+for_each_key(struct hash_table *table, void (*f)(unsigned int key, void *data),
+             void *data);
+// Bins and the keys in bins [begin, end)
+size_t
+no_bins(struct hash_table *table);
+void
+for_each_key_in_bins(struct hash_table *table, size_t begin, size_t end,
+                     void (*f)(unsigned int key, void *data), void *data);
+
+// The bytes the table holds
+struct memory_usage
+table_memory_usage(struct hash_table *table);
+
+// Make contains_key move found keys towards the front of their chain.
+void
+set_reorder(struct hash_table *table, enum reorder reorder);
+
 #endif
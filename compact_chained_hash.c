@@ -0,0 +1,369 @@
+
+#include "compact_chained_hash.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+
+#define MIN_BITS 3 // 8 bins
+
+// Average keys per bin before we double the table. We halve it when the
+// average drops below a quarter of this.
+#ifndef BIN_LOAD
+#define BIN_LOAD 8
+#endif
+// Blocks grow and shrink this many entries at a time
+#ifndef BLOCK_CHUNK
+#define BLOCK_CHUNK 4
+#endif
+
+// A block starts with its number of entries
+#define HEADER sizeof(uint32_t)
+
+static inline unsigned int
+quotient_bits(struct hash_table *table)
+{
+  return 32 - table->bits;
+}
+
+static inline uint32_t
+block_count(const uint8_t *block)
+{
+  uint32_t count;
+  memcpy(&count, block, sizeof count);
+  return count;
+}
+static inline void
+set_block_count(uint8_t *block, uint32_t count)
+{
+  memcpy(block, &count, sizeof count);
+}
+
+// The bytes in a block with count > 0 entries of q bits
+static inline size_t
+block_size(uint32_t count, unsigned int q)
+{
+  size_t capacity = (count + BLOCK_CHUNK - 1) / BLOCK_CHUNK * BLOCK_CHUNK;
+  return HEADER + (capacity * q + 7) / 8;
+}
+
+// Entry i is the q bits from bit i * q of data, least significant first.
+// It spans at most five bytes, and we only touch those.
+static inline uint32_t
+get_entry(const uint8_t *data, size_t i, unsigned int q)
+{
+  size_t bit = i * q;
+  const uint8_t *p = data + bit / 8;
+  unsigned int shift = bit % 8, bytes = (shift + q + 7) / 8;
+  uint64_t word = 0;
+  for (unsigned int b = 0; b < bytes; b++) {
+    word |= (uint64_t)p[b] << (8 * b);
+  }
+  return (uint32_t)((word >> shift) & (((uint64_t)1 << q) - 1));
+}
+
+static inline void
+set_entry(uint8_t *data, size_t i, unsigned int q, uint32_t value)
+{
+  size_t bit = i * q;
+  uint8_t *p = data + bit / 8;
+  unsigned int shift = bit % 8, bytes = (shift + q + 7) / 8;
+  uint64_t word = 0;
+  for (unsigned int b = 0; b < bytes; b++) {
+    word |= (uint64_t)p[b] << (8 * b);
+  }
+  uint64_t mask = (((uint64_t)1 << q) - 1) << shift;
+  word = (word & ~mask) | ((uint64_t)value << shift);
+  for (unsigned int b = 0; b < bytes; b++) {
+    p[b] = (uint8_t)(word >> (8 * b));
+  }
+}
+
+static inline uint8_t **
+get_key_bin(struct hash_table *table, unsigned int key)
+{
+  return table->bins + (key & (table->size - 1));
+}
+
+// The index of the entry with quotient in a block, or its count
+static uint32_t
+find_entry(const uint8_t *block, uint32_t quotient, unsigned int q)
+{
+  uint32_t count = block_count(block);
+  for (uint32_t i = 0; i < count; i++) {
+    if (get_entry(block + HEADER, i, q) == quotient)
+      return i;
+  }
+  return count;
+}
+
+// Change a bin's block from the size for `from` entries to the size for
+// `to`, where 0 entries means no block.
+static void
+resize_block(struct hash_table *table, uint8_t **bin, uint32_t from,
+             uint32_t to)
+{
+  unsigned int q = quotient_bits(table);
+  size_t old_size = from ? block_size(from, q) : 0,
+         new_size = to ? block_size(to, q) : 0;
+  if (old_size == new_size)
+    return;
+  if (new_size == 0) {
+    deallocate(table->allocator, *bin, old_size);
+    *bin = NULL;
+  } else {
+    *bin = reallocate(table->allocator, *bin, old_size, new_size);
+  }
+  table->block_bytes += new_size - old_size;
+}
+
+static void
+append_quotient(struct hash_table *table, uint8_t **bin, uint32_t quotient)
+{
+  uint32_t count = *bin ? block_count(*bin) : 0;
+  resize_block(table, bin, count, count + 1);
+  set_entry(*bin + HEADER, count, quotient_bits(table), quotient);
+  set_block_count(*bin, count + 1);
+}
+
+// Entries keep their order, so scans with cursors don't miss keys when
+// others are deleted.
+static void
+remove_entry(struct hash_table *table, uint8_t **bin, uint32_t i)
+{
+  unsigned int q = quotient_bits(table);
+  uint32_t count = block_count(*bin);
+  for (uint32_t j = i + 1; j < count; j++) {
+    set_entry(*bin + HEADER, j - 1, q, get_entry(*bin + HEADER, j, q));
+  }
+  if (count > 1)
+    set_block_count(*bin, count - 1);
+  resize_block(table, bin, count, count - 1);
+}
+
+static void
+init_bins(struct hash_table *table, unsigned int bits)
+{
+  table->bits = bits;
+  table->size = (size_t)1 << bits;
+  table->bins = allocate_zeroed(table->allocator,
+                                table->size * sizeof *table->bins);
+}
+
+struct hash_table *
+new_table_with_allocator(size_t keys, const struct allocator *allocator)
+{
+  unsigned int bits = MIN_BITS;
+  while (keys > ((size_t)BIN_LOAD << bits))
+    bits++;
+
+  struct hash_table *table = allocate(allocator, sizeof *table);
+  table->used = 0;
+  table->block_bytes = 0;
+  table->resizes = 0;
+  table->allocator = allocator;
+  init_bins(table, bits);
+  TRACE(TRACE_NEW_TABLE, table, keys, false);
+  return table;
+}
+
+struct hash_table *
+new_table_with_capacity(size_t keys)
+{
+  return new_table_with_allocator(keys, NULL);
+}
+
+struct hash_table *
+new_table()
+{
+  return new_table_with_capacity(0);
+}
+
+static void
+free_bins(struct hash_table *table, uint8_t **bins, size_t size,
+          unsigned int q)
+{
+  for (size_t bin = 0; bin < size; bin++) {
+    if (bins[bin]) {
+      size_t bytes = block_size(block_count(bins[bin]), q);
+      deallocate(table->allocator, bins[bin], bytes);
+      table->block_bytes -= bytes;
+    }
+  }
+  deallocate(table->allocator, bins, size * sizeof *bins);
+}
+
+void
+delete_table(struct hash_table *table)
+{
+  TRACE(TRACE_DELETE_TABLE, table, 0, false);
+  free_bins(table, table->bins, table->size, quotient_bits(table));
+  deallocate(table->allocator, table, sizeof *table);
+}
+
+// Rebuild the blocks for the new number of bits, putting each key back
+// together from its quotient and its old bin. Growing and shrinking back
+// can leave a bin's entries in another order, so cursors need to know.
+static void
+resize(struct hash_table *table, unsigned int new_bits)
+{
+  uint8_t **old_bins = table->bins;
+  size_t old_size = table->size;
+  unsigned int old_bits = table->bits, old_q = quotient_bits(table);
+
+  init_bins(table, new_bits);
+  table->resizes++;
+  for (size_t bin = 0; bin < old_size; bin++) {
+    uint8_t *block = old_bins[bin];
+    uint32_t count = block ? block_count(block) : 0;
+    for (uint32_t i = 0; i < count; i++) {
+      unsigned int key =
+          (unsigned int)(get_entry(block + HEADER, i, old_q) << old_bits) |
+          (unsigned int)bin;
+      append_quotient(table, get_key_bin(table, key), key >> new_bits);
+    }
+  }
+  free_bins(table, old_bins, old_size, old_q);
+}
+
+size_t
+no_keys(struct hash_table *table)
+{
+  return table->used;
+}
+
+static void
+visit_bin(struct hash_table *table, size_t bin,
+          void (*f)(unsigned int key, void *data), void *data)
+{
+  uint8_t *block = table->bins[bin];
+  if (!block)
+    return;
+  unsigned int q = quotient_bits(table);
+  uint32_t count = block_count(block);
+  for (uint32_t i = 0; i < count; i++) {
+    uint32_t quotient = get_entry(block + HEADER, i, q);
+    f((unsigned int)(quotient << table->bits) | (unsigned int)bin, data);
+  }
+}
+
+void
+for_each_key(struct hash_table *table, void (*f)(unsigned int key, void *data),
+             void *data)
+{
+  for_each_key_in_bins(table, 0, table->size, f, data);
+}
+
+size_t
+no_bins(struct hash_table *table)
+{
+  return table->size;
+}
+
+void
+for_each_key_in_bins(struct hash_table *table, size_t begin, size_t end,
+                     void (*f)(unsigned int key, void *data), void *data)
+{
+  for (size_t bin = begin; bin < end; bin++) {
+    visit_bin(table, bin, f, data);
+  }
+}
+
+static size_t
+next_scan_bin(void *table, size_t bin)
+{
+  return next_reverse_binary(bin, ((struct hash_table *)table)->size - 1);
+}
+
+static void
+visit_scan_bin(void *table, size_t bin,
+               void (*f)(unsigned int key, void *data), void *data)
+{
+  struct hash_table *t = table;
+  visit_bin(t, bin & (t->size - 1), f, data);
+}
+
+unsigned int
+next_n(struct hash_table *table, struct cursor *cursor, unsigned int *keys,
+       unsigned int n)
+{
+  struct scan_bins bins = {.table = table,
+                           .stamp = table->resizes,
+                           .restart_on_resize = false,
+                           .next = next_scan_bin,
+                           .visit = visit_scan_bin};
+  return scan_next_n(cursor, &bins, keys, n);
+}
+
+struct memory_usage
+table_memory_usage(struct hash_table *table)
+{
+  struct memory_usage usage = {.table = sizeof *table,
+                               .bins = table->size * sizeof *table->bins,
+                               .nodes = table->block_bytes};
+  usage.total = usage.table + usage.bins + usage.nodes;
+  return usage;
+}
+
+// The API functions are traced, so internally we use this instead.
+static bool
+has_key(struct hash_table *table, unsigned int key)
+{
+  uint8_t *block = *get_key_bin(table, key);
+  if (!block)
+    return false;
+  uint32_t quotient = key >> table->bits;
+  return find_entry(block, quotient, quotient_bits(table)) <
+         block_count(block);
+}
+
+bool
+try_insert(struct hash_table *table, unsigned int key)
+{
+  TRACE(TRACE_INSERT, table, key, false);
+  if (has_key(table, key))
+    return false;
+  append_quotient(table, get_key_bin(table, key), key >> table->bits);
+  if (++table->used > ((size_t)BIN_LOAD << table->bits))
+    resize(table, table->bits + 1);
+  return true;
+}
+
+void
+insert_key(struct hash_table *table, unsigned int key)
+{
+  try_insert(table, key);
+}
+
+bool
+contains_key(struct hash_table *table, unsigned int key)
+{
+  bool found = has_key(table, key);
+  TRACE(TRACE_CONTAINS, table, key, found);
+  return found;
+}
+
+bool
+erase(struct hash_table *table, unsigned int key)
+{
+  TRACE(TRACE_DELETE, table, key, false);
+  uint8_t **bin = get_key_bin(table, key);
+  if (!*bin)
+    return false;
+  uint32_t i = find_entry(*bin, key >> table->bits, quotient_bits(table));
+  if (i == block_count(*bin))
+    return false;
+  remove_entry(table, bin, i);
+  table->used--;
+  if (table->bits > MIN_BITS &&
+      table->used < ((size_t)BIN_LOAD << table->bits) / 4)
+    resize(table, table->bits - 1);
+  return true;
+}
+
+void
+delete_key(struct hash_table *table, unsigned int key)
+{
+  erase(table, key);
+}
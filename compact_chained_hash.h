@@ -0,0 +1,74 @@
+
+#ifndef COMPACT_CHAINED_HASH_H
+#define COMPACT_CHAINED_HASH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "allocator.h"
+#include "cursor.h"
+
+// Chaining with quotienting. A key's bin is its low `bits` bits, as in
+// chained_hash, so we only need to store the other 32 - bits bits, the
+// quotient, to get the key back. Instead of a linked list, each bin has a
+// block with the number of entries followed by the quotients packed at
+// 32 - bits bits each, and the block grows BLOCK_CHUNK entries at a time.
+// Bins hold BIN_LOAD keys on average, so a key costs a few bytes instead
+// of a struct link and its malloc header, and lookups scan one block
+// instead of following pointers.
+//
+// Quotients get one bit shorter every time the table doubles, so resizing
+// repacks all the blocks.
+struct hash_table {
+  uint8_t **bins; // NULL for an empty bin
+  size_t size;
+  unsigned int bits; // size is 1 << bits
+  size_t used;
+  size_t block_bytes; // Bytes in all the blocks
+  size_t resizes;     // Bumped whenever the blocks are rebuilt
+  const struct allocator *allocator;
+};
+
+struct hash_table *
+new_table(void);
+struct hash_table *
+new_table_with_capacity(size_t keys);
+struct hash_table *
+new_table_with_allocator(size_t keys, const struct allocator *allocator);
+void
+delete_table(struct hash_table *table);
+
+void
+insert_key(struct hash_table *table, unsigned int key);
+bool
+contains_key(struct hash_table *table, unsigned int key);
+void
+delete_key(struct hash_table *table, unsigned int key);
+
+// insert_key and delete_key, telling us what they did: try_insert returns
+// false if the key was already there, and erase whether it was there.
+bool
+try_insert(struct hash_table *table, unsigned int key);
+bool
+erase(struct hash_table *table, unsigned int key);
+
+// Number of keys in the table
+size_t
+no_keys(struct hash_table *table);
+// Call f(key, data) for every key in the table
+void
+for_each_key(struct hash_table *table, void (*f)(unsigned int key, void *data),
+             void *data);
+// Bins and the keys in bins [begin, end)
+size_t
+no_bins(struct hash_table *table);
+void
+for_each_key_in_bins(struct hash_table *table, size_t begin, size_t end,
+                     void (*f)(unsigned int key, void *data), void *data);
+
+// The bytes the table holds. The blocks count as nodes.
+struct memory_usage
+table_memory_usage(struct hash_table *table);
+
+#endif
@@ -0,0 +1,58 @@
+
+#include "compact_chained_hash.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// The keys survive the repacking when the table grows and shrinks, and
+// they take much less room than a struct link each.
+
+static unsigned int
+key(unsigned int i)
+{
+  return i * 2654435761U;
+}
+
+int
+main(int argc, const char *argv[])
+{
+  if (argc != 2) {
+    printf("Usage: %s no_elements\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  unsigned int no_elms = atoi(argv[1]);
+
+  struct hash_table *table = new_table();
+  for (unsigned int i = 0; i < no_elms; i++) {
+    insert_key(table, key(i));
+  }
+  for (unsigned int i = 0; i < no_elms; i++) {
+    assert(contains_key(table, key(i)));
+    assert(!contains_key(table, key(no_elms + i)));
+  }
+  // Keys that only differ in their quotients
+  assert(!contains_key(table, key(0) ^ 0x80000000U));
+
+  struct memory_usage usage = table_memory_usage(table);
+  double bytes_per_key = usage.total / (double)no_elms;
+  printf("bins: %zu, bytes per key: %.2f (%.2f in blocks)\n",
+         no_bins(table), bytes_per_key, usage.nodes / (double)no_elms);
+  assert(no_elms < 1000 || bytes_per_key < 8);
+
+  for (unsigned int i = 0; i < no_elms; i += 2) {
+    delete_key(table, key(i));
+  }
+  for (unsigned int i = 0; i < no_elms; i++) {
+    assert(contains_key(table, key(i)) == (i % 2 == 1));
+  }
+  for (unsigned int i = 1; i < no_elms; i += 2) {
+    delete_key(table, key(i));
+  }
+  assert(no_keys(table) == 0);
+  assert(no_bins(table) == 8);
+  assert(table_memory_usage(table).nodes == 0);
+
+  delete_table(table);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,79 @@
+
+#include "hash_table.h"
+#include "perf_counters.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "zipf.h"
+
+// Counting a stream of Zipf-distributed events, as for heavy hitters in
+// logs. We count with the fused increment_key, and the old way, with a
+// table of the distinct keys plus a table of their counts, where every
+// event looks the key up in both.
+
+int
+main(int argc, const char *argv[])
+{
+  if (argc != 3) {
+    printf("Usage: %s no_keys no_events\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  unsigned int key_range = atoi(argv[1]);
+  unsigned int no_events = atoi(argv[2]);
+
+  // Ranks scattered over the key space, so popular keys aren't neighbours
+  struct zipf *zipf = new_zipf(key_range, 1.0);
+  unsigned int *events = malloc(no_events * sizeof *events);
+  for (unsigned int i = 0; i < no_events; i++) {
+    events[i] = zipf_sample(zipf) * 2654435761U;
+  }
+  free_zipf(zipf);
+
+  struct perf_counters counters;
+  open_perf_counters(&counters);
+  print_perf_header();
+
+  struct hash_table *table = new_table();
+  start_perf_counters(&counters);
+  for (unsigned int i = 0; i < no_events; i++) {
+    increment_key(table, events[i], 1);
+  }
+  stop_perf_counters(&counters);
+  print_perf_counters("increment", &counters, no_events);
+
+  struct hash_table *distinct = new_table(), *counts = new_table();
+  start_perf_counters(&counters);
+  for (unsigned int i = 0; i < no_events; i++) {
+    insert_key(distinct, events[i]);
+    increment_key(counts, events[i], 1);
+  }
+  stop_perf_counters(&counters);
+  print_perf_counters("set + counter map", &counters, no_events);
+
+  struct key_count top[10];
+  start_perf_counters(&counters);
+  size_t no_top = top_k(table, 10, top);
+  stop_perf_counters(&counters);
+  print_perf_counters("top 10", &counters, no_keys(table));
+
+  // Rank 0, key 0, is the most frequent
+  bool ok = no_top > 0 && top[0].key == 0 &&
+            no_keys(table) == no_keys(distinct) &&
+            key_count(table, 0) == key_count(counts, 0);
+  for (size_t i = 0; i < no_top; i++) {
+    printf("%u\t%u\n", top[i].key, top[i].count);
+  }
+
+  close_perf_counters(&counters);
+  delete_table(counts);
+  delete_table(distinct);
+  delete_table(table);
+  free(events);
+
+  if (!ok) {
+    printf("The counts are wrong\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,86 @@
+
+#include "counting.h"
+
+unsigned int
+increment_key(struct hash_table *table, unsigned int key, unsigned int delta)
+{
+  bool inserted;
+  return *find_or_insert(table, key, &inserted) += delta;
+}
+
+// top_k keeps the best keys seen so far in a heap with the worst of them
+// at the root, so a new key only has to beat the root to get in.
+struct heap {
+  struct key_count *elms;
+  size_t size;
+  size_t k;
+};
+
+// a ranks above b
+static inline bool
+above(struct key_count a, struct key_count b)
+{
+  return a.count > b.count || (a.count == b.count && a.key < b.key);
+}
+
+static void
+sift_down(struct key_count *elms, size_t size, size_t i)
+{
+  for (;;) {
+    size_t worst = i, left = 2 * i + 1, right = 2 * i + 2;
+    if (left < size && above(elms[worst], elms[left]))
+      worst = left;
+    if (right < size && above(elms[worst], elms[right]))
+      worst = right;
+    if (worst == i)
+      return;
+    struct key_count tmp = elms[i];
+    elms[i] = elms[worst];
+    elms[worst] = tmp;
+    i = worst;
+  }
+}
+
+static void
+sift_up(struct key_count *elms, size_t i)
+{
+  while (i > 0 && above(elms[(i - 1) / 2], elms[i])) {
+    struct key_count tmp = elms[i];
+    elms[i] = elms[(i - 1) / 2];
+    elms[(i - 1) / 2] = tmp;
+    i = (i - 1) / 2;
+  }
+}
+
+static void
+offer(unsigned int key, unsigned int count, void *data)
+{
+  struct heap *heap = data;
+  struct key_count elm = {.key = key, .count = count};
+  if (heap->size < heap->k) {
+    heap->elms[heap->size] = elm;
+    sift_up(heap->elms, heap->size++);
+  } else if (above(elm, heap->elms[0])) {
+    heap->elms[0] = elm;
+    sift_down(heap->elms, heap->size, 0);
+  }
+}
+
+size_t
+top_k(struct hash_table *table, size_t k, struct key_count *top)
+{
+  if (k == 0)
+    return 0;
+  struct heap heap = {.elms = top, .size = 0, .k = k};
+  for_each_key_count(table, offer, &heap);
+
+  // Heap sort; taking the worst first and filling from the back leaves
+  // the best first.
+  for (size_t n = heap.size; n > 1; n--) {
+    struct key_count worst = top[0];
+    top[0] = top[n - 1];
+    top[n - 1] = worst;
+    sift_down(top, n - 1, 0);
+  }
+  return heap.size;
+}
@@ -0,0 +1,44 @@
+
+#ifndef COUNTING_H
+#define COUNTING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Tables as multisets, for counting occurrences. Every key in a table has
+// a count; insert_key adds keys with count 1 and leaves the count of keys
+// that are already there alone, so a table used as a set sees every count
+// as 1. delete_key removes a key whatever its count. Counts are unsigned
+// ints and wrap around like them.
+struct key_count {
+  unsigned int key;
+  unsigned int count;
+};
+
+struct hash_table;
+
+// Add delta to key's count and return the new count. If key isn't in the
+// table we add it with count 0 first. This takes a single lookup.
+unsigned int
+increment_key(struct hash_table *table, unsigned int key, unsigned int delta);
+// The same with a handle on key's count, to update as the caller likes.
+// Sets *inserted if we added the key. The handle is only good until the
+// table is next modified.
+unsigned int *
+find_or_insert(struct hash_table *table, unsigned int key, bool *inserted);
+// The count of key, or 0 if it isn't in the table
+unsigned int
+key_count(struct hash_table *table, unsigned int key);
+// Call f(key, count, data) for every key in the table
+void
+for_each_key_count(struct hash_table *table,
+                   void (*f)(unsigned int key, unsigned int count, void *data),
+                   void *data);
+
+// Write the (up to) k keys with the highest counts to top, highest first,
+// and return how many we wrote. Of keys with the same count, the smaller
+// key comes first. Takes time O(n log k) for n keys in the table.
+size_t
+top_k(struct hash_table *table, size_t k, struct key_count *top);
+
+#endif
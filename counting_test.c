@@ -0,0 +1,165 @@
+
+#include "hash_table.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Keys 0, ..., n - 1, with reference counts in an array
+
+static int
+compare_ranks(const void *a, const void *b)
+{
+  const struct key_count *x = a, *y = b;
+  if (x->count != y->count)
+    return x->count > y->count ? -1 : 1;
+  return x->key < y->key ? -1 : (x->key > y->key);
+}
+
+static void
+check_counts(struct hash_table *table, unsigned int *counts, unsigned int n,
+             bool *present)
+{
+  for (unsigned int key = 0; key < n; key++) {
+    assert(key_count(table, key) == (present[key] ? counts[key] : 0));
+  }
+}
+
+static void
+sum_count(unsigned int key, unsigned int count, void *data)
+{
+  *(unsigned long long *)data += count;
+}
+
+// Check top_k against sorting all the keys
+static void
+check_top_k(struct hash_table *table, unsigned int *counts, unsigned int n,
+            bool *present, size_t k)
+{
+  struct key_count *expected = malloc(n * sizeof *expected);
+  size_t no_present = 0;
+  for (unsigned int key = 0; key < n; key++) {
+    if (present[key])
+      expected[no_present++] =
+          (struct key_count){.key = key, .count = counts[key]};
+  }
+  qsort(expected, no_present, sizeof *expected, compare_ranks);
+
+  struct key_count *top = malloc((k + 1) * sizeof *top);
+  size_t written = top_k(table, k, top);
+  assert(written == (k < no_present ? k : no_present));
+  for (size_t i = 0; i < written; i++) {
+    assert(top[i].key == expected[i].key);
+    assert(top[i].count == expected[i].count);
+  }
+  free(top);
+  free(expected);
+}
+
+int
+main(int argc, const char *argv[])
+{
+  if (argc != 2) {
+    printf("Usage: %s no_elements\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  unsigned int n = atoi(argv[1]);
+  unsigned int *counts = calloc(n, sizeof *counts);
+  bool *present = calloc(n, sizeof *present);
+
+  // Key i is incremented on the rounds i is divisible by, so small keys
+  // get the highest counts, with many ties.
+  // We count the increments that return the wrong count, rather than
+  // call increment_key in an assert, which NDEBUG would take out.
+  struct hash_table *table = new_table();
+  unsigned int wrong = 0;
+  for (unsigned int round = 1; round <= 8; round++) {
+    for (unsigned int key = 0; key < n; key += round) {
+      unsigned int delta = key % 3 + 1;
+      counts[key] += delta;
+      present[key] = true;
+      wrong += increment_key(table, key, delta) != counts[key];
+    }
+  }
+  assert(wrong == 0);
+  assert(no_keys(table) == n);
+  check_counts(table, counts, n, present);
+  assert(key_count(table, n) == 0);
+
+  unsigned long long total = 0, expected_total = 0;
+  for_each_key_count(table, sum_count, &total);
+  for (unsigned int key = 0; key < n; key++) {
+    expected_total += counts[key];
+  }
+  assert(total == expected_total);
+
+  check_top_k(table, counts, n, present, 0);
+  check_top_k(table, counts, n, present, 1);
+  check_top_k(table, counts, n, present, 10);
+  check_top_k(table, counts, n, present, n + 10);
+
+  // insert_key leaves counts alone
+  for (unsigned int key = 0; key < n; key++) {
+    insert_key(table, key);
+  }
+  check_counts(table, counts, n, present);
+
+  // Deleting shrinks the table, and the counts move with the keys
+  for (unsigned int key = 0; key < n; key++) {
+    if (key % 8 != 0) {
+      delete_key(table, key);
+      present[key] = false;
+    }
+  }
+  check_counts(table, counts, n, present);
+  check_top_k(table, counts, n, present, 10);
+
+  // Keys come back with fresh counts
+  for (unsigned int key = 1; key < n; key += 8) {
+    counts[key] = 0;
+    wrong += increment_key(table, key, 0) != 0;
+    present[key] = true;
+  }
+  assert(wrong == 0);
+  check_counts(table, counts, n, present);
+
+  // find_or_insert hands out the count, for the caller to update
+  bool inserted;
+  unsigned int *count = find_or_insert(table, 0, &inserted);
+  assert(!inserted && *count == counts[0]);
+  *count += 7;
+  counts[0] += 7;
+  count = find_or_insert(table, n, &inserted);
+  assert(inserted && *count == 0);
+  *count = 3;
+  assert(key_count(table, n) == 3);
+  check_counts(table, counts, n, present);
+  delete_table(table);
+
+  // A table used as a set counts every key once, until we start counting
+  table = new_table();
+  for (unsigned int key = 0; key < n; key++) {
+    insert_key(table, key);
+    counts[key] = 1;
+    present[key] = true;
+  }
+  check_counts(table, counts, n, present);
+  for (unsigned int key = 0; key < n; key += 2) {
+    counts[key] += 5;
+    wrong += increment_key(table, key, 5) != counts[key];
+  }
+  assert(wrong == 0);
+  for (unsigned int key = n; key < 2 * n; key++) {
+    insert_key(table, key); // Grows the table with counting on
+  }
+  check_counts(table, counts, n, present);
+  for (unsigned int key = n; key < 2 * n; key++) {
+    assert(key_count(table, key) == 1);
+  }
+  check_top_k(table, counts, n, present, 10);
+  delete_table(table);
+
+  free(present);
+  free(counts);
+  return EXIT_SUCCESS;
+}
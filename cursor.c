@@ -0,0 +1,74 @@
+
+#include "cursor.h"
+
+// Copies keys from a bin to the caller's buffer, after skipping past
+// cursor->last_key if we are resuming a partially scanned bin.
+struct fill {
+  struct cursor *cursor;
+  unsigned int *keys;
+  unsigned int n;
+  unsigned int written;
+  bool skipping; // Still looking for last_key
+  bool full;     // The bin had more keys than fit
+};
+
+static void
+fill_key(unsigned int key, void *data)
+{
+  struct fill *fill = data;
+  if (fill->skipping) {
+    fill->skipping = (key != fill->cursor->last_key);
+  } else if (fill->written < fill->n) {
+    fill->keys[fill->written++] = key;
+    fill->cursor->last_key = key;
+  } else {
+    fill->full = true;
+  }
+}
+
+unsigned int
+scan_next_n(struct cursor *cursor, struct scan_bins *bins, unsigned int *keys,
+            unsigned int n)
+{
+  if (cursor->done)
+    return 0;
+
+  if (cursor->stamp != bins->stamp) {
+    // The keys in a partial bin may have moved, so redo it.
+    cursor->partial = false;
+    if (bins->restart_on_resize)
+      cursor->bin = 0;
+    cursor->stamp = bins->stamp;
+  }
+
+  struct fill fill = {.cursor = cursor, .keys = keys, .n = n, .written = 0};
+  while (fill.written < n) {
+    unsigned int written = fill.written;
+    fill.skipping = cursor->partial;
+    fill.full = false;
+    bins->visit(bins->table, cursor->bin, fill_key, &fill);
+    if (fill.skipping) {
+      // last_key is gone, so start the bin over.
+      fill.skipping = false;
+      fill.written = written;
+      bins->visit(bins->table, cursor->bin, fill_key, &fill);
+    }
+
+    cursor->partial = fill.full;
+    if (fill.full)
+      break;
+
+    cursor->bin = bins->next(bins->table, cursor->bin);
+    if (cursor->bin == 0) {
+      cursor->done = true;
+      break;
+    }
+  }
+  return fill.written;
+}
+
+bool
+next_key(struct hash_table *table, struct cursor *cursor, unsigned int *key)
+{
+  return next_n(table, cursor, key, 1) == 1;
+}
@@ -0,0 +1,82 @@
+
+#ifndef CURSOR_H
+#define CURSOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Cursors for scanning the keys in a table. A scan returns every key that
+// is in the table for the whole scan at least once, even if the table is
+// resized between calls. Keys inserted or deleted during the scan may or
+// may not be returned, and after a resize some keys can be returned twice.
+//
+// Power-of-two tables visit their bins in reverse-binary order, as in
+// Redis' SCAN. When the table doubles, bin i splits into bins i and
+// i + size, and when it halves they merge again; in both cases the bins
+// already visited in this order are exactly the ones the cursor has
+// passed. Backends without that property restart a scan when they resize.
+//
+// Lookups that reorder chains (set_reorder) can move keys the scan has not
+// reached behind it, so don't combine them with scans.
+struct cursor {
+  size_t bin;            // Position in the scan; 0 at the start
+  size_t stamp;          // The table's stamp at the last call
+  unsigned int last_key; // Last key returned from a partially scanned bin
+  bool partial;          // We stopped part-way through `bin`
+  bool done;
+};
+
+#define NEW_CURSOR                                                             \
+  ((struct cursor){.bin = 0, .stamp = 0, .partial = false, .done = false})
+
+struct hash_table;
+
+// Write up to n keys to keys and return how many we wrote. Returns 0 when
+// the scan is done.
+unsigned int
+next_n(struct hash_table *table, struct cursor *cursor, unsigned int *keys,
+       unsigned int n);
+// Get the next key. Returns false when the scan is done.
+bool
+next_key(struct hash_table *table, struct cursor *cursor, unsigned int *key);
+
+// The rest is for implementing next_n in the backends.
+
+// A backend's view of its bins during a scan. Bins are scanned from 0,
+// and next() returns 0 after the last one.
+struct scan_bins {
+  void *table;
+  size_t stamp;           // Changes whenever keys move between bins
+  bool restart_on_resize; // Start over when the stamp changes
+  size_t (*next)(void *table, size_t bin);
+  void (*visit)(void *table, size_t bin,
+                void (*f)(unsigned int key, void *data), void *data);
+};
+
+unsigned int
+scan_next_n(struct cursor *cursor, struct scan_bins *bins, unsigned int *keys,
+            unsigned int n);
+
+// The bin after `bin` in reverse-binary order, for bin indices masked
+// with mask. Increment the reversed index; the bits above the mask are set
+// first so the carry runs through them. We work in 64 bits whatever the
+// size of size_t.
+static inline uint64_t
+reverse_bits(uint64_t v)
+{
+  v = ((v >> 1) & 0x5555555555555555u) | ((v & 0x5555555555555555u) << 1);
+  v = ((v >> 2) & 0x3333333333333333u) | ((v & 0x3333333333333333u) << 2);
+  v = ((v >> 4) & 0x0f0f0f0f0f0f0f0fu) | ((v & 0x0f0f0f0f0f0f0f0fu) << 4);
+  v = ((v >> 8) & 0x00ff00ff00ff00ffu) | ((v & 0x00ff00ff00ff00ffu) << 8);
+  v = ((v >> 16) & 0x0000ffff0000ffffu) | ((v & 0x0000ffff0000ffffu) << 16);
+  return (v >> 32) | (v << 32);
+}
+static inline size_t
+next_reverse_binary(size_t bin, size_t mask)
+{
+  return (size_t)reverse_bits(reverse_bits((uint64_t)bin | ~(uint64_t)mask) +
+                              1);
+}
+
+#endif
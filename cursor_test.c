@@ -0,0 +1,181 @@
+
+#include "hash_table.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Stable keys are even and never deleted; the odd ones come and go
+// while we scan.
+static unsigned int
+stable_key(unsigned int i)
+{
+  return 2 * i;
+}
+static unsigned int
+volatile_key(unsigned int i)
+{
+  return 2 * i + 1;
+}
+
+// Grow the table with n volatile keys and delete them again
+static void
+churn(struct hash_table *table, unsigned int n)
+{
+  for (unsigned int i = 0; i < n; i++) {
+    insert_key(table, volatile_key(i));
+  }
+  for (unsigned int i = 0; i < n; i++) {
+    delete_key(table, volatile_key(i));
+  }
+}
+
+// Scan with batches of n keys and count how often we see each key
+static void
+scan_all(struct hash_table *table, unsigned int *seen, unsigned int range,
+         unsigned int n)
+{
+  unsigned int *keys = malloc(n * sizeof *keys);
+  struct cursor cursor = NEW_CURSOR;
+  unsigned int written;
+  while ((written = next_n(table, &cursor, keys, n))) {
+    assert(written <= n);
+    for (unsigned int i = 0; i < written; i++) {
+      assert(keys[i] < range);
+      seen[keys[i]]++;
+    }
+  }
+  // A finished scan stays finished
+  assert(next_n(table, &cursor, keys, n) == 0);
+  free(keys);
+}
+
+static void
+check_exactly_once(struct hash_table *table, unsigned int *seen,
+                   unsigned int range)
+{
+  unsigned int total = 0;
+  for (unsigned int key = 0; key < range; key++) {
+    assert(seen[key] == contains_key(table, key));
+    total += seen[key];
+  }
+  assert(total == no_keys(table));
+}
+
+int
+main(int argc, const char *argv[])
+{
+  if (argc != 2) {
+    printf("Usage: %s no_elements\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  unsigned int no_elms = atoi(argv[1]);
+  unsigned int range = 2 * 4 * no_elms;
+  unsigned int *seen = calloc(range, sizeof *seen);
+
+  struct hash_table *table = new_table();
+
+  // An empty table has nothing to scan
+  struct cursor cursor = NEW_CURSOR;
+  unsigned int key;
+  assert(!next_key(table, &cursor, &key));
+
+  for (unsigned int i = 0; i < no_elms; i++) {
+    insert_key(table, stable_key(i));
+  }
+
+  // Without updates we see every key exactly once, for any batch size.
+  unsigned int batch_sizes[] = {1, 2, 7, 1000};
+  for (unsigned int i = 0; i < sizeof batch_sizes / sizeof *batch_sizes; i++) {
+    memset(seen, 0, range * sizeof *seen);
+    scan_all(table, seen, range, batch_sizes[i]);
+    check_exactly_once(table, seen, range);
+  }
+
+  memset(seen, 0, range * sizeof *seen);
+  cursor = NEW_CURSOR;
+  while (next_key(table, &cursor, &key)) {
+    seen[key]++;
+  }
+  check_exactly_once(table, seen, range);
+
+  // Grow the table to several times its size and shrink it back while we
+  // scan. We must still see all the stable keys.
+  memset(seen, 0, range * sizeof *seen);
+  cursor = NEW_CURSOR;
+  unsigned int keys[3];
+  unsigned int no_volatile = 3 * no_elms, per_batch = no_volatile / 16 + 1;
+  unsigned int inserted = 0, deleted = 0;
+  for (unsigned int batch = 0;; batch++) {
+    unsigned int written = next_n(table, &cursor, keys, 3);
+    if (written == 0)
+      break;
+    for (unsigned int i = 0; i < written; i++) {
+      assert(keys[i] < range);
+      seen[keys[i]]++;
+    }
+
+    for (unsigned int i = 0; i < per_batch; i++) {
+      if (batch < 16 && inserted < no_volatile) {
+        insert_key(table, volatile_key(inserted++));
+      } else if (batch >= 16 && deleted < inserted) {
+        delete_key(table, volatile_key(deleted++));
+      }
+    }
+  }
+  while (deleted < inserted) {
+    delete_key(table, volatile_key(deleted++));
+  }
+  for (unsigned int i = 0; i < no_elms; i++) {
+    assert(seen[stable_key(i)] >= 1);
+  }
+  assert(no_keys(table) == no_elms);
+  delete_table(table);
+
+  // Grow a small table and shrink it back to the same size between two
+  // calls, stopping part-way through a bin first. The keys in the bin can
+  // come back in another order, and we must still see all of them. We try
+  // keys spread over the bins, and keys that are all in one bin while the
+  // table has at most 256 bins.
+  // Tables shrink later than they grow, so we grow and shrink once before
+  // the scan, less than during it, which leaves the keys in another order.
+  // The churn during the scan then ends at the size it started from.
+  // Prime sizes can go through a cycle of sizes instead, so we churn until
+  // we are back.
+  unsigned int no_small = 24, spreads[] = {2, 256};
+  for (unsigned int s = 0; s < sizeof spreads / sizeof *spreads; s++) {
+    for (unsigned int stop = 1; stop < no_small; stop++) {
+      table = new_table();
+      for (unsigned int i = 0; i < no_small; i++) {
+        insert_key(table, spreads[s] * i);
+      }
+      churn(table, 12 * no_small);
+      size_t bins = no_bins(table);
+      memset(seen, 0, range * sizeof *seen);
+      cursor = NEW_CURSOR;
+      for (unsigned int i = 0; i < stop; i++) {
+        bool more = next_key(table, &cursor, &key);
+        assert(more);
+        seen[key]++;
+      }
+      unsigned int churns = 0;
+      do {
+        churn(table, 24 * no_small);
+      } while (no_bins(table) != bins && ++churns < 16);
+      assert(no_bins(table) == bins);
+      while (next_key(table, &cursor, &key)) {
+        seen[key]++;
+      }
+      for (unsigned int i = 0; i < no_small; i++) {
+        assert(seen[spreads[s] * i] >= 1);
+      }
+      delete_table(table);
+    }
+  }
+
+  free(seen);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,133 @@
+
+#include "deque.h"
+
+#include <stdlib.h>
+
+// The memory orders follow Lê, Pop, Cohen and Zappa Nardelli, "Correct
+// and Efficient Work-Stealing for Weak Memory Models" (PPoPP 2013).
+
+struct deque_array {
+  long size; // A power of two
+  struct deque_array *previous;
+  atomic_int values[];
+};
+
+static struct deque_array *
+new_array(long size)
+{
+  struct deque_array *array =
+      malloc(sizeof *array + size * sizeof *array->values);
+  array->size = size;
+  array->previous = NULL;
+  return array;
+}
+
+static inline atomic_int *
+slot(struct deque_array *array, long i)
+{
+  return &array->values[i & (array->size - 1)];
+}
+
+struct deque *
+new_deque()
+{
+  struct deque *deque = malloc(sizeof *deque);
+  atomic_init(&deque->top, 0);
+  atomic_init(&deque->bottom, 0);
+  atomic_init(&deque->array, new_array(1));
+  deque->retired = NULL;
+  return deque;
+}
+
+void
+free_deque(struct deque *deque)
+{
+  free(atomic_load_explicit(&deque->array, memory_order_relaxed));
+  while (deque->retired) {
+    struct deque_array *previous = deque->retired->previous;
+    free(deque->retired);
+    deque->retired = previous;
+  }
+  free(deque);
+}
+
+// Copy the live range [top, bottom) to an array twice the size
+static struct deque_array *
+grow(struct deque *deque, struct deque_array *array, long top, long bottom)
+{
+  struct deque_array *new = new_array(2 * array->size);
+  for (long i = top; i < bottom; i++) {
+    int value = atomic_load_explicit(slot(array, i), memory_order_relaxed);
+    atomic_store_explicit(slot(new, i), value, memory_order_relaxed);
+  }
+  atomic_store_explicit(&deque->array, new, memory_order_release);
+  array->previous = deque->retired;
+  deque->retired = array;
+  return new;
+}
+
+void
+deque_push(struct deque *deque, int value)
+{
+  long bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+  long top = atomic_load_explicit(&deque->top, memory_order_acquire);
+  struct deque_array *array =
+      atomic_load_explicit(&deque->array, memory_order_relaxed);
+  if (bottom - top > array->size - 1)
+    array = grow(deque, array, top, bottom);
+  atomic_store_explicit(slot(array, bottom), value, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+}
+
+bool
+deque_pop(struct deque *deque, int *value)
+{
+  long bottom =
+      atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+  struct deque_array *array =
+      atomic_load_explicit(&deque->array, memory_order_relaxed);
+  // Claim the bottom value before we look at the top, so a thief either
+  // sees the claim or we see its steal.
+  atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+  long top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+  if (top > bottom) {
+    // Empty
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    return false;
+  }
+
+  *value = atomic_load_explicit(slot(array, bottom), memory_order_relaxed);
+  if (top < bottom)
+    return true; // More than one value, so no thief can take this one
+
+  // The last value. Race the thieves for it.
+  bool won = atomic_compare_exchange_strong_explicit(
+      &deque->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed);
+  atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+  return won;
+}
+
+bool
+deque_steal(struct deque *deque, int *value)
+{
+  long top = atomic_load_explicit(&deque->top, memory_order_acquire);
+  atomic_thread_fence(memory_order_seq_cst);
+  long bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+  if (top >= bottom)
+    return false;
+
+  // The array could have grown since we read bottom, but the old one still
+  // holds the value at top.
+  struct deque_array *array =
+      atomic_load_explicit(&deque->array, memory_order_acquire);
+  int stolen = atomic_load_explicit(slot(array, top), memory_order_relaxed);
+  if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1,
+                                               memory_order_seq_cst,
+                                               memory_order_relaxed))
+    return false;
+  *value = stolen;
+  return true;
+}
@@ -0,0 +1,44 @@
+
+#ifndef DEQUE_H
+#define DEQUE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+// A Chase-Lev work-stealing deque. It is the stack from stack.c, but a
+// circular array, and other threads can steal from the far end. The
+// owner pushes and pops at the bottom, in LIFO order. Any other thread can
+// steal the oldest value from the top.
+//
+// Push needs no atomic read-modify-write, only a release fence. Pop needs
+// a full fence, and a CAS only when it takes the last value, the one a
+// thief could be after. Thieves always CAS on the top.
+//
+// The array doubles when it is full and never shrinks. Thieves can still
+// be reading the old array, so we keep old arrays until free_deque.
+struct deque_array;
+struct deque {
+  atomic_long top;    // Thieves take from here
+  atomic_long bottom; // The owner pushes and pops here
+  _Atomic(struct deque_array *) array;
+  struct deque_array *retired; // Old arrays; only the owner touches them
+};
+
+struct deque *
+new_deque(void);
+void
+free_deque(struct deque *deque);
+
+// Only the owning thread can push and pop.
+void
+deque_push(struct deque *deque, int value);
+// Returns false if the deque is empty
+bool
+deque_pop(struct deque *deque, int *value);
+
+// Any thread can steal. Returns false if the deque is empty or another
+// thread got the value first.
+bool
+deque_steal(struct deque *deque, int *value);
+
+#endif
@@ -0,0 +1,120 @@
+
+#include "deque.h"
+#include "parallel.h"
+
+#include <assert.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static void
+test_sequential(void)
+{
+  struct deque *deque = new_deque();
+  int value;
+  assert(!deque_pop(deque, &value));
+  assert(!deque_steal(deque, &value));
+
+  for (int i = 0; i < 100; ++i) {
+    deque_push(deque, i);
+  }
+  // The owner gets the newest, thieves the oldest. We count the values
+  // that come out right and assert on the count, so the deque still
+  // empties when NDEBUG takes out the asserts.
+  int right = 0;
+  right += deque_pop(deque, &value) && value == 99;
+  right += deque_steal(deque, &value) && value == 0;
+  right += deque_steal(deque, &value) && value == 1;
+  for (int i = 98; i >= 2; --i) {
+    right += deque_pop(deque, &value) && value == i;
+  }
+  assert(right == 100);
+  assert(!deque_pop(deque, &value));
+  assert(!deque_steal(deque, &value));
+
+  // Wrap around the circular array
+  right = 0;
+  for (int i = 0; i < 1000; ++i) {
+    deque_push(deque, i);
+    right += deque_steal(deque, &value) && value == i;
+  }
+  assert(right == 1000);
+
+  free_deque(deque);
+}
+
+// The owner pushes every value in [0, n) and pops some of them back, while
+// the other threads steal. Each value must be taken exactly once.
+struct race {
+  struct deque *deque;
+  int n;
+  atomic_int *taken;
+  atomic_int done;
+};
+
+static void
+take(struct race *race, int value)
+{
+  assert(value >= 0 && value < race->n);
+  atomic_fetch_add(&race->taken[value], 1);
+}
+
+static void
+race_thread(unsigned int thread, size_t begin, size_t end, void *data)
+{
+  struct race *race = data;
+  int value;
+  if (thread == 0) {
+    for (int i = 0; i < race->n; ++i) {
+      deque_push(race->deque, i);
+      if (i % 3 == 0 && deque_pop(race->deque, &value))
+        take(race, value);
+    }
+    while (deque_pop(race->deque, &value)) {
+      take(race, value);
+    }
+    atomic_store(&race->done, 1);
+  } else {
+    while (!atomic_load(&race->done)) {
+      if (deque_steal(race->deque, &value))
+        take(race, value);
+      else
+        sched_yield();
+    }
+  }
+}
+
+static void
+test_race(int n, unsigned int no_threads)
+{
+  struct race race = {.deque = new_deque(),
+                      .n = n,
+                      .taken = calloc(n, sizeof *race.taken)};
+  atomic_init(&race.done, 0);
+  parallel_for(no_threads, no_threads, race_thread, &race);
+
+  // The owner only stops when its pops fail, and the deque is empty then
+  int value;
+  assert(!deque_steal(race.deque, &value));
+  for (int i = 0; i < n; ++i) {
+    assert(atomic_load(&race.taken[i]) == 1);
+  }
+
+  free(race.taken);
+  free_deque(race.deque);
+}
+
+int
+main(int argc, const char *argv[])
+{
+  if (argc != 2) {
+    printf("Usage: %s no_elements\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  int no_elms = atoi(argv[1]);
+
+  test_sequential();
+  test_race(no_elms, 4);
+
+  return EXIT_SUCCESS;
+}
@@ -5,6 +5,7 @@
 #include <stdlib.h>
 
 #include "linked_lists.h"
+#include "trace.h"
 
 static const unsigned int SUBTABLE_BITS = 3; // 8 bins to a sub-table
 
@@ -16,40 +17,46 @@ struct hash_table {
   subtable *tables; // Tables is an array of sub-tables
 
   unsigned int table_bits; // Bits used for indexing into sub-tables
-  unsigned int split;      // Pointer to the bin we need to split/merge
+  size_t split;            // Pointer to the bin we need to split/merge
+  size_t resizes;          // Bumped by every split and merge
 
-  unsigned int allocated_subtables; // Number of sub-tables allocated
+  size_t allocated_subtables; // Number of sub-tables allocated
+  size_t tables_capacity;     // Length of the tables array
+
+  const struct allocator *allocator;
+
+  enum reorder reorder; // How lookups reorganise the chains
 };
 
 // Size of a word with `bits` bits
-static inline unsigned int
+static inline size_t
 bits_size(unsigned int bits)
 {
-  return 1 << bits;
+  return (size_t)1 << bits;
 }
 // The range [0, split + m) are initialised. The range [split + m, 2m)
 // is where we are adding new initialised bins through splitting.
-static inline unsigned int
+static inline size_t
 m(struct hash_table *table)
 {
   return bits_size(table->table_bits + SUBTABLE_BITS);
 }
 
 // The largest bin that is currently in use
-static inline unsigned int
+static inline size_t
 max_index(struct hash_table *table)
 {
   return m(table) + table->split;
 }
 
 // Mask for the lower `bits` bits
-static inline unsigned int
+static inline size_t
 bit_mask(unsigned int bits)
 {
   return bits_size(bits) - 1;
 }
 // A mask for the parts of hash keys we are currently considering
-static inline unsigned int
+static inline size_t
 key_mask(struct hash_table *table)
 {
   return bit_mask(table->table_bits + 1 + SUBTABLE_BITS);
@@ -58,71 +65,117 @@ key_mask(struct hash_table *table)
 // The bins up to split + m are valid, the higher indices are not.
 // If we are below this index, we can use the index, otherwise we need
 // to use the smaller range [0, m).
-static inline unsigned int
-key_in_table_range(struct hash_table *table, unsigned int hash_key)
+static inline size_t
+key_in_table_range(struct hash_table *table, size_t hash_key)
 {
-  unsigned int masked_key = hash_key & key_mask(table);
+  size_t masked_key = hash_key & key_mask(table);
   return (masked_key < max_index(table)) ? masked_key : (masked_key - m(table));
 }
 
-static inline unsigned int
-table_index(struct hash_table *table, unsigned int hash_key)
+static inline size_t
+table_index(struct hash_table *table, size_t hash_key)
 {
   return hash_key >> SUBTABLE_BITS;
 }
-static inline unsigned int
-bin_index(struct hash_table *table, unsigned int hash_key)
+static inline size_t
+bin_index(struct hash_table *table, size_t hash_key)
 {
   return hash_key & bit_mask(SUBTABLE_BITS);
 }
 
 // Get a bin from an index
 static inline LIST
-get_bin(struct hash_table *table, unsigned int hash_key)
+get_bin(struct hash_table *table, size_t hash_key)
 {
-  unsigned int tab_idx = table_index(table, hash_key);
-  unsigned int bin_idx = bin_index(table, hash_key);
+  size_t tab_idx = table_index(table, hash_key);
+  size_t bin_idx = bin_index(table, hash_key);
   return &table->tables[tab_idx][bin_idx];
 }
 
+static subtable
+new_subtable(struct hash_table *table)
+{
+  return allocate(table->allocator,
+                  bits_size(SUBTABLE_BITS) * sizeof *table->tables[0]);
+}
+
+static void
+free_subtable(struct hash_table *table, subtable subtable)
+{
+  deallocate(table->allocator, subtable,
+             bits_size(SUBTABLE_BITS) * sizeof *subtable);
+}
+
+static void
+resize_tables(struct hash_table *table, size_t capacity)
+{
+  table->tables =
+      reallocate(table->allocator, table->tables,
+                 table->tables_capacity * sizeof *table->tables,
+                 capacity * sizeof *table->tables);
+  table->tables_capacity = capacity;
+}
+
+// Linear hashing grows one bin per insertion, so there is no resize to
+// avoid by allocating up front.
 struct hash_table *
-new_table()
+new_table_with_allocator(size_t keys, const struct allocator *allocator)
 {
-  struct hash_table *table = malloc(sizeof *table);
+  struct hash_table *table = allocate(allocator, sizeof *table);
+  table->allocator = allocator;
 
   // Initialial size olds 2 table-pointers, [0,m) and [m,2m).
-  table->tables = malloc(2 * sizeof *table->tables);
+  table->tables = allocate(allocator, 2 * sizeof *table->tables);
+  table->tables_capacity = 2;
 
   // Allocate and initialise the first table only.
-  table->tables[0] =
-      malloc(bits_size(SUBTABLE_BITS) * sizeof *table->tables[0]);
-  for (unsigned int i = 0; i < bits_size(SUBTABLE_BITS); i++) {
+  table->tables[0] = new_subtable(table);
+  for (size_t i = 0; i < bits_size(SUBTABLE_BITS); i++) {
     table->tables[0][i] = NULL;
   }
   table->allocated_subtables = 1;
 
   table->table_bits = 0; // we only use bin bits initially
   table->split = 0;      // we start splitting at the first bin
+  table->resizes = 0;
+
+  table->reorder = NO_REORDER;
 
+  TRACE(TRACE_NEW_TABLE, table, 0, false);
   return table;
 }
 
+struct hash_table *
+new_table_with_capacity(size_t keys)
+{
+  return new_table_with_allocator(keys, NULL);
+}
+
+struct hash_table *
+new_table()
+{
+  return new_table_with_capacity(0);
+}
+
 void
 delete_table(struct hash_table *table)
 {
+  TRACE(TRACE_DELETE_TABLE, table, 0, false);
+
   // Delete lists in all initialised bins
-  for (unsigned int bin = 0; bin < max_index(table); bin++) {
-    free_list(get_bin(table, bin));
+  for (size_t bin = 0; bin < max_index(table); bin++) {
+    free_list_with_allocator(get_bin(table, bin), table->allocator);
   }
 
   // Delete subtables.
-  for (unsigned int tbl = 0; tbl < table->allocated_subtables; tbl++) {
-    free(table->tables[tbl]);
+  for (size_t tbl = 0; tbl < table->allocated_subtables; tbl++) {
+    free_subtable(table, table->tables[tbl]);
   }
 
   // And finally free the tables array and the table
-  free(table->tables);
-  free(table);
+  deallocate(table->allocator, table->tables,
+             table->tables_capacity * sizeof *table->tables);
+  deallocate(table->allocator, table, sizeof *table);
 }
 
 void
@@ -136,25 +189,26 @@ init_next_subtable(struct hash_table *table)
     // Alloc more table pointers (but don't initialise, we do that
     // incrementally). The first half of the new size handles the
     // new [0,m) and the second the new [m,2m) range. The new [0,m)
-    // range is already initialised.
-    size_t new_size = 2 * bits_size(table->table_bits) * sizeof *table->tables;
-    table->tables = realloc(table->tables, new_size);
+    // range is already initialised. Shrinking keeps more sub-tables than
+    // it needs, so we may have room for the pointers already, and must
+    // not cut off the sub-tables past the new size.
+    if (table->tables_capacity < 2 * bits_size(table->table_bits))
+      resize_tables(table, 2 * bits_size(table->table_bits));
 
     // Reset split pointer
     table->split = 0;
   }
 
-  unsigned int tab_index = table_index(table, max_index(table));
+  size_t tab_index = table_index(table, max_index(table));
   if (tab_index == table->allocated_subtables) {
     // If we are moving into a new sub-table, we need to allocate it
-    table->tables[tab_index] =
-        malloc(bits_size(SUBTABLE_BITS) * sizeof *table->tables[tab_index]);
+    table->tables[tab_index] = new_subtable(table);
     table->allocated_subtables++;
   }
 }
 
 void
-split_bin(LIST from_bin, LIST to_bin, unsigned int split_bit)
+split_bin(LIST from_bin, LIST to_bin, size_t split_bit)
 {
   struct link *link = *from_bin; // Catch list before we clear the bin.
   *to_bin = NULL;                // Initialise if it isn't already
@@ -188,23 +242,68 @@ split(struct hash_table *table)
 
   // Update counter to reflect that we have split
   table->split++;
+  table->resizes++;
 }
 
-void
-insert_key(struct hash_table *table, unsigned int key)
+// Splitting moves links but doesn't reallocate them, so the link stays
+// valid.
+static struct link *
+add_key(struct hash_table *table, unsigned int key, bool *added)
 {
   LIST bin = get_bin(table, key_in_table_range(table, key));
-  if (!contains_element(bin, key)) {
-    add_element(bin, key);
+  struct link *link =
+      get_or_add_element_with_allocator(bin, key, added, table->allocator);
+  if (*added) {
     split(table);
   }
+  return link;
+}
+
+bool
+try_insert(struct hash_table *table, unsigned int key)
+{
+  TRACE(TRACE_INSERT, table, key, false);
+  bool added;
+  struct link *link = add_key(table, key, &added);
+  if (added)
+    link->count = 1;
+  return added;
+}
+
+void
+insert_key(struct hash_table *table, unsigned int key)
+{
+  try_insert(table, key);
+}
+
+unsigned int *
+find_or_insert(struct hash_table *table, unsigned int key, bool *inserted)
+{
+  TRACE(TRACE_INSERT, table, key, false);
+  return &add_key(table, key, inserted)->count;
+}
+
+unsigned int
+key_count(struct hash_table *table, unsigned int key)
+{
+  LIST bin = get_bin(table, key_in_table_range(table, key));
+  struct link *link = get_element(bin, key);
+  return link ? link->count : 0;
 }
 
 bool
 contains_key(struct hash_table *table, unsigned int key)
 {
   LIST bin = get_bin(table, key_in_table_range(table, key));
-  return contains_element(bin, key);
+  bool found = contains_element_reorder(bin, key, table->reorder);
+  TRACE(TRACE_CONTAINS, table, key, found);
+  return found;
+}
+
+void
+set_reorder(struct hash_table *table, enum reorder reorder)
+{
+  table->reorder = reorder;
 }
 
 static void
@@ -225,12 +324,11 @@ shrink_tables(struct hash_table *table)
   // Checking when we point to the beginning of [0,2m).
   if (table->split == 0 &&
       bits_size(table->table_bits) < table->allocated_subtables / 4) {
-    unsigned int new_no_tables = bits_size(table->table_bits + 1);
-    for (unsigned int i = new_no_tables; i < table->allocated_subtables; i++) {
-      free(table->tables[i]);
+    size_t new_no_tables = bits_size(table->table_bits + 1);
+    for (size_t i = new_no_tables; i < table->allocated_subtables; i++) {
+      free_subtable(table, table->tables[i]);
     }
-    table->tables =
-        realloc(table->tables, new_no_tables * sizeof *table->tables);
+    resize_tables(table, new_no_tables);
     table->allocated_subtables = new_no_tables;
   }
 }
@@ -258,24 +356,128 @@ merge(struct hash_table *table)
   // Merge largest bin into split bin (well, one before the split bin so the
   // indices match)
   merge_bins(get_bin(table, max_index(table)), get_bin(table, table->split));
+  table->resizes++;
 
   shrink_tables(table);
 }
 
+bool
+erase(struct hash_table *table, unsigned int key)
+{
+  TRACE(TRACE_DELETE, table, key, false);
+  LIST bin = get_bin(table, key_in_table_range(table, key));
+  if (!delete_element_with_allocator(bin, key, table->allocator))
+    return false;
+  merge(table);
+  return true;
+}
+
 void
 delete_key(struct hash_table *table, unsigned int key)
 {
-  LIST bin = get_bin(table, key_in_table_range(table, key));
-  if (contains_element(bin, key)) {
-    delete_element(bin, key);
-    merge(table);
+  erase(table, key);
+}
+
+size_t
+no_keys(struct hash_table *table)
+{
+  // We split a bin for each insertion and merge one for each deletion,
+  // so the bins beyond the initial sub-table are one per key.
+  return max_index(table) - bits_size(SUBTABLE_BITS);
+}
+
+void
+for_each_key(struct hash_table *table, void (*f)(unsigned int key, void *data),
+             void *data)
+{
+  for (size_t slot = 0; slot < max_index(table); slot++) {
+    for (struct link *link = *get_bin(table, slot); link; link = link->next) {
+      f(link->key, data);
+    }
   }
 }
 
+void
+for_each_key_count(struct hash_table *table,
+                   void (*f)(unsigned int key, unsigned int count, void *data),
+                   void *data)
+{
+  for (size_t slot = 0; slot < max_index(table); slot++) {
+    for (struct link *link = *get_bin(table, slot); link; link = link->next) {
+      f(link->key, link->count, data);
+    }
+  }
+}
+
+size_t
+no_bins(struct hash_table *table)
+{
+  return max_index(table);
+}
+
+void
+for_each_key_in_bins(struct hash_table *table, size_t begin, size_t end,
+                     void (*f)(unsigned int key, void *data), void *data)
+{
+  for (size_t slot = begin; slot < end; slot++) {
+    for (struct link *link = *get_bin(table, slot); link; link = link->next) {
+      f(link->key, data);
+    }
+  }
+}
+
+struct memory_usage
+table_memory_usage(struct hash_table *table)
+{
+  struct memory_usage usage = {
+      .table = sizeof *table,
+      .bins = table->allocated_subtables * bits_size(SUBTABLE_BITS) *
+              sizeof *table->tables[0],
+      .nodes = no_keys(table) * sizeof(struct link),
+      .subtables = table->tables_capacity * sizeof *table->tables};
+  usage.total = usage.table + usage.bins + usage.nodes + usage.subtables;
+  return usage;
+}
+
+// We scan the hash keys' classes, key & key_mask, in reverse-binary
+// order. Classes past max_index share a bin with the class m below them,
+// so we pick out each class' keys from its bin.
+static size_t
+next_scan_bin(void *table, size_t bin)
+{
+  return next_reverse_binary(bin, key_mask(table));
+}
+
+static void
+visit_scan_bin(void *table, size_t bin,
+               void (*f)(unsigned int key, void *data), void *data)
+{
+  size_t class = bin & key_mask(table);
+  LIST list = get_bin(table, key_in_table_range(table, class));
+  for (struct link *link = *list; link; link = link->next) {
+    if ((link->key & key_mask(table)) == class)
+      f(link->key, data);
+  }
+}
+
+unsigned int
+next_n(struct hash_table *table, struct cursor *cursor, unsigned int *keys,
+       unsigned int n)
+{
+  // Splits and merges move keys between bins and reorder the chains, and
+  // a split and a merge can bring back the same max_index.
+  struct scan_bins bins = {.table = table,
+                           .stamp = table->resizes,
+                           .restart_on_resize = false,
+                           .next = next_scan_bin,
+                           .visit = visit_scan_bin};
+  return scan_next_n(cursor, &bins, keys, n);
+}
+
 void
 print_table(struct hash_table *table)
 {
-  unsigned int slot;
+  size_t slot;
   for (slot = 0; slot < max_index(table); slot++) {
     if ((slot & bit_mask(SUBTABLE_BITS)) == 0)
       printf("\n");
@@ -292,7 +494,7 @@ print_table(struct hash_table *table)
     printf("]");
   }
   printf("\n");
-  printf("Allocated sutables: %u\n", table->allocated_subtables);
+  printf("Allocated sutables: %zu\n", table->allocated_subtables);
   printf("\n");
-  printf("Usage is %u\n", max_index(table));
+  printf("Usage is %zu\n", max_index(table));
 }
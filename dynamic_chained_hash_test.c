@@ -78,6 +78,20 @@ main(int argc, const char *argv[])
     print_table(table);
   }
 
+  // Shrinking keeps some of the sub-tables, and growing again must not
+  // lose them
+  for (int round = 0; round < 2; ++round) {
+    for (int i = 0; i < 16 * no_elms; ++i) {
+      insert_key(table, i);
+    }
+    for (int i = no_elms / 10; i < 16 * no_elms; ++i) {
+      delete_key(table, i);
+    }
+  }
+  for (int i = 0; i < 16 * no_elms; ++i) {
+    assert(contains_key(table, i) == (i < no_elms / 10));
+  }
+
   free(keys);
   delete_table(table);
 
@@ -0,0 +1,81 @@
+
+#include "filtered_table.h"
+
+#include <stdlib.h>
+
+#define MIN_CAPACITY 64
+
+static void
+add_to_filter(unsigned int key, void *filter)
+{
+  bloom_insert(filter, key);
+}
+
+static void
+rebuild_filter(struct filtered_table *table, unsigned int capacity)
+{
+  free_bloom_filter(table->filter);
+  table->filter = new_bloom_filter(capacity);
+  table->capacity = capacity;
+  table->stale = 0;
+  for_each_key(table->table, add_to_filter, table->filter);
+}
+
+struct filtered_table *
+new_filtered_table()
+{
+  struct filtered_table *table = malloc(sizeof *table);
+  *table = (struct filtered_table){.table = new_table(),
+                                   .filter = new_bloom_filter(MIN_CAPACITY),
+                                   .keys = 0,
+                                   .capacity = MIN_CAPACITY,
+                                   .stale = 0};
+  return table;
+}
+
+void
+delete_filtered_table(struct filtered_table *table)
+{
+  free_bloom_filter(table->filter);
+  delete_table(table->table);
+  free(table);
+}
+
+bool
+filtered_contains_key(struct filtered_table *table, unsigned int key)
+{
+  return bloom_may_contain(table->filter, key) &&
+         contains_key(table->table, key);
+}
+
+void
+filtered_insert_key(struct filtered_table *table, unsigned int key)
+{
+  if (filtered_contains_key(table, key))
+    return;
+
+  insert_key(table->table, key);
+  bloom_insert(table->filter, key);
+  table->keys++;
+
+  // Stale keys count towards the filter's load, so include them.
+  if (table->keys + table->stale > table->capacity)
+    rebuild_filter(table, 2 * table->capacity);
+}
+
+void
+filtered_delete_key(struct filtered_table *table, unsigned int key)
+{
+  if (!filtered_contains_key(table, key))
+    return;
+
+  delete_key(table->table, key);
+  table->keys--;
+  table->stale++;
+
+  if (table->capacity > MIN_CAPACITY && table->keys < table->capacity / 4) {
+    rebuild_filter(table, table->capacity / 2);
+  } else if (table->stale > table->capacity / 2) {
+    rebuild_filter(table, table->capacity);
+  }
+}
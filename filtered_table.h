@@ -0,0 +1,37 @@
+
+#ifndef FILTERED_TABLE_H
+#define FILTERED_TABLE_H
+
+#include <stdbool.h>
+
+#include "bloom_filter.h"
+#include "hash_table.h"
+
+// A hash table from any backend with a Bloom filter in front of it.
+// Lookups for keys the filter rules out never touch the table.
+//
+// Bloom filters cannot delete keys, so deleted keys stay in the filter
+// as stale bits that only cost false positives. When too many keys are
+// stale, or the table outgrows the filter, the filter is rebuilt from the
+// table's keys.
+struct filtered_table {
+  struct hash_table *table;
+  struct bloom_filter *filter;
+  unsigned int keys;     // Keys in the table
+  unsigned int capacity; // Keys the filter is sized for
+  unsigned int stale;    // Deleted keys still set in the filter
+};
+
+struct filtered_table *
+new_filtered_table(void);
+void
+delete_filtered_table(struct filtered_table *table);
+
+void
+filtered_insert_key(struct filtered_table *table, unsigned int key);
+bool
+filtered_contains_key(struct filtered_table *table, unsigned int key);
+void
+filtered_delete_key(struct filtered_table *table, unsigned int key);
+
+#endif
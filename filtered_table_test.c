@@ -0,0 +1,83 @@
+
+#include "filtered_table.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static unsigned int
+random_key()
+{
+  unsigned int key = (unsigned int)rand();
+  return key;
+}
+
+int
+main(int argc, const char *argv[])
+{
+  if (argc != 2) {
+    printf("Usage: %s no_elements\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  int no_elms = atoi(argv[1]);
+  unsigned int *keys = malloc(no_elms * sizeof *keys);
+  for (int i = 0; i < no_elms; ++i) {
+    keys[i] = random_key();
+  }
+
+  struct filtered_table *table = new_filtered_table();
+  for (int i = 0; i < no_elms; ++i) {
+    filtered_insert_key(table, keys[i]);
+  }
+  for (int i = 0; i < no_elms; ++i) {
+    assert(filtered_contains_key(table, keys[i]));
+  }
+
+  // Time misses with and without the filter
+  unsigned int *misses = malloc(no_elms * sizeof *misses);
+  for (int i = 0; i < no_elms; ++i) {
+    misses[i] = random_key();
+  }
+  int passed = 0;
+  for (int i = 0; i < no_elms; ++i) {
+    passed += bloom_may_contain(table->filter, misses[i]);
+  }
+  clock_t start = clock();
+  for (int i = 0; i < no_elms; ++i) {
+    (void)filtered_contains_key(table, misses[i]);
+  }
+  clock_t end = clock();
+  for (int i = 0; i < no_elms; ++i) {
+    (void)contains_key(table->table, misses[i]);
+  }
+  clock_t unfiltered_end = clock();
+  printf("filter passed %d of %d random keys\n", passed, no_elms);
+  printf("filtered:   %g\n", (end - start) / (double)CLOCKS_PER_SEC);
+  printf("unfiltered: %g\n",
+         (unfiltered_end - end) / (double)CLOCKS_PER_SEC);
+
+  // Deleting half the keys leaves stale bits, but the filter must still
+  // agree with the table on the rest.
+  for (int i = 0; i < no_elms; i += 2) {
+    filtered_delete_key(table, keys[i]);
+  }
+  for (int i = 0; i < no_elms; ++i) {
+    assert(filtered_contains_key(table, keys[i]) ==
+           contains_key(table->table, keys[i]));
+  }
+  for (int i = 0; i < no_elms; ++i) {
+    filtered_delete_key(table, keys[i]);
+  }
+  for (int i = 0; i < no_elms; ++i) {
+    assert(!filtered_contains_key(table, keys[i]));
+  }
+  assert(table->keys == 0);
+
+  free(misses);
+  free(keys);
+  delete_filtered_table(table);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,280 @@
+
+#include "frozen_table.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define KEYS_PER_BUCKET 5
+#define LOAD_FACTOR 0.99
+#define MAX_PILOT UINT16_MAX
+
+static inline uint64_t
+mix(uint64_t h)
+{
+  // MurmurHash3's 64-bit finaliser
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+// Map a 32-bit hash to [0, n) with a multiply instead of a division
+static inline unsigned int
+reduce(uint32_t h, unsigned int n)
+{
+  return (unsigned int)(((uint64_t)h * n) >> 32);
+}
+
+static inline uint64_t
+key_hash(struct frozen_table *table, unsigned int key)
+{
+  return mix(key ^ table->seed);
+}
+
+// The hash picks a bucket. As in PTHash, the buckets are skewed so 60%
+// of the keys go to the first 30% of the buckets. Those dense buckets are
+// placed while the table is still mostly empty, which leaves only small
+// buckets for the crowded end.
+static inline unsigned int
+hash_bucket(struct frozen_table *table, uint64_t h)
+{
+  unsigned int dense = table->no_buckets * 3 / 10 + 1;
+  if ((h >> 32) < (uint64_t)(0.6 * 4294967296.0))
+    return reduce((uint32_t)h, dense);
+  else
+    return dense + reduce((uint32_t)h, table->no_buckets - dense);
+}
+
+// The hash mixed with the pilot picks the slot. The XOR must be
+// mixed again: keys whose hashes agree in the high bits would otherwise
+// collide for every pilot.
+static inline unsigned int
+hash_slot(struct frozen_table *table, uint64_t h, uint16_t pilot)
+{
+  return reduce((uint32_t)mix(h ^ (pilot + table->seed)), table->no_slots);
+}
+
+static void
+collect_key(unsigned int key, void *data)
+{
+  unsigned int **next = data;
+  *(*next)++ = key;
+}
+
+static inline bool
+is_taken(uint64_t *taken, unsigned int slot)
+{
+  return (taken[slot / 64] >> (slot % 64)) & 1;
+}
+
+static inline void
+set_taken(uint64_t *taken, unsigned int slot)
+{
+  taken[slot / 64] |= 1ULL << (slot % 64);
+}
+
+// Try to find pilots for all buckets with the table's current seed.
+// Key hashes are given sorted by bucket, with bucket b in
+// hashes[offsets[b], offsets[b + 1]).
+static bool
+find_pilots(struct frozen_table *table, uint64_t *hashes,
+            unsigned int *offsets, unsigned int *order, uint64_t *taken,
+            unsigned int *positions)
+{
+  memset(taken, 0, (table->no_slots + 63) / 64 * sizeof *taken);
+
+  for (unsigned int i = 0; i < table->no_buckets; i++) {
+    unsigned int bucket = order[i];
+    uint64_t *begin = hashes + offsets[bucket],
+             *end = hashes + offsets[bucket + 1];
+    if (begin == end)
+      break; // Buckets are sorted by size, so the rest are empty
+
+    unsigned int pilot = 0;
+    for (; pilot <= MAX_PILOT; pilot++) {
+      unsigned int n = 0;
+      for (uint64_t *h = begin; h < end; h++, n++) {
+        unsigned int slot = hash_slot(table, *h, pilot);
+        if (is_taken(taken, slot))
+          break;
+        // Keys in the same bucket must not collide with each other either
+        unsigned int j = 0;
+        while (j < n && positions[j] != slot)
+          j++;
+        if (j < n)
+          break;
+        positions[n] = slot;
+      }
+      if (begin + n == end)
+        break;
+    }
+    if (pilot > MAX_PILOT)
+      return false; // Try again with another seed
+
+    table->pilots[bucket] = pilot;
+    for (unsigned int j = 0; j < end - begin; j++) {
+      set_taken(taken, positions[j]);
+    }
+  }
+  return true;
+}
+
+// Sort the key hashes by bucket and the buckets by decreasing size, so
+// we place the hardest buckets while the table is still empty.
+static unsigned int
+sort_buckets(struct frozen_table *table, unsigned int *keys, uint64_t *hashes,
+             unsigned int *offsets, unsigned int *order)
+{
+  const struct allocator *allocator = table->allocator;
+  unsigned int no_buckets = table->no_buckets, max_size = 0;
+
+  memset(offsets, 0, (no_buckets + 1) * sizeof *offsets);
+  for (unsigned int i = 0; i < table->no_keys; i++) {
+    offsets[hash_bucket(table, key_hash(table, keys[i])) + 1]++;
+  }
+  for (unsigned int b = 0; b < no_buckets; b++) {
+    if (offsets[b + 1] > max_size)
+      max_size = offsets[b + 1];
+    offsets[b + 1] += offsets[b];
+  }
+  for (unsigned int i = 0; i < table->no_keys; i++) {
+    uint64_t h = key_hash(table, keys[i]);
+    unsigned int b = hash_bucket(table, h);
+    // offsets[b] is moved forward as we place keys and restored below
+    hashes[offsets[b]++] = h;
+  }
+  for (unsigned int b = no_buckets; b > 0; b--) {
+    offsets[b] = offsets[b - 1];
+  }
+  offsets[0] = 0;
+
+  // Counting sort of the buckets by size, largest first
+  size_t counts_size = (max_size + 2) * sizeof(unsigned int);
+  unsigned int *counts = allocate_zeroed(allocator, counts_size);
+  for (unsigned int b = 0; b < no_buckets; b++) {
+    counts[max_size - (offsets[b + 1] - offsets[b]) + 1]++;
+  }
+  for (unsigned int s = 0; s <= max_size; s++) {
+    counts[s + 1] += counts[s];
+  }
+  for (unsigned int b = 0; b < no_buckets; b++) {
+    order[counts[max_size - (offsets[b + 1] - offsets[b])]++] = b;
+  }
+  deallocate(allocator, counts, counts_size);
+
+  return max_size;
+}
+
+struct frozen_table *
+freeze_table_with_allocator(struct hash_table *hash_table,
+                            const struct allocator *allocator)
+{
+  unsigned int n = no_keys(hash_table);
+  unsigned int no_buckets = n / KEYS_PER_BUCKET + 2; // Dense and sparse
+  unsigned int no_slots = (unsigned int)(n / LOAD_FACTOR) + 1;
+
+  struct frozen_table *table = allocate(allocator, sizeof *table);
+  *table = (struct frozen_table){
+      .slots = allocate(allocator, no_slots * sizeof *table->slots),
+      .pilots = allocate_zeroed(allocator, no_buckets * sizeof *table->pilots),
+      .no_keys = n,
+      .no_slots = no_slots,
+      .no_buckets = no_buckets,
+      .allocator = allocator,
+  };
+  if (n == 0)
+    return table;
+
+  size_t keys_size = n * sizeof(unsigned int);
+  size_t hashes_size = n * sizeof(uint64_t);
+  size_t offsets_size = (no_buckets + 1) * sizeof(unsigned int);
+  size_t order_size = no_buckets * sizeof(unsigned int);
+  size_t taken_size = (no_slots + 63) / 64 * sizeof(uint64_t);
+  size_t positions_size = 0;
+
+  unsigned int *keys = allocate(allocator, keys_size), *next = keys;
+  for_each_key(hash_table, collect_key, &next);
+
+  uint64_t *hashes = allocate(allocator, hashes_size);
+  unsigned int *offsets = allocate(allocator, offsets_size);
+  unsigned int *order = allocate(allocator, order_size);
+  uint64_t *taken = allocate(allocator, taken_size);
+  unsigned int *positions = NULL;
+
+  for (uint64_t attempt = 1;; attempt++) {
+    table->seed = mix(attempt);
+    unsigned int max_size = sort_buckets(table, keys, hashes, offsets, order);
+    positions = reallocate(allocator, positions, positions_size,
+                           max_size * sizeof *positions);
+    positions_size = max_size * sizeof *positions;
+    if (find_pilots(table, hashes, offsets, order, taken, positions))
+      break;
+  }
+
+  // Any key works as filler for the empty slots, since it has its own slot.
+  for (unsigned int s = 0; s < no_slots; s++) {
+    table->slots[s] = keys[0];
+  }
+  for (unsigned int i = 0; i < n; i++) {
+    unsigned int key = keys[i];
+    uint64_t h = key_hash(table, key);
+    uint16_t pilot = table->pilots[hash_bucket(table, h)];
+    table->slots[hash_slot(table, h, pilot)] = key;
+  }
+
+  deallocate(allocator, positions, positions_size);
+  deallocate(allocator, taken, taken_size);
+  deallocate(allocator, order, order_size);
+  deallocate(allocator, offsets, offsets_size);
+  deallocate(allocator, hashes, hashes_size);
+  deallocate(allocator, keys, keys_size);
+
+  return table;
+}
+
+struct frozen_table *
+freeze_table(struct hash_table *hash_table)
+{
+  return freeze_table_with_allocator(hash_table, NULL);
+}
+
+void
+delete_frozen_table(struct frozen_table *table)
+{
+  const struct allocator *allocator = table->allocator;
+  deallocate(allocator, table->slots, table->no_slots * sizeof *table->slots);
+  deallocate(allocator, table->pilots,
+             table->no_buckets * sizeof *table->pilots);
+  deallocate(allocator, table, sizeof *table);
+}
+
+bool
+frozen_contains_key(struct frozen_table *table, unsigned int key)
+{
+  if (table->no_keys == 0)
+    return false;
+  uint64_t h = key_hash(table, key);
+  uint16_t pilot = table->pilots[hash_bucket(table, h)];
+  return table->slots[hash_slot(table, h, pilot)] == key;
+}
+
+bool
+frozen_slot_has_key(struct frozen_table *table, unsigned int slot)
+{
+  if (table->no_keys == 0)
+    return false;
+  // The filler is a key with a slot of its own, somewhere else
+  unsigned int key = table->slots[slot];
+  uint64_t h = key_hash(table, key);
+  uint16_t pilot = table->pilots[hash_bucket(table, h)];
+  return hash_slot(table, h, pilot) == slot;
+}
+
+size_t
+frozen_table_memory(struct frozen_table *table)
+{
+  return sizeof *table + table->no_slots * sizeof *table->slots +
+         table->no_buckets * sizeof *table->pilots;
+}
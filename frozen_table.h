@@ -0,0 +1,53 @@
+
+#ifndef FROZEN_TABLE_H
+#define FROZEN_TABLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "allocator.h"
+#include "hash_table.h"
+
+// An immutable table built from any backend with a perfect hash function
+// in the style of PTHash. Keys are hashed to buckets of about five keys,
+// and each bucket has a 16-bit "pilot" chosen so that its keys land in
+// distinct slots. A lookup reads the pilot and then the slot, which holds
+// the key for verification.
+//
+// There are slightly more slots than keys so the last buckets can still
+// find free slots. The slots that stay empty hold a key that hashes to
+// another slot, so they never match.
+struct frozen_table {
+  unsigned int *slots;
+  uint16_t *pilots;
+  unsigned int no_keys;
+  unsigned int no_slots;
+  unsigned int no_buckets;
+  uint64_t seed;
+  const struct allocator *allocator;
+};
+
+// Build a frozen copy of table. The table itself is not changed.
+struct frozen_table *
+freeze_table(struct hash_table *table);
+// The same, with all the memory, including scratch space for building,
+// from `allocator`
+struct frozen_table *
+freeze_table_with_allocator(struct hash_table *table,
+                            const struct allocator *allocator);
+void
+delete_frozen_table(struct frozen_table *table);
+
+bool
+frozen_contains_key(struct frozen_table *table, unsigned int key);
+
+// Whether a slot holds one of the keys rather than filler, so
+// slots[slot] for those slots are the table's keys.
+bool
+frozen_slot_has_key(struct frozen_table *table, unsigned int slot);
+
+// The bytes the frozen table holds
+size_t
+frozen_table_memory(struct frozen_table *table);
+
+#endif
@@ -0,0 +1,84 @@
+
+#include "frozen_table.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static unsigned int
+random_key()
+{
+  unsigned int key = (unsigned int)rand();
+  return key;
+}
+
+int
+main(int argc, const char *argv[])
+{
+  if (argc != 2) {
+    printf("Usage: %s no_elements\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  int no_elms = atoi(argv[1]);
+  unsigned int *keys = malloc(no_elms * sizeof *keys);
+  for (int i = 0; i < no_elms; ++i) {
+    keys[i] = random_key();
+  }
+
+  struct hash_table *table = new_table();
+  struct frozen_table *empty = freeze_table(table);
+  assert(!frozen_contains_key(empty, random_key()));
+  delete_frozen_table(empty);
+
+  for (int i = 0; i < no_elms; ++i) {
+    insert_key(table, keys[i]);
+  }
+
+  clock_t start = clock();
+  struct frozen_table *frozen = freeze_table(table);
+  clock_t end = clock();
+  printf("freezing: %g\n", (end - start) / (double)CLOCKS_PER_SEC);
+
+  double bytes = frozen->no_slots * sizeof *frozen->slots +
+                 frozen->no_buckets * sizeof *frozen->pilots;
+  printf("bytes per key: %g\n", bytes / frozen->no_keys);
+  assert(frozen->no_keys == no_keys(table));
+
+  start = clock();
+  for (int i = 0; i < no_elms; ++i) {
+    assert(frozen_contains_key(frozen, keys[i]));
+  }
+  end = clock();
+  printf("frozen hits: %g\n", (end - start) / (double)CLOCKS_PER_SEC);
+
+  unsigned int *misses = malloc(no_elms * sizeof *misses);
+  for (int i = 0; i < no_elms; ++i) {
+    misses[i] = random_key();
+  }
+  start = clock();
+  for (int i = 0; i < no_elms; ++i) {
+    (void)contains_key(table, misses[i]);
+  }
+  end = clock();
+  printf("table lookups:  %g\n", (end - start) / (double)CLOCKS_PER_SEC);
+  start = clock();
+  for (int i = 0; i < no_elms; ++i) {
+    (void)frozen_contains_key(frozen, misses[i]);
+  }
+  end = clock();
+  printf("frozen lookups: %g\n", (end - start) / (double)CLOCKS_PER_SEC);
+
+  for (int i = 0; i < no_elms; ++i) {
+    assert(frozen_contains_key(frozen, misses[i]) ==
+           contains_key(table, misses[i]));
+  }
+
+  free(misses);
+  free(keys);
+  delete_frozen_table(frozen);
+  delete_table(table);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,96 @@
+
+#include "hash_table.h"
+#include "perf_counters.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// The workload from the backend tests, split into phases, with time and
+// hardware events per operation for each.
+
+static unsigned int
+random_key()
+{
+  unsigned int key = (unsigned int)rand();
+  return key;
+}
+
+int
+main(int argc, const char *argv[])
+{
+  if (argc != 2) {
+    printf("Usage: %s no_elements\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  int no_elms = atoi(argv[1]);
+  unsigned int *keys = malloc(no_elms * sizeof *keys);
+  unsigned int *misses = malloc(no_elms * sizeof *misses);
+  for (int i = 0; i < no_elms; ++i) {
+    keys[i] = random_key();
+    misses[i] = random_key();
+  }
+
+  struct perf_counters counters;
+  open_perf_counters(&counters);
+  print_perf_header();
+
+  struct hash_table *table = new_table();
+  start_perf_counters(&counters);
+  for (int i = 0; i < no_elms; ++i) {
+    insert_key(table, keys[i]);
+  }
+  stop_perf_counters(&counters);
+  print_perf_counters("insert", &counters, no_elms);
+
+  unsigned int found = 0;
+  start_perf_counters(&counters);
+  for (int i = 0; i < no_elms; ++i) {
+    found += contains_key(table, keys[i]);
+  }
+  stop_perf_counters(&counters);
+  print_perf_counters("lookup hit", &counters, no_elms);
+
+  start_perf_counters(&counters);
+  for (int i = 0; i < no_elms; ++i) {
+    found += contains_key(table, misses[i]);
+  }
+  stop_perf_counters(&counters);
+  print_perf_counters("lookup random", &counters, no_elms);
+
+  // Duplicates, which leave the table alone
+  unsigned int inserted = 0;
+  start_perf_counters(&counters);
+  for (int i = 0; i < no_elms; ++i) {
+    inserted += try_insert(table, keys[i]);
+  }
+  stop_perf_counters(&counters);
+  print_perf_counters("insert duplicate", &counters, no_elms);
+
+  start_perf_counters(&counters);
+  for (int i = 0; i < no_elms; ++i) {
+    delete_key(table, keys[i]);
+  }
+  stop_perf_counters(&counters);
+  print_perf_counters("delete", &counters, no_elms);
+
+  start_perf_counters(&counters);
+  for (int i = 0; i < no_elms; ++i) {
+    inserted += erase(table, keys[i]);
+  }
+  stop_perf_counters(&counters);
+  print_perf_counters("delete missing", &counters, no_elms);
+
+  // Use found, so the lookups aren't optimised away
+  if (found < (unsigned int)no_elms || inserted || no_keys(table) != 0) {
+    printf("The table lost keys\n");
+    return EXIT_FAILURE;
+  }
+
+  close_perf_counters(&counters);
+  delete_table(table);
+  free(misses);
+  free(keys);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,365 @@
+
+#include "parallel.h"
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Deduplicates or counts a file of native-endian uint32 keys, and writes
+// the distinct keys, or (key, count) pairs, to another file, in no
+// particular order.
+//
+// The input is memory mapped, and we go through it a window of
+// WINDOW_KEYS keys at a time. Each thread reads a contiguous chunk of the
+// window and scatters the keys into buffers by their partition of the hash
+// space. Then each thread adds the keys in the buffers of all the threads
+// for one partition to that partition's table, and the buffers are reused
+// for the next window. Every key is read and hashed once, by one thread,
+// so the file is read once from disk, in order, and the buffers only ever
+// hold a window of keys.
+// The tables come from a backend module loaded at run time, since all the
+// backends define the same functions and can't be linked together.
+
+#ifndef BACKEND_DIR
+#define BACKEND_DIR "."
+#endif
+
+#ifndef WINDOW_KEYS
+#define WINDOW_KEYS ((size_t)1 << 24)
+#endif
+
+// The table functions we use, from the backend module
+struct backend {
+  void *handle;
+  struct hash_table *(*new_table)(void);
+  void (*delete_table)(struct hash_table *table);
+  bool (*try_insert)(struct hash_table *table, unsigned int key);
+  unsigned int (*increment_key)(struct hash_table *table, unsigned int key,
+                                unsigned int delta);
+  size_t (*no_keys)(struct hash_table *table);
+  void (*for_each_key)(struct hash_table *table,
+                       void (*f)(unsigned int key, void *data), void *data);
+  void (*for_each_key_count)(struct hash_table *table,
+                             void (*f)(unsigned int key, unsigned int count,
+                                       void *data),
+                             void *data);
+};
+
+// A name without a slash is a module in BACKEND_DIR
+static bool
+load_backend(const char *name, bool counting, struct backend *backend)
+{
+  char path[4096];
+  if (strchr(name, '/'))
+    snprintf(path, sizeof path, "%s", name);
+  else
+    snprintf(path, sizeof path, "%s/hash_backend_%s.so", BACKEND_DIR, name);
+
+  backend->handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+  if (!backend->handle) {
+    fprintf(stderr, "%s\n", dlerror());
+    return false;
+  }
+  *(void **)&backend->new_table = dlsym(backend->handle, "new_table");
+  *(void **)&backend->delete_table = dlsym(backend->handle, "delete_table");
+  *(void **)&backend->try_insert = dlsym(backend->handle, "try_insert");
+  *(void **)&backend->increment_key = dlsym(backend->handle, "increment_key");
+  *(void **)&backend->no_keys = dlsym(backend->handle, "no_keys");
+  *(void **)&backend->for_each_key = dlsym(backend->handle, "for_each_key");
+  *(void **)&backend->for_each_key_count =
+      dlsym(backend->handle, "for_each_key_count");
+
+  if (!backend->new_table || !backend->delete_table || !backend->try_insert ||
+      !backend->no_keys || !backend->for_each_key) {
+    fprintf(stderr, "%s: not a hash table backend\n", path);
+    return false;
+  }
+  if (counting && (!backend->increment_key || !backend->for_each_key_count)) {
+    fprintf(stderr, "%s: the backend can't count keys\n", path);
+    return false;
+  }
+  return true;
+}
+
+// The keys one thread read that belong to one part
+struct bucket {
+  uint32_t *keys;
+  size_t n;
+  size_t capacity;
+};
+
+struct job {
+  struct backend *backend;
+  bool counting;
+  unsigned int no_threads;
+  unsigned int no_parts;
+  const uint32_t *keys;
+  size_t no_keys;
+  const uint32_t *window; // The keys we scatter now
+  struct bucket *buckets; // Thread t's bucket for part p is t * no_parts + p
+  struct hash_table **tables;
+  int out;
+  size_t *offsets; // Where each part goes in the output, in bytes
+  atomic_bool no_memory;
+  atomic_bool failed;
+};
+
+// Partitions use the high bits of a multiplicative hash, so they don't
+// correlate with the low bits the backends use for bins.
+static inline unsigned int
+part_of(uint32_t key, unsigned int no_parts)
+{
+  uint32_t hash = key * 2654435769U;
+  return (unsigned int)(((uint64_t)hash * no_parts) >> 32);
+}
+
+// Make room for capacity keys in bucket
+static bool
+reserve(struct bucket *bucket, size_t capacity)
+{
+  if (capacity <= bucket->capacity)
+    return true;
+  uint32_t *keys = realloc(bucket->keys, capacity * sizeof *keys);
+  if (!keys)
+    return false;
+  bucket->keys = keys;
+  bucket->capacity = capacity;
+  return true;
+}
+
+static void
+scatter_keys(unsigned int thread, size_t begin, size_t end, void *data)
+{
+  struct job *job = data;
+  struct bucket *buckets = job->buckets + (size_t)thread * job->no_parts;
+  // Room for a fair share of the chunk, and some, so most buckets never
+  // grow
+  size_t expected = (end - begin) / job->no_parts;
+  for (unsigned int part = 0; part < job->no_parts; part++) {
+    buckets[part].n = 0;
+    if (!reserve(&buckets[part], expected + expected / 8 + 16)) {
+      atomic_store(&job->no_memory, true);
+      return;
+    }
+  }
+  for (size_t i = begin; i < end; i++) {
+    uint32_t key = job->window[i];
+    struct bucket *bucket = &buckets[part_of(key, job->no_parts)];
+    if (bucket->n == bucket->capacity &&
+        !reserve(bucket, 2 * bucket->capacity)) {
+      atomic_store(&job->no_memory, true);
+      return;
+    }
+    bucket->keys[bucket->n++] = key;
+  }
+}
+
+static void
+build_part(unsigned int thread, size_t begin, size_t end, void *data)
+{
+  struct job *job = data;
+  struct backend *backend = job->backend;
+  for (size_t part = begin; part < end; part++) {
+    struct hash_table *table = job->tables[part];
+    for (unsigned int t = 0; t < job->no_threads; t++) {
+      struct bucket *bucket = &job->buckets[(size_t)t * job->no_parts + part];
+      for (size_t i = 0; i < bucket->n; i++) {
+        if (job->counting)
+          backend->increment_key(table, bucket->keys[i], 1);
+        else
+          backend->try_insert(table, bucket->keys[i]);
+      }
+      bucket->n = 0;
+    }
+  }
+}
+
+// Buffered output for a part, written at its offset in the file
+struct writer {
+  struct job *job;
+  off_t offset;
+  uint32_t buf[1 << 14];
+  size_t used;
+};
+
+static void
+flush(struct writer *writer)
+{
+  size_t bytes = writer->used * sizeof *writer->buf;
+  const char *p = (const char *)writer->buf;
+  while (bytes > 0) {
+    ssize_t written = pwrite(writer->job->out, p, bytes, writer->offset);
+    if (written <= 0) {
+      atomic_store(&writer->job->failed, true);
+      break;
+    }
+    p += written;
+    bytes -= written;
+    writer->offset += written;
+  }
+  writer->used = 0;
+}
+
+static inline void
+put(struct writer *writer, uint32_t word)
+{
+  writer->buf[writer->used++] = word;
+  if (writer->used == sizeof writer->buf / sizeof *writer->buf)
+    flush(writer);
+}
+
+static void
+write_key(unsigned int key, void *data)
+{
+  put(data, key);
+}
+
+static void
+write_key_count(unsigned int key, unsigned int count, void *data)
+{
+  put(data, key);
+  put(data, count);
+}
+
+static void
+write_part(unsigned int thread, size_t begin, size_t end, void *data)
+{
+  struct job *job = data;
+  struct writer *writer = malloc(sizeof *writer);
+  if (!writer) {
+    atomic_store(&job->failed, true);
+    return;
+  }
+  for (size_t part = begin; part < end; part++) {
+    writer->job = job;
+    writer->offset = job->offsets[part];
+    writer->used = 0;
+    if (job->counting)
+      job->backend->for_each_key_count(job->tables[part], write_key_count,
+                                       writer);
+    else
+      job->backend->for_each_key(job->tables[part], write_key, writer);
+    flush(writer);
+  }
+  free(writer);
+}
+
+int
+main(int argc, const char *argv[])
+{
+  if (argc != 6 || (strcmp(argv[2], "distinct") && strcmp(argv[2], "count"))) {
+    printf("Usage: %s backend distinct|count no_threads input output\n",
+           argv[0]);
+    return EXIT_FAILURE;
+  }
+  bool counting = strcmp(argv[2], "count") == 0;
+  unsigned int no_threads = atoi(argv[3]);
+  if (no_threads == 0)
+    no_threads = no_cpus();
+
+  struct backend backend;
+  if (!load_backend(argv[1], counting, &backend))
+    return EXIT_FAILURE;
+
+  int in = open(argv[4], O_RDONLY);
+  struct stat st;
+  if (in < 0 || fstat(in, &st) < 0) {
+    perror(argv[4]);
+    return EXIT_FAILURE;
+  }
+  if (st.st_size % sizeof(uint32_t)) {
+    fprintf(stderr, "%s: not a file of 32-bit keys\n", argv[4]);
+    return EXIT_FAILURE;
+  }
+  const uint32_t *keys = NULL;
+  if (st.st_size > 0) {
+    keys = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, in, 0);
+    if (keys == MAP_FAILED) {
+      perror(argv[4]);
+      return EXIT_FAILURE;
+    }
+    madvise((void *)keys, st.st_size, MADV_SEQUENTIAL);
+  }
+  close(in);
+
+  struct job job = {.backend = &backend,
+                    .counting = counting,
+                    .no_threads = no_threads,
+                    .no_parts = no_threads,
+                    .keys = keys,
+                    .no_keys = st.st_size / sizeof *keys,
+                    // parallel_for may use fewer threads than we ask
+                    // for, and their buckets stay empty
+                    .buckets = calloc((size_t)no_threads * no_threads,
+                                      sizeof *job.buckets),
+                    .tables = calloc(no_threads, sizeof *job.tables),
+                    .offsets = malloc(no_threads * sizeof *job.offsets),
+                    .no_memory = false,
+                    .failed = false};
+  if (!job.buckets || !job.tables || !job.offsets) {
+    fprintf(stderr, "%s: out of memory\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  for (unsigned int part = 0; part < job.no_parts; part++) {
+    job.tables[part] = backend.new_table();
+    if (!job.tables[part]) {
+      fprintf(stderr, "%s: out of memory\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  for (size_t start = 0; start < job.no_keys; start += WINDOW_KEYS) {
+    size_t n = job.no_keys - start < WINDOW_KEYS ? job.no_keys - start
+                                                 : WINDOW_KEYS;
+    job.window = keys + start;
+    parallel_for(no_threads, n, scatter_keys, &job);
+    if (atomic_load(&job.no_memory)) {
+      fprintf(stderr, "%s: out of memory\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+    parallel_for(no_threads, job.no_parts, build_part, &job);
+  }
+  for (size_t i = 0; i < (size_t)no_threads * no_threads; i++)
+    free(job.buckets[i].keys);
+  free(job.buckets);
+
+  // The parts are disjoint, so each one knows where its output goes
+  size_t offset = 0, no_distinct = 0;
+  for (unsigned int part = 0; part < job.no_parts; part++) {
+    size_t n = backend.no_keys(job.tables[part]);
+    job.offsets[part] = offset;
+    offset += n * (counting ? 2 : 1) * sizeof(uint32_t);
+    no_distinct += n;
+  }
+
+  job.out = open(argv[5], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (job.out < 0 || ftruncate(job.out, offset) < 0) {
+    perror(argv[5]);
+    return EXIT_FAILURE;
+  }
+  parallel_for(no_threads, job.no_parts, write_part, &job);
+  if (close(job.out) < 0 || atomic_load(&job.failed)) {
+    perror(argv[5]);
+    return EXIT_FAILURE;
+  }
+
+  printf("%zu keys, %zu distinct\n", job.no_keys, no_distinct);
+
+  for (unsigned int part = 0; part < job.no_parts; part++) {
+    backend.delete_table(job.tables[part]);
+  }
+  free(job.offsets);
+  free(job.tables);
+  if (keys)
+    munmap((void *)keys, st.st_size);
+  dlclose(backend.handle);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,84 @@
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Runs hash_distinct on a file with known duplicates and checks its output.
+// Key d is d * 2654435761, and we get d back by multiplying with the
+// inverse of 2654435761 modulo 2^32.
+
+#define INVERSE 244002641U
+
+static uint32_t
+key(uint32_t d)
+{
+  return d * 2654435761U;
+}
+
+int
+main(int argc, const char *argv[])
+{
+  if (argc != 5) {
+    printf("Usage: %s hash_distinct backend distinct|count no_keys\n",
+           argv[0]);
+    return EXIT_FAILURE;
+  }
+  const char *mode = argv[3];
+  bool counting = strcmp(mode, "count") == 0;
+  uint32_t no_keys = atoi(argv[4]);
+  uint32_t no_distinct = no_keys / 7 + 1;
+
+  char input[256], output[256], command[1024];
+  snprintf(input, sizeof input, "hash_distinct_%s_%s.in", argv[2], mode);
+  snprintf(output, sizeof output, "hash_distinct_%s_%s.out", argv[2], mode);
+
+  // Key d appears once for every i = d modulo no_distinct
+  FILE *f = fopen(input, "wb");
+  assert(f);
+  for (uint32_t i = 0; i < no_keys; i++) {
+    uint32_t k = key(i % no_distinct);
+    fwrite(&k, sizeof k, 1, f);
+  }
+  fclose(f);
+
+  snprintf(command, sizeof command, "%s %s %s 3 %s %s", argv[1], argv[2], mode,
+           input, output);
+  if (system(command) != 0) {
+    printf("%s failed\n", command);
+    return EXIT_FAILURE;
+  }
+
+  uint32_t *seen = calloc(no_distinct, sizeof *seen);
+  f = fopen(output, "rb");
+  assert(f);
+  uint32_t k, count;
+  while (fread(&k, sizeof k, 1, f) == 1) {
+    uint32_t d = k * INVERSE;
+    assert(d < no_distinct);
+    if (counting) {
+      // Not in an assert, which NDEBUG takes out
+      if (fread(&count, sizeof count, 1, f) != 1) {
+        printf("%s: a key without a count\n", output);
+        return EXIT_FAILURE;
+      }
+      assert(seen[d] == 0);
+      seen[d] = count;
+    } else {
+      seen[d]++;
+    }
+  }
+  fclose(f);
+
+  for (uint32_t d = 0; d < no_distinct && d < no_keys; d++) {
+    uint32_t expected = no_keys / no_distinct + (d < no_keys % no_distinct);
+    assert(seen[d] == (counting ? expected : 1));
+  }
+
+  free(seen);
+  remove(input);
+  remove(output);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,229 @@
+
+#include "hash_table.h"
+#include "perf_counters.h"
+#include "trace.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// Replays a trace from a backend built with TRACE_OPERATIONS against the
+// backend this is linked with. The first run replays the operations back
+// to back to measure throughput and hardware events. The second times each
+// operation to get latency percentiles.
+
+struct trace {
+  const struct trace_record *records;
+  size_t no_records;
+  void *map;
+  size_t map_size;
+};
+
+static bool
+map_trace(const char *path, struct trace *trace)
+{
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    perror(path);
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) < 0 || st.st_size < TRACE_MAGIC_SIZE) {
+    fprintf(stderr, "%s: not a trace\n", path);
+    close(fd);
+    return false;
+  }
+  trace->map_size = st.st_size;
+  trace->map = mmap(NULL, trace->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (trace->map == MAP_FAILED) {
+    perror(path);
+    return false;
+  }
+  if (memcmp(trace->map, TRACE_MAGIC, TRACE_MAGIC_SIZE) != 0) {
+    fprintf(stderr, "%s: not a trace\n", path);
+    munmap(trace->map, trace->map_size);
+    return false;
+  }
+  madvise(trace->map, trace->map_size, MADV_SEQUENTIAL);
+  // The magic is 8 bytes, so the records are aligned. A trace from a
+  // program that crashed can end with part of a record; we ignore it.
+  trace->records =
+      (const struct trace_record *)((char *)trace->map + TRACE_MAGIC_SIZE);
+  trace->no_records =
+      (trace->map_size - TRACE_MAGIC_SIZE) / sizeof *trace->records;
+  return true;
+}
+
+// Check that the records make sense before we replay them: the
+// operations exist, and every record other than new_table is for a table
+// that exists. Truncated traces, or traces pieced together from several
+// runs, can get that wrong, and replaying them would use a NULL table.
+static bool
+check_trace(const char *path, const struct trace *trace)
+{
+  bool *exists = calloc(MAX_TRACED_TABLES, sizeof *exists);
+  bool ok = true;
+  for (size_t i = 0; ok && i < trace->no_records; i++) {
+    const struct trace_record *record = &trace->records[i];
+    if (record->op > TRACE_DELETE) {
+      fprintf(stderr, "%s: bad operation in record %zu\n", path, i);
+      ok = false;
+    } else if (record->op == TRACE_NEW_TABLE) {
+      if (exists[record->table]) {
+        fprintf(stderr, "%s: record %zu creates table %u, which exists\n",
+                path, i, record->table);
+        ok = false;
+      }
+      exists[record->table] = true;
+    } else if (!exists[record->table]) {
+      fprintf(stderr, "%s: record %zu uses table %u, which doesn't exist\n",
+              path, i, record->table);
+      ok = false;
+    } else if (record->op == TRACE_DELETE_TABLE) {
+      exists[record->table] = false;
+    }
+  }
+  free(exists);
+  return ok;
+}
+
+// Replay a single record. Returns false if contains_key disagrees with
+// the traced result.
+static inline bool
+replay(struct hash_table **tables, const struct trace_record *record)
+{
+  struct hash_table **table = &tables[record->table];
+  switch ((enum trace_op)record->op) {
+  case TRACE_NEW_TABLE:
+    *table = record->key ? new_table_with_capacity(record->key) : new_table();
+    break;
+  case TRACE_DELETE_TABLE:
+    delete_table(*table);
+    *table = NULL;
+    break;
+  case TRACE_INSERT:
+    insert_key(*table, record->key);
+    break;
+  case TRACE_CONTAINS:
+    return contains_key(*table, record->key) == record->result;
+  case TRACE_DELETE:
+    delete_key(*table, record->key);
+    break;
+  }
+  return true;
+}
+
+static void
+delete_tables(struct hash_table **tables)
+{
+  for (unsigned int i = 0; i < MAX_TRACED_TABLES; i++) {
+    if (tables[i])
+      delete_table(tables[i]);
+    tables[i] = NULL;
+  }
+}
+
+static int
+compare_latencies(const void *a, const void *b)
+{
+  uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+  return (x > y) - (x < y);
+}
+
+static void
+print_percentiles(const char *name, uint32_t *latencies, size_t n)
+{
+  if (n == 0)
+    return;
+  qsort(latencies, n, sizeof *latencies, compare_latencies);
+  printf("%-14s %10zu %8u %8u %8u %8u %8u\n", name, n, latencies[n / 2],
+         latencies[n * 90 / 100], latencies[n * 99 / 100],
+         latencies[n * 999 / 1000], latencies[n - 1]);
+}
+
+int
+main(int argc, const char *argv[])
+{
+  if (argc != 2) {
+    printf("Usage: %s trace\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  struct trace trace;
+  if (!map_trace(argv[1], &trace))
+    return EXIT_FAILURE;
+  if (!check_trace(argv[1], &trace))
+    return EXIT_FAILURE;
+  struct hash_table **tables = calloc(MAX_TRACED_TABLES, sizeof *tables);
+
+  struct perf_counters counters;
+  open_perf_counters(&counters);
+  size_t mismatches = 0;
+  start_perf_counters(&counters);
+  for (size_t i = 0; i < trace.no_records; i++) {
+    mismatches += !replay(tables, &trace.records[i]);
+  }
+  stop_perf_counters(&counters);
+  delete_tables(tables);
+
+  printf("time: %g s, %g operations/s\n", counters.seconds,
+         counters.seconds > 0 ? trace.no_records / counters.seconds : 0);
+  print_perf_header();
+  print_perf_counters("replay", &counters, trace.no_records);
+  close_perf_counters(&counters);
+
+  // Latencies in nanoseconds, by operation. Reading the clock costs tens
+  // of nanoseconds, which is included.
+  struct timespec begin, end;
+  size_t counts[TRACE_DELETE + 1] = {0};
+  for (size_t i = 0; i < trace.no_records; i++) {
+    counts[trace.records[i].op]++;
+  }
+  uint32_t *latencies[TRACE_DELETE + 1];
+  for (int op = 0; op <= TRACE_DELETE; op++) {
+    latencies[op] = malloc(counts[op] * sizeof *latencies[op]);
+    counts[op] = 0;
+  }
+  for (size_t i = 0; i < trace.no_records; i++) {
+    const struct trace_record *record = &trace.records[i];
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    replay(tables, record);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    uint64_t ns = (uint64_t)((end.tv_sec - begin.tv_sec) * 1000000000LL +
+                             (end.tv_nsec - begin.tv_nsec));
+    latencies[record->op][counts[record->op]++] =
+        ns > UINT32_MAX ? UINT32_MAX : (uint32_t)ns;
+  }
+  delete_tables(tables);
+
+  printf("%-14s %10s %8s %8s %8s %8s %8s\n", "latency (ns)", "count", "p50",
+         "p90", "p99", "p99.9", "max");
+  print_percentiles("new_table", latencies[TRACE_NEW_TABLE],
+                    counts[TRACE_NEW_TABLE]);
+  print_percentiles("delete_table", latencies[TRACE_DELETE_TABLE],
+                    counts[TRACE_DELETE_TABLE]);
+  print_percentiles("insert_key", latencies[TRACE_INSERT],
+                    counts[TRACE_INSERT]);
+  print_percentiles("contains_key", latencies[TRACE_CONTAINS],
+                    counts[TRACE_CONTAINS]);
+  print_percentiles("delete_key", latencies[TRACE_DELETE],
+                    counts[TRACE_DELETE]);
+
+  for (int op = 0; op <= TRACE_DELETE; op++) {
+    free(latencies[op]);
+  }
+  free(tables);
+  munmap(trace.map, trace.map_size);
+
+  if (mismatches) {
+    printf("%zu lookups disagree with the trace\n", mismatches);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
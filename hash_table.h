@@ -0,0 +1,77 @@
+
+#ifndef HASH_TABLE_H
+#define HASH_TABLE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "allocator.h"
+#include "counting.h"
+#include "cursor.h"
+#include "linked_lists.h"
+
+// The interface all the hash table backends implement. Code that only
+// uses these functions can be linked against any of the backend
+// libraries, the way the tests are.
+struct hash_table; // Forward declaration
+
+struct hash_table *
+new_table(void);
+// A table that can hold `keys` keys without resizing
+struct hash_table *
+new_table_with_capacity(size_t keys);
+// A table that gets all its memory from `allocator`
+struct hash_table *
+new_table_with_allocator(size_t keys, const struct allocator *allocator);
+void
+delete_table(struct hash_table *table);
+
+void
+insert_key(struct hash_table *table, unsigned int key);
+bool
+contains_key(struct hash_table *table, unsigned int key);
+void
+delete_key(struct hash_table *table, unsigned int key);
+
+// insert_key and delete_key, telling us what they did: try_insert returns
+// false if the key was already there, and erase whether it was there.
+bool
+try_insert(struct hash_table *table, unsigned int key);
+bool
+erase(struct hash_table *table, unsigned int key);
+
+// Number of keys in the table
+size_t
+no_keys(struct hash_table *table);
+
+// Call f(key, data) for every key in the table, in no particular order.
+// The table must not be modified while this runs.
+void
+for_each_key(struct hash_table *table, void (*f)(unsigned int key, void *data),
+             void *data);
+
+// The keys are stored in no_bins(table) bins (or slots), and
+// for_each_key_in_bins calls f(key, data) for the keys in bins
+// [begin, end). Calls for disjoint ranges can run in parallel as long as
+// nothing modifies the table.
+size_t
+no_bins(struct hash_table *table);
+void
+for_each_key_in_bins(struct hash_table *table, size_t begin, size_t end,
+                     void (*f)(unsigned int key, void *data), void *data);
+
+// The bytes the table holds, by what they are for. With an allocator,
+// the total is what the table has allocated from it and not freed.
+struct memory_usage
+table_memory_usage(struct hash_table *table);
+
+// Scanning with cursors, next_n and next_key, is declared in cursor.h.
+
+// Counting keys, increment_key and top_k, is declared in counting.h. Only
+// the chaining and open addressing backends implement it.
+
+// Only the chaining backends implement this.
+void
+set_reorder(struct hash_table *table, enum reorder reorder);
+
+#endif
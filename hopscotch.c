@@ -0,0 +1,374 @@
+
+#include "hopscotch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "trace.h"
+
+// Smaller tables would have neighbourhoods that wrap around onto
+// themselves.
+#define MIN_SIZE NEIGHBORHOOD
+// new_table_with_capacity() sizes tables for this load
+#define CAPACITY_LOAD 0.875
+
+// Unlike open_addressing.c we don't use the key itself as the hash. With
+// clustered keys, more than NEIGHBORHOOD of them could share a home bin,
+// and then no amount of displacement or growing helps.
+static inline unsigned int
+hash(unsigned int key)
+{
+  // MurmurHash3's 32-bit finaliser, a bijection
+  key ^= key >> 16;
+  key *= 0x85ebca6bU;
+  key ^= key >> 13;
+  key *= 0xc2b2ae35U;
+  key ^= key >> 16;
+  return key;
+}
+
+static inline size_t
+home_bin(struct hash_table *table, unsigned int key)
+{
+  return hash(key) & (table->size - 1);
+}
+
+// The bin i bins after bin, wrapping around at the end of the table
+static inline size_t
+bin_after(struct hash_table *table, size_t bin, size_t i)
+{
+  return (bin + i) & (table->size - 1);
+}
+
+static inline bool
+is_occupied(struct hash_table *table, size_t bin)
+{
+  return (table->occupied[bin / 64] >> (bin % 64)) & 1;
+}
+static inline void
+flip_occupied(struct hash_table *table, size_t bin)
+{
+  table->occupied[bin / 64] ^= (uint64_t)1 << (bin % 64);
+}
+
+static void
+init_table(struct hash_table *table, size_t size)
+{
+  size_t moves = table->moves + 1;
+  const struct allocator *allocator = table->allocator;
+  struct hop_bin *bins = allocate(allocator, size * sizeof *bins);
+  for (size_t i = 0; i < size; i++) {
+    bins[i].hop = 0;
+  }
+  size_t words = (size + 63) / 64;
+  uint64_t *occupied = allocate_zeroed(allocator, words * sizeof *occupied);
+  // A table smaller than a word has bins past its end in the bitmap. Mark
+  // them as occupied so we never try to put a key there.
+  if (size % 64)
+    occupied[words - 1] = ~(uint64_t)0 << (size % 64);
+
+  *table = (struct hash_table){.bins = bins,
+                               .occupied = occupied,
+                               .size = size,
+                               .active = 0,
+                               .moves = moves,
+                               .allocator = allocator};
+}
+
+static void
+free_bins(struct hash_table *table)
+{
+  size_t words = (table->size + 63) / 64;
+  deallocate(table->allocator, table->occupied,
+             words * sizeof *table->occupied);
+  deallocate(table->allocator, table->bins, table->size * sizeof *table->bins);
+}
+
+struct hash_table *
+new_table_with_allocator(size_t keys, const struct allocator *allocator)
+{
+  size_t size = MIN_SIZE;
+  while (keys > size * CAPACITY_LOAD)
+    size *= 2;
+
+  struct hash_table *table = allocate(allocator, sizeof *table);
+  table->moves = 0;
+  table->allocator = allocator;
+  init_table(table, size);
+  TRACE(TRACE_NEW_TABLE, table, keys, false);
+  return table;
+}
+
+struct hash_table *
+new_table_with_capacity(size_t keys)
+{
+  return new_table_with_allocator(keys, NULL);
+}
+
+struct hash_table *
+new_table()
+{
+  return new_table_with_capacity(0);
+}
+
+void
+delete_table(struct hash_table *table)
+{
+  TRACE(TRACE_DELETE_TABLE, table, 0, false);
+  free_bins(table);
+  deallocate(table->allocator, table, sizeof *table);
+}
+
+// The bin holding key, or NULL
+static struct hop_bin *
+find_key(struct hash_table *table, unsigned int key)
+{
+  size_t home = home_bin(table, key);
+  for (uint32_t hop = table->bins[home].hop; hop; hop &= hop - 1) {
+    struct hop_bin *bin =
+        table->bins + bin_after(table, home, __builtin_ctz(hop));
+    if (bin->key == key)
+      return bin;
+  }
+  return NULL;
+}
+
+// The distance from bin to the first empty bin at or after it, or the
+// table size if there are none. We search the bitmap a word at a time.
+static size_t
+find_empty(struct hash_table *table, size_t bin)
+{
+  size_t distance = 0;
+  while (distance < table->size) {
+    size_t i = bin_after(table, bin, distance);
+    uint64_t empty = ~table->occupied[i / 64] >> (i % 64);
+    if (empty) {
+      distance += __builtin_ctzll(empty);
+      break;
+    }
+    // On to the next word, or the start of a table smaller than a word
+    distance += (table->size - i < 64 - i % 64) ? table->size - i : 64 - i % 64;
+  }
+  return distance < table->size ? distance : table->size;
+}
+
+// Move a key from a bin before `empty` into it, keeping the key in its
+// neighbourhood, and update `empty` to the bin we emptied. We take the
+// first key from the home bin furthest back, which moves the empty bin
+// the furthest. Returns false if no key can move.
+static bool
+move_empty_back(struct hash_table *table, size_t *empty)
+{
+  for (unsigned int distance = NEIGHBORHOOD - 1; distance > 0; distance--) {
+    size_t home = bin_after(table, *empty, table->size - distance);
+    // Keys from this home in bins before the empty one
+    uint32_t hop = table->bins[home].hop & ((1U << distance) - 1);
+    if (!hop)
+      continue;
+
+    unsigned int i = __builtin_ctz(hop);
+    size_t from = bin_after(table, home, i);
+    table->bins[*empty].key = table->bins[from].key;
+    table->bins[home].hop ^= (1U << i) | (1U << distance);
+    flip_occupied(table, *empty);
+    flip_occupied(table, from);
+    table->moves++;
+    *empty = from;
+    return true;
+  }
+  return false;
+}
+
+// Put a key that isn't in the table into it. Returns false if we can't
+// get an empty bin into its neighbourhood.
+static bool
+place_key(struct hash_table *table, unsigned int key)
+{
+  size_t home = home_bin(table, key);
+  size_t distance = find_empty(table, home);
+  if (distance == table->size)
+    return false;
+
+  size_t empty = bin_after(table, home, distance);
+  while (distance >= NEIGHBORHOOD) {
+    if (!move_empty_back(table, &empty))
+      return false;
+    distance = (empty - home) & (table->size - 1);
+  }
+
+  table->bins[empty].key = key;
+  table->bins[home].hop |= 1U << distance;
+  flip_occupied(table, empty);
+  table->active++;
+  return true;
+}
+
+// Move the keys to a table with new_size bins. If some neighbourhood
+// overflows, which is unlikely with fewer keys than bins, we try again
+// with twice the size.
+static void
+resize(struct hash_table *table, size_t new_size)
+{
+  struct hash_table old = *table;
+  for (;;) {
+    init_table(table, new_size);
+    size_t bin = 0;
+    for (; bin < old.size; bin++) {
+      if (is_occupied(&old, bin) && !place_key(table, old.bins[bin].key))
+        break;
+    }
+    if (bin == old.size)
+      break;
+    free_bins(table);
+    new_size *= 2;
+  }
+  free_bins(&old);
+}
+
+// The API functions are traced, so internally we use these instead.
+static bool
+add_key(struct hash_table *table, unsigned int key)
+{
+  if (find_key(table, key))
+    return false;
+  // Only grow when displacement fails
+  while (!place_key(table, key)) {
+    resize(table, 2 * table->size);
+  }
+  return true;
+}
+
+bool
+try_insert(struct hash_table *table, unsigned int key)
+{
+  TRACE(TRACE_INSERT, table, key, false);
+  return add_key(table, key);
+}
+
+void
+insert_key(struct hash_table *table, unsigned int key)
+{
+  try_insert(table, key);
+}
+
+bool
+contains_key(struct hash_table *table, unsigned int key)
+{
+  bool found = find_key(table, key) != NULL;
+  TRACE(TRACE_CONTAINS, table, key, found);
+  return found;
+}
+
+bool
+erase(struct hash_table *table, unsigned int key)
+{
+  TRACE(TRACE_DELETE, table, key, false);
+  struct hop_bin *bin = find_key(table, key);
+  if (!bin)
+    return false;
+
+  size_t index = bin - table->bins;
+  size_t home = home_bin(table, key);
+  table->bins[home].hop ^= 1U << ((index - home) & (table->size - 1));
+  flip_occupied(table, index);
+  table->active--;
+
+  if (table->active < table->size / 8 && table->size > MIN_SIZE)
+    resize(table, table->size / 2);
+  return true;
+}
+
+void
+delete_key(struct hash_table *table, unsigned int key)
+{
+  erase(table, key);
+}
+
+struct memory_usage
+table_memory_usage(struct hash_table *table)
+{
+  size_t words = (table->size + 63) / 64;
+  struct memory_usage usage = {
+      .table = sizeof *table,
+      .bins = table->size * sizeof *table->bins +
+              words * sizeof *table->occupied};
+  usage.total = usage.table + usage.bins;
+  return usage;
+}
+
+size_t
+no_keys(struct hash_table *table)
+{
+  return table->active;
+}
+
+void
+for_each_key(struct hash_table *table, void (*f)(unsigned int key, void *data),
+             void *data)
+{
+  for_each_key_in_bins(table, 0, table->size, f, data);
+}
+
+size_t
+no_bins(struct hash_table *table)
+{
+  return table->size;
+}
+
+void
+for_each_key_in_bins(struct hash_table *table, size_t begin, size_t end,
+                     void (*f)(unsigned int key, void *data), void *data)
+{
+  for (size_t bin = begin; bin < end; bin++) {
+    if (is_occupied(table, bin))
+      f(table->bins[bin].key, data);
+  }
+}
+
+// We scan keys by their home bin, in reverse-binary order, as in
+// open_addressing.c. Displacement moves keys around in a neighbourhood,
+// so it counts as a resize for the cursor.
+static size_t
+next_scan_bin(void *table, size_t bin)
+{
+  return next_reverse_binary(bin, ((struct hash_table *)table)->size - 1);
+}
+
+static void
+visit_scan_bin(void *table, size_t bin,
+               void (*f)(unsigned int key, void *data), void *data)
+{
+  struct hash_table *t = table;
+  size_t home = bin & (t->size - 1);
+  for (uint32_t hop = t->bins[home].hop; hop; hop &= hop - 1) {
+    f(t->bins[bin_after(t, home, __builtin_ctz(hop))].key, data);
+  }
+}
+
+unsigned int
+next_n(struct hash_table *table, struct cursor *cursor, unsigned int *keys,
+       unsigned int n)
+{
+  struct scan_bins bins = {.table = table,
+                           .stamp = table->moves,
+                           .restart_on_resize = false,
+                           .next = next_scan_bin,
+                           .visit = visit_scan_bin};
+  return scan_next_n(cursor, &bins, keys, n);
+}
+
+void
+print_table(struct hash_table *table)
+{
+  for (size_t i = 0; i < table->size; i++) {
+    if (i > 0 && i % 8 == 0) {
+      printf("\n");
+    }
+    if (is_occupied(table, i)) {
+      printf("[%u]", table->bins[i].key);
+    } else {
+      printf("[ ]");
+    }
+  }
+  printf("\n----------------------\n");
+}
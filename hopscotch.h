@@ -0,0 +1,78 @@
+
+#ifndef HOPSCOTCH_H
+#define HOPSCOTCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "allocator.h"
+#include "cursor.h"
+
+// Hopscotch hashing. Every key is within NEIGHBORHOOD bins of its home
+// bin, and the home bin has a bitmap of which of those bins hold its keys,
+// so a lookup only looks at the bins in the bitmap. Insertion finds an
+// empty bin and, if it is too far from home, moves keys closer to their
+// own homes until it is near. Only when that fails do we grow the table,
+// so the table can run at a load of 0.9 or more.
+#define NEIGHBORHOOD 32
+
+struct hop_bin {
+  uint32_t hop; // Bit i is set if bin home + i holds a key with this home
+  unsigned int key;
+};
+
+struct hash_table {
+  struct hop_bin *bins;
+  uint64_t *occupied; // Bitmap of the bins holding a key
+  size_t size;
+  size_t active;
+  size_t moves; // Bumped whenever keys move between bins
+  const struct allocator *allocator;
+};
+
+struct hash_table *
+new_table(void);
+struct hash_table *
+new_table_with_capacity(size_t keys);
+struct hash_table *
+new_table_with_allocator(size_t keys, const struct allocator *allocator);
+void
+delete_table(struct hash_table *table);
+
+void
+insert_key(struct hash_table *table, unsigned int key);
+bool
+contains_key(struct hash_table *table, unsigned int key);
+void
+delete_key(struct hash_table *table, unsigned int key);
+
+// insert_key and delete_key, telling us what they did: try_insert returns
+// false if the key was already there, and erase whether it was there.
+bool
+try_insert(struct hash_table *table, unsigned int key);
+bool
+erase(struct hash_table *table, unsigned int key);
+
+// Number of keys in the table
+size_t
+no_keys(struct hash_table *table);
+// Call f(key, data) for every key in the table
+void
+for_each_key(struct hash_table *table, void (*f)(unsigned int key, void *data),
+             void *data);
+// Bins and the keys in bins [begin, end)
+size_t
+no_bins(struct hash_table *table);
+void
+for_each_key_in_bins(struct hash_table *table, size_t begin, size_t end,
+                     void (*f)(unsigned int key, void *data), void *data);
+
+// The bytes the table holds
+struct memory_usage
+table_memory_usage(struct hash_table *table);
+
+// For debugging
+void
+print_table(struct hash_table *table);
+
+#endif
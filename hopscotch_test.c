@@ -0,0 +1,81 @@
+
+#include "hopscotch.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static unsigned int
+random_key()
+{
+  unsigned int key = (unsigned int)rand();
+  return key;
+}
+
+int
+main(int argc, const char *argv[])
+{
+  if (argc != 2) {
+    printf("Usage: %s no_elements\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  int no_elms = atoi(argv[1]);
+  unsigned int *keys = malloc(no_elms * sizeof *keys);
+  // Distinct keys, so deleting one doesn't delete another
+  for (int i = 0; i < no_elms; ++i) {
+    keys[i] = (unsigned int)i * 2654435761U;
+  }
+
+  struct hash_table *table = new_table();
+  clock_t start = clock();
+  // We only grow when displacement fails, so the table should be nearly
+  // full each time it grows. Small tables fill up completely.
+  double min_load = 1;
+  for (int i = 0; i < no_elms; ++i) {
+    unsigned int bins = no_bins(table), keys_before = no_keys(table);
+    insert_key(table, keys[i]);
+    if (no_bins(table) != bins && bins >= 1024 &&
+        keys_before / (double)bins < min_load)
+      min_load = keys_before / (double)bins;
+  }
+  for (int i = 0; i < no_elms; ++i) {
+    assert(contains_key(table, keys[i]));
+  }
+  for (int i = 0; i < no_elms; ++i) {
+    contains_key(table, random_key());
+  }
+  for (int i = 0; i < no_elms / 2; ++i) {
+    delete_key(table, keys[i]);
+  }
+  for (int i = 0; i < no_elms; ++i) {
+    assert(contains_key(table, keys[i]) == (i >= no_elms / 2));
+  }
+  for (int i = no_elms / 2; i < no_elms; ++i) {
+    delete_key(table, keys[i]);
+  }
+  for (int i = 0; i < no_elms; ++i) {
+    assert(!contains_key(table, keys[i]));
+  }
+  assert(no_keys(table) == 0);
+  clock_t end = clock();
+  double elapsed_time = (end - start) / (double)CLOCKS_PER_SEC;
+  printf("%g (lowest load when growing %g)\n", elapsed_time, min_load);
+  assert(min_load > 0.75);
+
+  // Keys that are all the same modulo the table size don't break it
+  for (unsigned int i = 0; i < 1000; ++i) {
+    insert_key(table, i << 20);
+  }
+  assert(no_keys(table) == 1000);
+  assert(no_bins(table) <= 2048);
+  for (unsigned int i = 0; i < 1000; ++i) {
+    assert(contains_key(table, i << 20));
+  }
+
+  free(keys);
+  delete_table(table);
+
+  return EXIT_SUCCESS;
+}
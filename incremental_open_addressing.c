@@ -0,0 +1,377 @@
+
+#include "incremental_open_addressing.h"
+
+#include <stdlib.h>
+
+#include "trace.h"
+
+#define MIN_BITS 3 // 8 groups
+
+// Groups are allocated this many at a time
+#ifndef SEGMENT_BITS
+#define SEGMENT_BITS 6
+#endif
+#define SEGMENT_GROUPS ((size_t)1 << SEGMENT_BITS)
+
+static inline size_t
+m(struct hash_table *table)
+{
+  return (size_t)1 << table->bits;
+}
+
+// The groups [0, m + split) are in the table
+static inline size_t
+max_index(struct hash_table *table)
+{
+  return m(table) + table->split;
+}
+
+// A key's home group, as in dynamic_chained_hash
+static inline size_t
+home_group(struct hash_table *table, unsigned int key)
+{
+  size_t masked_key = key & (2 * m(table) - 1);
+  return (masked_key < max_index(table)) ? masked_key : (masked_key - m(table));
+}
+
+static inline struct group *
+get_group(struct hash_table *table, size_t index)
+{
+  return &table->segments[index >> SEGMENT_BITS][index & (SEGMENT_GROUPS - 1)];
+}
+
+static inline size_t
+allocated_groups(struct hash_table *table)
+{
+  return table->no_segments << SEGMENT_BITS;
+}
+
+// Make sure the groups up to index exist
+static void
+reserve_group(struct hash_table *table, size_t index)
+{
+  while (index >= allocated_groups(table)) {
+    if (table->no_segments == table->segments_capacity) {
+      size_t capacity = 2 * table->segments_capacity;
+      table->segments =
+          reallocate(table->allocator, table->segments,
+                     table->segments_capacity * sizeof *table->segments,
+                     capacity * sizeof *table->segments);
+      table->segments_capacity = capacity;
+    }
+    table->segments[table->no_segments++] = allocate_zeroed(
+        table->allocator, SEGMENT_GROUPS * sizeof(struct group));
+  }
+}
+
+static inline bool
+segment_is_empty(struct group *segment)
+{
+  for (size_t i = 0; i < SEGMENT_GROUPS; i++) {
+    if (segment[i].count || segment[i].overflow)
+      return false;
+  }
+  return true;
+}
+
+// Free empty segments at the end that are past the groups in the table
+static void
+release_segments(struct hash_table *table)
+{
+  while (table->no_segments > 1 &&
+         (table->no_segments - 1) << SEGMENT_BITS >= max_index(table) &&
+         segment_is_empty(table->segments[table->no_segments - 1])) {
+    deallocate(table->allocator, table->segments[--table->no_segments],
+               SEGMENT_GROUPS * sizeof(struct group));
+  }
+}
+
+// Adding or removing a key that probed past groups [from, to)
+static void
+add_overflow(struct hash_table *table, size_t from, size_t to)
+{
+  for (size_t index = from; index < to; index++) {
+    struct group *group = get_group(table, index);
+    if (group->overflow < UINT16_MAX)
+      group->overflow++;
+  }
+}
+static void
+remove_overflow(struct hash_table *table, size_t from, size_t to)
+{
+  for (size_t index = from; index < to; index++) {
+    struct group *group = get_group(table, index);
+    if (group->overflow < UINT16_MAX)
+      group->overflow--;
+  }
+}
+
+// Put a key that isn't in the table in the first group with room
+static void
+place_key(struct hash_table *table, unsigned int key, size_t home)
+{
+  size_t index = home;
+  for (;; index++) {
+    reserve_group(table, index);
+    struct group *group = get_group(table, index);
+    if (group->count < GROUP_SLOTS) {
+      group->keys[group->count++] = key;
+      break;
+    }
+  }
+  add_overflow(table, home, index);
+}
+
+// Find a key, setting *index and *slot to where it is
+static bool
+find_key(struct hash_table *table, unsigned int key, size_t home,
+         size_t *index, unsigned int *slot)
+{
+  for (size_t i = home;; i++) {
+    struct group *group = get_group(table, i);
+    for (unsigned int s = 0; s < group->count; s++) {
+      if (group->keys[s] == key) {
+        *index = i;
+        *slot = s;
+        return true;
+      }
+    }
+    if (!group->overflow)
+      return false;
+  }
+}
+
+static void
+remove_slot(struct hash_table *table, size_t home, size_t index,
+            unsigned int slot)
+{
+  struct group *group = get_group(table, index);
+  group->keys[slot] = group->keys[--group->count];
+  remove_overflow(table, home, index);
+}
+
+// Take the keys with masked value `masked` out of the probe run from home,
+// returning them in an array of *n keys the caller frees.
+static unsigned int *
+take_keys(struct hash_table *table, size_t home, size_t mask, size_t masked,
+          size_t *n)
+{
+  *n = 0;
+  for (size_t index = home;; index++) {
+    struct group *group = get_group(table, index);
+    for (unsigned int s = 0; s < group->count; s++) {
+      *n += (group->keys[s] & mask) == masked;
+    }
+    if (!group->overflow)
+      break;
+  }
+  if (*n == 0)
+    return NULL;
+
+  unsigned int *keys = allocate(table->allocator, *n * sizeof *keys);
+  size_t taken = 0;
+  for (size_t index = home; taken < *n; index++) {
+    struct group *group = get_group(table, index);
+    for (unsigned int s = group->count; s-- > 0;) {
+      if ((group->keys[s] & mask) == masked) {
+        keys[taken++] = group->keys[s];
+        remove_slot(table, home, index, s);
+      }
+    }
+  }
+  return keys;
+}
+
+// Put back keys we took out, at their homes in the table as it is now
+static void
+place_keys(struct hash_table *table, unsigned int *keys, size_t n)
+{
+  for (size_t i = 0; i < n; i++) {
+    place_key(table, keys[i], home_group(table, keys[i]));
+  }
+  if (n)
+    deallocate(table->allocator, keys, n * sizeof *keys);
+}
+
+// Add group m + split to the table, giving it the keys in the split group
+// with the next bit set. We put back the keys that stay as well, since
+// the split group was one of the fullest, and the ones that overflowed it
+// can now move back closer to home.
+static void
+split_group(struct hash_table *table)
+{
+  size_t from = table->split, n;
+  unsigned int *keys = take_keys(table, from, m(table) - 1, from, &n);
+  reserve_group(table, max_index(table));
+  if (++table->split == m(table)) {
+    table->bits++;
+    table->split = 0;
+  }
+  place_keys(table, keys, n);
+}
+
+// Take the last group out of the table, moving its keys back to the group
+// it was split from. The group stays allocated if keys probed into it.
+static void
+merge_group(struct hash_table *table)
+{
+  if (table->split == 0) {
+    table->bits--;
+    table->split = m(table);
+  }
+  size_t from = m(table) + --table->split, n;
+  unsigned int *keys = take_keys(table, from, 2 * m(table) - 1, from, &n);
+  place_keys(table, keys, n);
+  release_segments(table);
+}
+
+struct hash_table *
+new_table_with_allocator(size_t keys, const struct allocator *allocator)
+{
+  struct hash_table *table = allocate(allocator, sizeof *table);
+  table->allocator = allocator;
+  table->segments_capacity = 2;
+  table->segments = allocate(allocator, table->segments_capacity *
+                                            sizeof *table->segments);
+  table->no_segments = 0;
+  table->bits = MIN_BITS;
+  table->split = 0;
+  table->used = 0;
+
+  // Start with the groups for keys at half load, since splitting them one
+  // at a time would move the keys several times.
+  size_t groups = (2 * keys + GROUP_SLOTS - 1) / GROUP_SLOTS;
+  while (2 * m(table) <= groups)
+    table->bits++;
+  if (groups > m(table))
+    table->split = groups - m(table);
+  reserve_group(table, max_index(table) - 1);
+  TRACE(TRACE_NEW_TABLE, table, keys, false);
+  return table;
+}
+
+struct hash_table *
+new_table_with_capacity(size_t keys)
+{
+  return new_table_with_allocator(keys, NULL);
+}
+
+struct hash_table *
+new_table()
+{
+  return new_table_with_capacity(0);
+}
+
+void
+delete_table(struct hash_table *table)
+{
+  TRACE(TRACE_DELETE_TABLE, table, 0, false);
+  for (size_t i = 0; i < table->no_segments; i++) {
+    deallocate(table->allocator, table->segments[i],
+               SEGMENT_GROUPS * sizeof(struct group));
+  }
+  deallocate(table->allocator, table->segments,
+             table->segments_capacity * sizeof *table->segments);
+  deallocate(table->allocator, table, sizeof *table);
+}
+
+size_t
+no_keys(struct hash_table *table)
+{
+  return table->used;
+}
+
+void
+for_each_key(struct hash_table *table, void (*f)(unsigned int key, void *data),
+             void *data)
+{
+  for_each_key_in_bins(table, 0, no_bins(table), f, data);
+}
+
+size_t
+no_bins(struct hash_table *table)
+{
+  return allocated_groups(table);
+}
+
+void
+for_each_key_in_bins(struct hash_table *table, size_t begin, size_t end,
+                     void (*f)(unsigned int key, void *data), void *data)
+{
+  for (size_t index = begin; index < end; index++) {
+    struct group *group = get_group(table, index);
+    for (unsigned int s = 0; s < group->count; s++) {
+      f(group->keys[s], data);
+    }
+  }
+}
+
+struct memory_usage
+table_memory_usage(struct hash_table *table)
+{
+  struct memory_usage usage = {
+      .table = sizeof *table,
+      .bins = allocated_groups(table) * sizeof(struct group),
+      .subtables = table->segments_capacity * sizeof *table->segments};
+  usage.total = usage.table + usage.bins + usage.subtables;
+  return usage;
+}
+
+// The API functions are traced, so internally we use this instead.
+static bool
+has_key(struct hash_table *table, unsigned int key)
+{
+  size_t index;
+  unsigned int slot;
+  return find_key(table, key, home_group(table, key), &index, &slot);
+}
+
+bool
+try_insert(struct hash_table *table, unsigned int key)
+{
+  TRACE(TRACE_INSERT, table, key, false);
+  if (has_key(table, key))
+    return false;
+  place_key(table, key, home_group(table, key));
+  // Split when the table is more than half full
+  if (2 * ++table->used > max_index(table) * GROUP_SLOTS)
+    split_group(table);
+  return true;
+}
+
+void
+insert_key(struct hash_table *table, unsigned int key)
+{
+  try_insert(table, key);
+}
+
+bool
+contains_key(struct hash_table *table, unsigned int key)
+{
+  bool found = has_key(table, key);
+  TRACE(TRACE_CONTAINS, table, key, found);
+  return found;
+}
+
+bool
+erase(struct hash_table *table, unsigned int key)
+{
+  TRACE(TRACE_DELETE, table, key, false);
+  size_t home = home_group(table, key), index;
+  unsigned int slot;
+  if (!find_key(table, key, home, &index, &slot))
+    return false;
+  remove_slot(table, home, index, slot);
+  table->used--;
+  // Merge when it is less than a quarter full
+  if (max_index(table) > ((size_t)1 << MIN_BITS) &&
+      4 * table->used < max_index(table) * GROUP_SLOTS)
+    merge_group(table);
+  return true;
+}
+
+void
+delete_key(struct hash_table *table, unsigned int key)
+{
+  erase(table, key);
+}
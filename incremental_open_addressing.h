@@ -0,0 +1,87 @@
+
+#ifndef INCREMENTAL_OPEN_ADDRESSING_H
+#define INCREMENTAL_OPEN_ADDRESSING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "allocator.h"
+
+// Open addressing that grows one group of bins at a time, with the split
+// pointer addressing of linear hashing from dynamic_chained_hash.c.
+//
+// Keys go in groups of GROUP_SLOTS slots, and a lookup scans its home
+// group. A key whose home group is full goes in the next group with room,
+// and every group it passes counts it in `overflow`, so a lookup only goes
+// on to the next group while that count is non-zero. Deletions undo the
+// counts, so there are no tombstones.
+//
+// Whenever the table is half full we split the group at the split pointer,
+// which only touches the keys of that group, giving those with the next
+// bit set to the new group at the end.
+// Probes never wrap around, so keys that run past the last group just go
+// into groups after it, and they stay findable when those groups join the
+// table. Groups are allocated in segments as they are reached, so memory
+// grows by a segment at a time rather than doubling.
+#define GROUP_SLOTS 7
+
+struct group {
+  unsigned int keys[GROUP_SLOTS]; // keys[0, count) are in use
+  uint8_t count;
+  uint16_t overflow; // Keys that probed past this group; sticks at max
+};
+
+struct hash_table {
+  struct group **segments;
+  size_t no_segments;
+  size_t segments_capacity;
+  unsigned int bits; // The first 1 << bits groups are the base range
+  size_t split;      // Groups [0, split) have been split this round
+  size_t used;
+  const struct allocator *allocator;
+};
+
+struct hash_table *
+new_table(void);
+struct hash_table *
+new_table_with_capacity(size_t keys);
+struct hash_table *
+new_table_with_allocator(size_t keys, const struct allocator *allocator);
+void
+delete_table(struct hash_table *table);
+
+void
+insert_key(struct hash_table *table, unsigned int key);
+bool
+contains_key(struct hash_table *table, unsigned int key);
+void
+delete_key(struct hash_table *table, unsigned int key);
+
+// insert_key and delete_key, telling us what they did: try_insert returns
+// false if the key was already there, and erase whether it was there.
+bool
+try_insert(struct hash_table *table, unsigned int key);
+bool
+erase(struct hash_table *table, unsigned int key);
+
+// Number of keys in the table
+size_t
+no_keys(struct hash_table *table);
+// Call f(key, data) for every key in the table
+void
+for_each_key(struct hash_table *table, void (*f)(unsigned int key, void *data),
+             void *data);
+// Bins, here the allocated groups, and the keys in bins [begin, end)
+size_t
+no_bins(struct hash_table *table);
+void
+for_each_key_in_bins(struct hash_table *table, size_t begin, size_t end,
+                     void (*f)(unsigned int key, void *data), void *data);
+
+// The bytes the table holds. The groups are the bins, and the array of
+// segment pointers counts as subtables.
+struct memory_usage
+table_memory_usage(struct hash_table *table);
+
+#endif
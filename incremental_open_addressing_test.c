@@ -0,0 +1,94 @@
+
+#include "incremental_open_addressing.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Memory grows a segment at a time as the table splits its groups, never
+// by doubling, and keys that overflow their groups survive the splits and
+// merges.
+
+static unsigned int
+key(unsigned int i)
+{
+  return i * 2654435761U;
+}
+
+static void
+count_key(unsigned int key, void *data)
+{
+  (*(size_t *)data)++;
+}
+
+int
+main(int argc, const char *argv[])
+{
+  if (argc != 2) {
+    printf("Usage: %s no_elements\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  unsigned int no_elms = atoi(argv[1]);
+
+  struct hash_table *table = new_table();
+  size_t empty_bins = table_memory_usage(table).bins, largest_step = 0;
+  size_t before = table_memory_usage(table).total;
+  // We count what try_insert and erase do, rather than call them in
+  // asserts, which NDEBUG takes out
+  unsigned int changed = 0;
+  for (unsigned int i = 0; i < no_elms; i++) {
+    changed += try_insert(table, key(i));
+    size_t after = table_memory_usage(table).total;
+    if (after - before > largest_step)
+      largest_step = after - before;
+    // A segment, and now and then the segment pointers doubling
+    assert(after - before <= 4096 + before / 64);
+    before = after;
+  }
+  assert(changed == no_elms);
+  for (unsigned int i = 0; i < no_elms; i++) {
+    assert(contains_key(table, key(i)));
+    assert(!contains_key(table, key(no_elms + i)));
+  }
+  printf("groups: %zu, bytes per key: %.2f, largest step: %zu bytes\n",
+         no_bins(table), before / (double)no_elms, largest_step);
+
+  changed = 0;
+  for (unsigned int i = 0; i < no_elms; i += 2) {
+    changed += erase(table, key(i));
+  }
+  assert(changed == (no_elms + 1) / 2);
+  for (unsigned int i = 0; i < no_elms; i++) {
+    assert(contains_key(table, key(i)) == (i % 2 == 1));
+  }
+  for (unsigned int i = 1; i < no_elms; i += 2) {
+    delete_key(table, key(i));
+  }
+  assert(no_keys(table) == 0);
+  // The segments go again as the groups merge
+  assert(table_memory_usage(table).bins == empty_bins);
+
+  // Keys with the same low bits all start in the same group, so most of
+  // them overflow, and they keep moving between groups as the table splits
+  // and merges.
+  unsigned int collisions = no_elms < 1000 ? no_elms : 1000;
+  for (unsigned int i = 0; i < collisions; i++) {
+    insert_key(table, i << 16);
+  }
+  for (unsigned int i = 0; i < collisions; i++) {
+    assert(contains_key(table, i << 16));
+    assert(!contains_key(table, (i << 16) | 1));
+  }
+  for (unsigned int i = 0; i < collisions; i += 2) {
+    delete_key(table, i << 16);
+  }
+  for (unsigned int i = 0; i < collisions; i++) {
+    assert(contains_key(table, i << 16) == (i % 2 == 1));
+  }
+  size_t visited = 0;
+  for_each_key(table, count_key, &visited);
+  assert(visited == no_keys(table));
+
+  delete_table(table);
+  return EXIT_SUCCESS;
+}
@@ -4,51 +4,77 @@
 #include <stdio.h>
 
 LIST
-new_owned_list()
+new_owned_list_with_allocator(const struct allocator *allocator)
 {
-  struct link **ptr = malloc(sizeof *ptr);
+  struct link **ptr = allocate(allocator, sizeof *ptr);
   *ptr = NULL;
   return ptr;
 }
 
+LIST
+new_owned_list(void)
+{
+  return new_owned_list_with_allocator(NULL);
+}
+
 static void
-free_head(LIST list)
+free_head(LIST list, const struct allocator *allocator)
 {
   struct link *next = (*list)->next;
-  free(*list);
+  deallocate(allocator, *list, sizeof **list);
   *list = next;
 }
 
 void
-free_list(LIST list)
+free_list_with_allocator(LIST list, const struct allocator *allocator)
 {
   while (*list) {
-    free_head(list);
+    free_head(list, allocator);
   }
 }
 
+void
+free_list(LIST list)
+{
+  free_list_with_allocator(list, NULL);
+}
+
+void
+free_owned_list_with_allocator(LIST list, const struct allocator *allocator)
+{
+  free_list_with_allocator(list, allocator);
+  deallocate(allocator, list, sizeof *list);
+}
+
 void
 free_owned_list(LIST list)
 {
-  free_list(list);
-  free(list);
+  free_owned_list_with_allocator(list, NULL);
 }
 
 struct link *
-new_link(unsigned int key, struct link *next)
+new_link(unsigned int key, struct link *next,
+         const struct allocator *allocator)
 {
-  struct link *link = malloc(sizeof *link);
-  *link = (struct link){.key = key, .next = next};
+  struct link *link = allocate(allocator, sizeof *link);
+  *link = (struct link){.key = key, .count = 1, .next = next};
   return link;
 }
 
 void
-add_element(LIST list, unsigned int key)
+add_element_with_allocator(LIST list, unsigned int key,
+                           const struct allocator *allocator)
 {
   // Build link and put it at the front of the list.
   // The hash table checks for duplicates if we want to
   // avoid those
-  *list = new_link(key, *list);
+  *list = new_link(key, *list, allocator);
+}
+
+void
+add_element(LIST list, unsigned int key)
+{
+  add_element_with_allocator(list, key, NULL);
 }
 
 LIST
@@ -61,12 +87,21 @@ find_key(LIST list, unsigned int key)
   return NULL;
 }
 
-void
-delete_element(LIST list, unsigned int key)
+bool
+delete_element_with_allocator(LIST list, unsigned int key,
+                              const struct allocator *allocator)
 {
   if ((list = find_key(list, key))) {
-    free_head(list);
+    free_head(list, allocator);
+    return true;
   }
+  return false;
+}
+
+bool
+delete_element(LIST list, unsigned int key)
+{
+  return delete_element_with_allocator(list, key, NULL);
 }
 
 bool
@@ -74,3 +109,65 @@ contains_element(LIST list, unsigned int key)
 {
   return find_key(list, key) != 0;
 }
+
+struct link *
+get_element(LIST list, unsigned int key)
+{
+  return (list = find_key(list, key)) ? *list : NULL;
+}
+
+struct link *
+get_or_add_element_with_allocator(LIST list, unsigned int key, bool *added,
+                                  const struct allocator *allocator)
+{
+  struct link *link = get_element(list, key);
+  *added = !link;
+  if (!link) {
+    link = *list = new_link(key, *list, allocator);
+    link->count = 0;
+  }
+  return link;
+}
+
+struct link *
+get_or_add_element(LIST list, unsigned int key, bool *added)
+{
+  return get_or_add_element_with_allocator(list, key, added, NULL);
+}
+
+bool
+contains_element_reorder(LIST list, unsigned int key, enum reorder reorder)
+{
+  LIST head = list, prev = NULL;
+  for (; *list; prev = list, list = &(*list)->next) {
+    if ((*list)->key == key)
+      break;
+  }
+
+  struct link *link = *list;
+  if (!link)
+    return false;
+  if (!prev)
+    return true; // Already at the front
+
+  switch (reorder) {
+  case NO_REORDER:
+    break;
+
+  case MOVE_TO_FRONT:
+    // Unlink and put the link at the front of the list
+    *list = link->next;
+    link->next = *head;
+    *head = link;
+    break;
+
+  case TRANSPOSE:
+    // Swap the link with the one before it. `list` is the predecessor's
+    // next pointer, so updating it unlinks `link`.
+    *list = link->next;
+    link->next = *prev;
+    *prev = link;
+    break;
+  }
+  return true;
+}
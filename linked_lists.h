@@ -5,16 +5,24 @@
 #include <stdbool.h>
 #include <stdlib.h>
 
+#include "allocator.h"
+
 struct link {
   unsigned int key;
+  unsigned int count; // For counting tables; fits in the padding
   struct link *next;
 };
 typedef struct link **LIST;
 
 #define EMPTY_LIST &((struct link *){NULL})
 
+// Strategies for self-organising lists. On a successful lookup the key
+// can be moved to the front of the list or swapped with its predecessor,
+// so frequently accessed keys migrate towards the front.
+enum reorder { NO_REORDER, MOVE_TO_FRONT, TRANSPOSE };
+
 LIST
-new_owned_list();
+new_owned_list(void);
 void
 free_owned_list(LIST list);
 void
@@ -22,9 +30,38 @@ free_list(LIST list);
 
 void
 add_element(LIST list, unsigned int key);
-void
+// Returns whether key was in the list
+bool
 delete_element(LIST list, unsigned int key);
 bool
 contains_element(LIST list, unsigned int key);
+bool
+contains_element_reorder(LIST list, unsigned int key, enum reorder reorder);
+
+// The link holding key, or NULL
+struct link *
+get_element(LIST list, unsigned int key);
+// The link holding key. If there isn't one, we add it at the front with
+// count 0 and set *added.
+struct link *
+get_or_add_element(LIST list, unsigned int key, bool *added);
+
+// The same, with the links coming from allocator (NULL for malloc). A
+// list must be freed with the allocator its links came from.
+LIST
+new_owned_list_with_allocator(const struct allocator *allocator);
+void
+free_owned_list_with_allocator(LIST list, const struct allocator *allocator);
+void
+free_list_with_allocator(LIST list, const struct allocator *allocator);
+void
+add_element_with_allocator(LIST list, unsigned int key,
+                           const struct allocator *allocator);
+bool
+delete_element_with_allocator(LIST list, unsigned int key,
+                              const struct allocator *allocator);
+struct link *
+get_or_add_element_with_allocator(LIST list, unsigned int key, bool *added,
+                                  const struct allocator *allocator);
 
 #endif
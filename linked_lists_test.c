@@ -42,6 +42,40 @@ test_list(LIST list)
   printf("\n");
 }
 
+static void
+test_reorder(void)
+{
+  LIST list = new_owned_list();
+  for (unsigned int key = 1; key <= 4; key++) {
+    add_element(list, key);
+  }
+  // The list is now 4, 3, 2, 1
+
+  // contains_element_reorder goes outside the asserts, so the list still
+  // reorders when NDEBUG takes them out
+  printf("Transposing key 1\n");
+  unsigned int found = contains_element_reorder(list, 1, TRANSPOSE);
+  assert(found == 1);
+  assert((*list)->next->next->key == 1);
+  assert((*list)->next->next->next->key == 2);
+
+  printf("Moving key 2 to the front\n");
+  found += contains_element_reorder(list, 2, MOVE_TO_FRONT);
+  assert(found == 2);
+  assert((*list)->key == 2);
+  assert((*list)->next->key == 4);
+
+  found += contains_element_reorder(list, 5, MOVE_TO_FRONT);
+  found += contains_element_reorder(list, 5, TRANSPOSE);
+  assert(found == 2);
+  for (unsigned int key = 1; key <= 4; key++) {
+    assert(contains_element(list, key));
+  }
+  printf("\n");
+
+  free_owned_list(list);
+}
+
 int
 main()
 {
@@ -53,5 +87,7 @@ main()
   test_list(owned_list);
   free_owned_list(owned_list);
 
+  test_reorder();
+
   return 0;
 }
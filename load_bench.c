@@ -0,0 +1,85 @@
+
+#include "hash_table.h"
+#include "perf_counters.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Lookups in a table with a fixed number of bins, as full as the backend
+// lets it get before it grows. Open addressing uses 4.25 bytes per bin and
+// hopscotch 8, so divide the bins by the load to compare bytes per key.
+
+static unsigned int
+random_key()
+{
+  unsigned int key = (unsigned int)rand();
+  return key;
+}
+
+int
+main(int argc, const char *argv[])
+{
+  if (argc != 2) {
+    printf("Usage: %s no_bins\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  unsigned int max_bins = atoi(argv[1]);
+
+  // Find how many keys we can insert before the table outgrows max_bins
+  unsigned int *keys = malloc((max_bins + 1) * sizeof *keys);
+  struct hash_table *table = new_table();
+  unsigned int no_elms = 0;
+  for (;;) {
+    unsigned int key = random_key();
+    if (contains_key(table, key))
+      continue; // We want distinct keys
+    insert_key(table, key);
+    if (no_bins(table) > max_bins)
+      break;
+    keys[no_elms++] = key;
+  }
+  delete_table(table);
+
+  table = new_table();
+  for (unsigned int i = 0; i < no_elms; i++) {
+    insert_key(table, keys[i]);
+  }
+  printf("keys: %zu, bins: %zu, load: %g\n", no_keys(table), no_bins(table),
+         no_keys(table) / (double)no_bins(table));
+
+  unsigned int *misses = malloc(no_elms * sizeof *misses);
+  for (unsigned int i = 0; i < no_elms; i++) {
+    misses[i] = random_key();
+  }
+
+  struct perf_counters counters;
+  open_perf_counters(&counters);
+  print_perf_header();
+
+  unsigned int found = 0;
+  start_perf_counters(&counters);
+  for (unsigned int i = 0; i < no_elms; i++) {
+    found += contains_key(table, keys[i]);
+  }
+  stop_perf_counters(&counters);
+  print_perf_counters("lookup hit", &counters, no_elms);
+
+  start_perf_counters(&counters);
+  for (unsigned int i = 0; i < no_elms; i++) {
+    found += contains_key(table, misses[i]);
+  }
+  stop_perf_counters(&counters);
+  print_perf_counters("lookup random", &counters, no_elms);
+  close_perf_counters(&counters);
+
+  if (found < no_elms) {
+    printf("The table lost keys\n");
+    return EXIT_FAILURE;
+  }
+
+  delete_table(table);
+  free(misses);
+  free(keys);
+
+  return EXIT_SUCCESS;
+}
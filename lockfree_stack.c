@@ -0,0 +1,204 @@
+
+#include "lockfree_stack.h"
+
+#include <stdlib.h>
+
+#ifndef ELIMINATION_SPINS
+#define ELIMINATION_SPINS 128 // How long a push waits for a pop to meet it
+#endif
+
+#define NIL UINT32_MAX
+
+struct lockfree_node {
+  int value;
+  _Atomic uint32_t next;
+};
+
+// Tagged indices: the index in the low bits, the tag in the high
+static inline uint32_t
+tagged_index(uint64_t tagged)
+{
+  return (uint32_t)tagged;
+}
+static inline uint64_t
+tagged(uint32_t index, uint64_t previous)
+{
+  return ((previous >> 32) + 1) << 32 | index;
+}
+
+// Elimination slots: the state in the high bits, the value in the low
+enum slot_state { SLOT_EMPTY, SLOT_OFFERED, SLOT_TAKEN };
+
+static inline uint64_t
+slot_word(enum slot_state state, int value)
+{
+  return (uint64_t)state << 32 | (uint32_t)value;
+}
+static inline enum slot_state
+slot_state(uint64_t word)
+{
+  return (enum slot_state)(word >> 32);
+}
+
+struct lockfree_stack *
+new_lockfree_stack(unsigned int capacity, unsigned int no_slots)
+{
+  struct lockfree_stack *stack = malloc(sizeof *stack);
+  stack->nodes = malloc(capacity * sizeof *stack->nodes);
+  // Initially, all the nodes are on the free list, in order
+  for (uint32_t i = 0; i < capacity; i++) {
+    atomic_init(&stack->nodes[i].next, i + 1 < capacity ? i + 1 : NIL);
+  }
+  atomic_init(&stack->top, NIL);
+  atomic_init(&stack->free, capacity ? 0 : NIL);
+
+  stack->no_slots = no_slots;
+  stack->slots = malloc(no_slots * sizeof *stack->slots);
+  for (unsigned int i = 0; i < no_slots; i++) {
+    atomic_init(&stack->slots[i], slot_word(SLOT_EMPTY, 0));
+  }
+  return stack;
+}
+
+void
+free_lockfree_stack(struct lockfree_stack *stack)
+{
+  free(stack->slots);
+  free(stack->nodes);
+  free(stack);
+}
+
+// Push and pop nodes on a tagged list, either the stack or the free list.
+// Return whether the CAS succeeded.
+static bool
+try_push_node(struct lockfree_stack *stack, _Atomic uint64_t *list,
+              uint32_t node)
+{
+  uint64_t top = atomic_load_explicit(list, memory_order_relaxed);
+  atomic_store_explicit(&stack->nodes[node].next, tagged_index(top),
+                        memory_order_relaxed);
+  return atomic_compare_exchange_weak_explicit(
+      list, &top, tagged(node, top), memory_order_release,
+      memory_order_relaxed);
+}
+// Sets *node to NIL if the list is empty
+static bool
+try_pop_node(struct lockfree_stack *stack, _Atomic uint64_t *list,
+             uint32_t *node)
+{
+  uint64_t top = atomic_load_explicit(list, memory_order_acquire);
+  *node = tagged_index(top);
+  if (*node == NIL)
+    return true;
+  // The node may be popped and reused before we get to the CAS, and then
+  // next is garbage, but then the tag has changed and the CAS fails.
+  uint32_t next =
+      atomic_load_explicit(&stack->nodes[*node].next, memory_order_relaxed);
+  return atomic_compare_exchange_weak_explicit(
+      list, &top, tagged(next, top), memory_order_acquire,
+      memory_order_relaxed);
+}
+
+static uint32_t
+pool_get(struct lockfree_stack *stack)
+{
+  uint32_t node;
+  while (!try_pop_node(stack, &stack->free, &node))
+    ;
+  return node;
+}
+static void
+pool_put(struct lockfree_stack *stack, uint32_t node)
+{
+  while (!try_push_node(stack, &stack->free, node))
+    ;
+}
+
+// Each thread picks elimination slots with its own random sequence
+static _Thread_local uint32_t slot_seed;
+
+static _Atomic uint64_t *
+random_slot(struct lockfree_stack *stack)
+{
+  // xorshift32; the seed must not be zero
+  uint32_t x = slot_seed ? slot_seed : (uint32_t)(uintptr_t)&slot_seed | 1;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  slot_seed = x;
+  return &stack->slots[x % stack->no_slots];
+}
+
+// Offer a value in the elimination array and wait a little for a pop to
+// take it. Returns true if one did.
+static bool
+offer(struct lockfree_stack *stack, int value)
+{
+  if (stack->no_slots == 0)
+    return false;
+  _Atomic uint64_t *slot = random_slot(stack);
+  uint64_t word = slot_word(SLOT_EMPTY, 0);
+  uint64_t offered = slot_word(SLOT_OFFERED, value);
+  if (!atomic_compare_exchange_strong(slot, &word, offered))
+    return false; // Someone else is using the slot
+
+  for (int i = 0; i < ELIMINATION_SPINS; i++) {
+    if (slot_state(atomic_load_explicit(slot, memory_order_acquire)) ==
+        SLOT_TAKEN)
+      break;
+  }
+  // Withdraw the offer. If that fails, a pop took the value, and only we
+  // can reset the slot.
+  if (atomic_compare_exchange_strong(slot, &offered, slot_word(SLOT_EMPTY, 0)))
+    return false;
+  atomic_store_explicit(slot, slot_word(SLOT_EMPTY, 0), memory_order_release);
+  return true;
+}
+
+// Take a value someone offered, if there is one in the slot we look at
+static bool
+take(struct lockfree_stack *stack, int *value)
+{
+  if (stack->no_slots == 0)
+    return false;
+  _Atomic uint64_t *slot = random_slot(stack);
+  uint64_t word = atomic_load_explicit(slot, memory_order_acquire);
+  if (slot_state(word) != SLOT_OFFERED)
+    return false;
+  uint64_t taken = slot_word(SLOT_TAKEN, (int)(uint32_t)word);
+  if (!atomic_compare_exchange_strong(slot, &word, taken))
+    return false;
+  *value = (int)(uint32_t)word;
+  return true;
+}
+
+bool
+lockfree_push(struct lockfree_stack *stack, int value)
+{
+  uint32_t node = pool_get(stack);
+  if (node == NIL)
+    return false;
+  stack->nodes[node].value = value;
+  while (!try_push_node(stack, &stack->top, node)) {
+    if (offer(stack, value)) {
+      pool_put(stack, node);
+      return true;
+    }
+  }
+  return true;
+}
+
+bool
+lockfree_pop(struct lockfree_stack *stack, int *value)
+{
+  uint32_t node;
+  while (!try_pop_node(stack, &stack->top, &node)) {
+    if (take(stack, value))
+      return true;
+  }
+  if (node == NIL)
+    return false;
+  *value = stack->nodes[node].value;
+  pool_put(stack, node);
+  return true;
+}
@@ -0,0 +1,46 @@
+
+#ifndef LOCKFREE_STACK_H
+#define LOCKFREE_STACK_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// A lock-free stack (Treiber's) that any number of threads can push to
+// and pop from.
+//
+// Nodes come from a pool allocated up front, and we refer to them by index
+// rather than by pointer. The top of the stack and of the pool's free list
+// are an index and a tag in one 64-bit word, and every update bumps the
+// tag. A thread that read the top, and then lost the node to a pop and a
+// push of the same node, fails its CAS instead of corrupting the stack
+// (the ABA problem). As the pool memory is never freed, reading a node
+// that another thread has just popped is harmless.
+//
+// Under contention, a push and a pop that both fail their CAS can meet in
+// an elimination array and hand the value over directly, without touching
+// the top.
+struct lockfree_node;
+struct lockfree_stack {
+  _Atomic uint64_t top;  // Tagged index of the top node
+  _Atomic uint64_t free; // Tagged index of the pool's free list
+  struct lockfree_node *nodes;
+  _Atomic uint64_t *slots; // The elimination array
+  unsigned int no_slots;
+};
+
+// The stack holds at most capacity values. With no_slots == 0 there is no
+// elimination.
+struct lockfree_stack *
+new_lockfree_stack(unsigned int capacity, unsigned int no_slots);
+void
+free_lockfree_stack(struct lockfree_stack *stack);
+
+// Returns false if the stack is full
+bool
+lockfree_push(struct lockfree_stack *stack, int value);
+// Returns false if the stack is empty
+bool
+lockfree_pop(struct lockfree_stack *stack, int *value);
+
+#endif
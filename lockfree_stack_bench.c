@@ -0,0 +1,110 @@
+
+#include "lockfree_stack.h"
+#include "parallel.h"
+#include "stack.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define ELIMINATION_SLOTS 8
+
+// The stack from stack.c behind a mutex, for comparison
+struct locked_stack {
+  pthread_mutex_t lock;
+  struct stack *stack;
+};
+
+static void
+locked_push(struct locked_stack *stack, int value)
+{
+  pthread_mutex_lock(&stack->lock);
+  push(stack->stack, value);
+  pthread_mutex_unlock(&stack->lock);
+}
+
+static bool
+locked_pop(struct locked_stack *stack, int *value)
+{
+  pthread_mutex_lock(&stack->lock);
+  bool popped = !is_empty(stack->stack);
+  if (popped)
+    *value = pop(stack->stack);
+  pthread_mutex_unlock(&stack->lock);
+  return popped;
+}
+
+// Every thread does ops pushes, each followed by a pop, which is what a
+// shared free list sees.
+struct workload {
+  struct locked_stack *locked;
+  struct lockfree_stack *lockfree;
+  int ops;
+};
+
+static void
+run_locked(unsigned int thread, size_t begin, size_t end, void *data)
+{
+  struct workload *workload = data;
+  int value;
+  for (int i = 0; i < workload->ops; i++) {
+    locked_push(workload->locked, i);
+    locked_pop(workload->locked, &value);
+  }
+}
+
+static void
+run_lockfree(unsigned int thread, size_t begin, size_t end, void *data)
+{
+  struct workload *workload = data;
+  int value;
+  for (int i = 0; i < workload->ops; i++) {
+    lockfree_push(workload->lockfree, i);
+    lockfree_pop(workload->lockfree, &value);
+  }
+}
+
+static double
+wall_time(void (*run)(unsigned int, size_t, size_t, void *),
+          struct workload *workload, unsigned int threads)
+{
+  struct timespec begin, end;
+  clock_gettime(CLOCK_MONOTONIC, &begin);
+  parallel_for(threads, threads, run, workload);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  return (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9;
+}
+
+int
+main(int argc, const char *argv[])
+{
+  if (argc != 3) {
+    printf("Usage: %s ops_per_thread max_threads\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  int ops = atoi(argv[1]);
+  unsigned int max_threads = atoi(argv[2]);
+
+  printf("threads\tmutex\tlockfree\telimination\n");
+  for (unsigned int threads = 1; threads <= max_threads; threads *= 2) {
+    struct locked_stack locked = {.lock = PTHREAD_MUTEX_INITIALIZER,
+                                  .stack = new_stack()};
+    struct workload workload = {.locked = &locked, .ops = ops};
+    double mutex_time = wall_time(run_locked, &workload, threads);
+    free_stack(locked.stack);
+
+    workload.lockfree = new_lockfree_stack(threads, 0);
+    double lockfree_time = wall_time(run_lockfree, &workload, threads);
+    free_lockfree_stack(workload.lockfree);
+
+    workload.lockfree = new_lockfree_stack(threads, ELIMINATION_SLOTS);
+    double elimination_time = wall_time(run_lockfree, &workload, threads);
+    free_lockfree_stack(workload.lockfree);
+
+    printf("%u\t%g\t%g\t%g\n", threads, mutex_time, lockfree_time,
+           elimination_time);
+  }
+
+  return EXIT_SUCCESS;
+}
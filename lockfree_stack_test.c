@@ -0,0 +1,100 @@
+
+#include "lockfree_stack.h"
+#include "parallel.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static void
+test_sequential(unsigned int no_slots)
+{
+  struct lockfree_stack *stack = new_lockfree_stack(10, no_slots);
+  int value;
+  assert(!lockfree_pop(stack, &value));
+
+  // We count what push and pop return and assert on the counts, so the
+  // stack still changes when NDEBUG takes out the asserts
+  int pushed = 0;
+  for (int i = 0; i < 10; ++i) {
+    pushed += lockfree_push(stack, i);
+  }
+  pushed += lockfree_push(stack, 10); // Full
+  assert(pushed == 10);
+  int popped = 0;
+  for (int i = 9; i >= 0; --i) {
+    popped += lockfree_pop(stack, &value) && value == i;
+  }
+  assert(popped == 10);
+  assert(!lockfree_pop(stack, &value));
+
+  // The nodes went back to the pool, so we can fill it again
+  pushed = 0;
+  for (int i = 0; i < 10; ++i) {
+    pushed += lockfree_push(stack, -i);
+  }
+  assert(pushed == 10);
+  free_lockfree_stack(stack);
+}
+
+// Every thread pushes its own values, interleaved with pops. At the end,
+// everything pushed was popped exactly once.
+struct stress {
+  struct lockfree_stack *stack;
+  int n; // Values per thread
+  atomic_int pushed;
+  atomic_int *popped;
+};
+
+static void
+stress_thread(unsigned int thread, size_t begin, size_t end, void *data)
+{
+  struct stress *stress = data;
+  int value, pushed = 0;
+  for (int i = 0; i < stress->n; ++i) {
+    pushed += lockfree_push(stress->stack, (int)thread * stress->n + i);
+    if (i % 2 && lockfree_pop(stress->stack, &value))
+      atomic_fetch_add(&stress->popped[value], 1);
+  }
+  while (lockfree_pop(stress->stack, &value)) {
+    atomic_fetch_add(&stress->popped[value], 1);
+  }
+  atomic_fetch_add(&stress->pushed, pushed);
+}
+
+static void
+test_stress(int n, unsigned int no_threads, unsigned int no_slots)
+{
+  struct stress stress = {
+      .stack = new_lockfree_stack(n * no_threads, no_slots),
+      .n = n,
+      .pushed = 0,
+      .popped = calloc(n * no_threads, sizeof *stress.popped)};
+  parallel_for(no_threads, no_threads, stress_thread, &stress);
+
+  assert(atomic_load(&stress.pushed) == n * (int)no_threads);
+  int value;
+  assert(!lockfree_pop(stress.stack, &value));
+  for (int i = 0; i < n * (int)no_threads; ++i) {
+    assert(atomic_load(&stress.popped[i]) == 1);
+  }
+  free(stress.popped);
+  free_lockfree_stack(stress.stack);
+}
+
+int
+main(int argc, const char *argv[])
+{
+  if (argc != 2) {
+    printf("Usage: %s no_elements\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  int no_elms = atoi(argv[1]);
+
+  test_sequential(0);
+  test_sequential(4);
+  test_stress(no_elms, 8, 0);
+  test_stress(no_elms, 8, 4);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,124 @@
+
+#include "hash_table.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Tables get all their memory from their allocator, give it back with the
+// right sizes, and table_memory_usage agrees with what they hold.
+
+// An allocator that keeps account of the bytes it has handed out. It puts
+// each block's size in a header, so it can check the sizes we free with.
+struct tracker {
+  size_t live;   // Bytes allocated and not freed
+  size_t blocks; // Blocks allocated and not freed
+};
+
+union header {
+  size_t size;
+  max_align_t align;
+};
+
+static void *
+track_alloc(void *context, size_t size)
+{
+  struct tracker *tracker = context;
+  union header *header = malloc(sizeof *header + size);
+  header->size = size;
+  tracker->live += size;
+  tracker->blocks++;
+  return header + 1;
+}
+
+static void
+track_free(void *context, void *ptr, size_t size)
+{
+  struct tracker *tracker = context;
+  union header *header = (union header *)ptr - 1;
+  assert(header->size == size);
+  tracker->live -= size;
+  tracker->blocks--;
+  free(header);
+}
+
+static void *
+track_realloc(void *context, void *ptr, size_t old_size, size_t new_size)
+{
+  void *new_ptr = track_alloc(context, new_size);
+  memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+  track_free(context, ptr, old_size);
+  return new_ptr;
+}
+
+static unsigned int
+key(unsigned int i)
+{
+  return i * 2654435761U;
+}
+
+static void
+check_usage(struct hash_table *table, struct tracker *tracker)
+{
+  struct memory_usage usage = table_memory_usage(table);
+  assert(usage.total == usage.table + usage.bins + usage.nodes +
+                            usage.subtables);
+  assert(usage.total == tracker->live);
+}
+
+int
+main(int argc, const char *argv[])
+{
+  if (argc != 2) {
+    printf("Usage: %s no_elements\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  unsigned int no_elms = atoi(argv[1]);
+
+  struct tracker tracker = {.live = 0, .blocks = 0};
+  struct allocator allocator = {.alloc = track_alloc,
+                                .realloc = track_realloc,
+                                .free = track_free,
+                                .context = &tracker};
+
+  struct hash_table *table = new_table_with_allocator(0, &allocator);
+  check_usage(table, &tracker);
+  for (unsigned int i = 0; i < no_elms; i++) {
+    insert_key(table, key(i));
+  }
+  check_usage(table, &tracker);
+  size_t full = tracker.live;
+
+#ifdef COUNTING
+  // Counting can need memory of its own
+  for (unsigned int i = 0; i < no_elms; i += 2) {
+    increment_key(table, key(i), 1);
+  }
+  check_usage(table, &tracker);
+#endif
+
+  // Shrinking gives memory back
+  for (unsigned int i = 0; i < no_elms; i++) {
+    delete_key(table, key(i));
+    if (i % 1000 == 0)
+      check_usage(table, &tracker);
+  }
+  check_usage(table, &tracker);
+  assert(no_elms < 1000 || tracker.live < full);
+
+  delete_table(table);
+  assert(tracker.live == 0 && tracker.blocks == 0);
+
+  // Without an allocator we use malloc, and get the same accounting
+  table = new_table_with_capacity(no_elms);
+  for (unsigned int i = 0; i < no_elms; i++) {
+    insert_key(table, key(i));
+  }
+  struct memory_usage usage = table_memory_usage(table);
+  assert(usage.total >= no_elms * sizeof(unsigned int));
+  delete_table(table);
+
+  return EXIT_SUCCESS;
+}
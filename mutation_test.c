@@ -0,0 +1,65 @@
+
+#include "hash_table.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// try_insert and erase report what they did, and agree with contains_key.
+// We count what they return and assert on the counts, so the table still
+// changes when NDEBUG takes out the asserts.
+
+static unsigned int
+key(unsigned int i)
+{
+  return i * 2654435761U;
+}
+
+int
+main(int argc, const char *argv[])
+{
+  if (argc != 2) {
+    printf("Usage: %s no_elements\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  unsigned int no_elms = atoi(argv[1]);
+
+  struct hash_table *table = new_table();
+  unsigned int inserted = 0;
+  for (unsigned int i = 0; i < no_elms; i++) {
+    inserted += try_insert(table, key(i));
+    inserted += try_insert(table, key(i));
+  }
+  assert(inserted == no_elms);
+  assert(no_keys(table) == no_elms);
+
+  // Every third key goes, once
+  unsigned int erased = 0, thirds = 0;
+  for (unsigned int i = 0; i < no_elms; i += 3) {
+    erased += erase(table, key(i));
+    erased += erase(table, key(i));
+    thirds++;
+  }
+  erased += erase(table, key(no_elms));
+  assert(erased == thirds);
+
+  inserted = 0;
+  for (unsigned int i = 0; i < no_elms; i++) {
+    bool present = i % 3 != 0;
+    assert(contains_key(table, key(i)) == present);
+    inserted += try_insert(table, key(i)) == !present;
+  }
+  assert(inserted == no_elms);
+  assert(no_keys(table) == no_elms);
+
+  // Erasing everything shrinks the table on the way
+  erased = 0;
+  for (unsigned int i = 0; i < no_elms; i++) {
+    erased += erase(table, key(i));
+  }
+  assert(erased == no_elms);
+  assert(no_keys(table) == 0);
+
+  delete_table(table);
+  return EXIT_SUCCESS;
+}
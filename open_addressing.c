@@ -5,140 +5,572 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "parallel.h"
+#include "trace.h"
+
 #define MIN_SIZE 8
 
-unsigned int static p(unsigned int k, unsigned int i, unsigned int m)
+// Resizes to at least this many bins reinsert the keys with
+// RESIZE_THREADS threads (0 means one per CPU).
+#ifndef PARALLEL_RESIZE_THRESHOLD
+#define PARALLEL_RESIZE_THRESHOLD (1 << 20)
+#endif
+#ifndef RESIZE_THREADS
+#define RESIZE_THREADS 0
+#endif
+
+static inline size_t
+home(struct hash_table *table, size_t k)
+{
+  return k & (table->size - 1);
+}
+
+// For double hashing, the step comes from the high bits of the key, and
+// it is odd so it is coprime with the table size.
+static inline unsigned int
+step(unsigned int k)
 {
-  return (k + i) & (m - 1);
+  return (k * 0x9e3779b9U) >> 16 | 1;
 }
 
+// The i'th bin in the probe sequence for k
+static inline size_t
+p(struct hash_table *table, size_t k, size_t i)
+{
+  switch (table->probe) {
+  case TRIANGULAR_PROBING:
+    return (k + i * (i + 1) / 2) & (table->size - 1);
+  case DOUBLE_HASHING:
+    return (k + i * step((unsigned int)k)) & (table->size - 1);
+  case LINEAR_PROBING:
+  default:
+    return (k + i) & (table->size - 1);
+  }
+}
+
+static size_t
+add_key(struct hash_table *table, unsigned int key, unsigned int count,
+        bool *added);
+
+// Set up empty bins; all states are BIN_EMPTY.
 static void
-init_table(struct hash_table *table, unsigned int size, struct bin *begin,
-           struct bin *end)
+init_bins(struct hash_table *table, size_t size, bool counting)
+{
+  const struct allocator *allocator = table->allocator;
+  table->keys = allocate(allocator, size * sizeof *table->keys);
+  table->states =
+      allocate_zeroed(allocator, (size + 31) / 32 * sizeof *table->states);
+  table->counts =
+      counting ? allocate(allocator, size * sizeof *table->counts) : NULL;
+  table->size = size;
+}
+
+static void
+init_table(struct hash_table *table, size_t size, struct hash_table *old)
 {
   // Initialize table members
-  struct bin *bins = malloc(size * sizeof *bins);
-  *table =
-      (struct hash_table){.bins = bins, .size = size, .used = 0, .active = 0};
-
-  // Initialize bins
-  struct bin empty_bin = {.in_probe = false, .is_empty = true};
-  for (unsigned int i = 0; i < table->size; i++) {
-    table->bins[i] = empty_bin;
-  }
+  *table = (struct hash_table){.used = 0,
+                               .active = 0,
+                               .resizes = table->resizes,
+                               .probe = table->probe,
+                               .allocator = table->allocator};
+  init_bins(table, size, old && old->counts);
 
   // Copy the old bins to the new table
-  for (struct bin *bin = begin; bin != end; bin++) {
-    if (!bin->is_empty) {
-      insert_key(table, bin->key);
+  bool added;
+  for (size_t bin = 0; old && bin < old->size; bin++) {
+    if (bin_state(old, bin) == BIN_LIVE)
+      add_key(table, old->keys[bin], old->counts ? old->counts[bin] : 1,
+              &added);
+  }
+}
+
+// Large tables are resized in parallel. The new bins are split into
+// `no_parts` ranges, and we first sort the keys by the range their home bin
+// is in. Then each thread inserts the keys for its ranges without touching
+// the others. Probes that would run past the end of a range are finished
+// sequentially afterwards; they continue past a full stretch of bins,
+// exactly as sequential insertion would.
+struct migration {
+  struct hash_table *table;
+  struct hash_table old;
+  unsigned int no_parts; // A power of two, so ranges align with bins
+  size_t *offsets;       // Where each thread puts its keys for each part
+  size_t *parts;         // Start of each part's keys in `keys`
+  size_t *overflow;      // Number of keys that overflowed each part
+  unsigned int *keys;
+  unsigned int *counts; // The keys' counts, if the table counts
+};
+
+static inline unsigned int
+part_of(struct migration *migration, unsigned int key)
+{
+  return (unsigned int)(home(migration->table, key) /
+                        (migration->table->size / migration->no_parts));
+}
+
+static void
+count_keys(unsigned int thread, size_t begin, size_t end, void *data)
+{
+  struct migration *migration = data;
+  size_t *counts = migration->offsets + thread * migration->no_parts;
+  for (size_t bin = begin; bin < end; bin++) {
+    if (bin_state(&migration->old, bin) == BIN_LIVE)
+      counts[part_of(migration, migration->old.keys[bin])]++;
+  }
+}
+
+static void
+sort_keys(unsigned int thread, size_t begin, size_t end, void *data)
+{
+  struct migration *migration = data;
+  size_t *offsets = migration->offsets + thread * migration->no_parts;
+  for (size_t bin = begin; bin < end; bin++) {
+    if (bin_state(&migration->old, bin) != BIN_LIVE)
+      continue;
+    unsigned int key = migration->old.keys[bin];
+    size_t i = offsets[part_of(migration, key)]++;
+    migration->keys[i] = key;
+    if (migration->counts)
+      migration->counts[i] = migration->old.counts[bin];
+  }
+}
+
+static void
+insert_parts(unsigned int thread, size_t begin, size_t end, void *data)
+{
+  struct migration *migration = data;
+  struct hash_table *table = migration->table;
+  size_t part_size = table->size / migration->no_parts;
+
+  unsigned int *keys = migration->keys, *counts = migration->counts;
+
+  for (size_t part = begin; part < end; part++) {
+    size_t first = migration->parts[part], last = migration->parts[part + 1],
+           overflow = first;
+    size_t part_end = (part + 1) * part_size;
+
+    for (size_t i = first; i < last; i++) {
+      size_t bin = home(table, keys[i]);
+      while (bin < part_end && bin_state(table, bin) != BIN_EMPTY)
+        bin++;
+      if (bin < part_end) {
+        table->keys[bin] = keys[i];
+        set_bin_state(table, bin, BIN_LIVE);
+        if (counts)
+          table->counts[bin] = counts[i];
+      } else {
+        // Keep it for the sequential pass
+        keys[overflow] = keys[i];
+        if (counts)
+          counts[overflow] = counts[i];
+        overflow++;
+      }
     }
+    migration->overflow[part] = overflow - first;
   }
 }
 
 static void
-resize(struct hash_table *table, unsigned int new_size)
+parallel_resize(struct hash_table *table, size_t new_size)
 {
+  unsigned int no_threads = RESIZE_THREADS ? RESIZE_THREADS : no_cpus();
+  // Parts have at least 32 bins so threads don't share words of states
+  unsigned int no_parts = 1;
+  while (no_parts < 4 * no_threads && 32 * no_parts < new_size)
+    no_parts *= 2;
+
+  // The scratch arrays come from the table's allocator too
+  const struct allocator *allocator = table->allocator;
+  size_t offsets_size = no_threads * no_parts * sizeof(size_t);
+  size_t parts_size = (no_parts + 1) * sizeof(size_t);
+  size_t overflow_size = no_parts * sizeof(size_t);
+  size_t keys_size = table->active * sizeof(unsigned int);
+  struct migration migration = {
+      .table = table,
+      .old = *table,
+      .no_parts = no_parts,
+      .offsets = allocate_zeroed(allocator, offsets_size),
+      .parts = allocate(allocator, parts_size),
+      .overflow = allocate(allocator, overflow_size),
+      .keys = allocate(allocator, keys_size),
+      .counts = table->counts ? allocate(allocator, keys_size) : NULL};
+
+  table->used = table->active;
+  init_bins(table, new_size, table->counts != NULL);
+
+  // Count the keys each thread has for each part, and turn the counts into
+  // offsets so part 0's keys come first, then part 1's, and so on.
+  parallel_for(no_threads, migration.old.size, count_keys, &migration);
+  size_t offset = 0;
+  for (unsigned int part = 0; part < no_parts; part++) {
+    migration.parts[part] = offset;
+    for (unsigned int thread = 0; thread < no_threads; thread++) {
+      size_t count = migration.offsets[thread * no_parts + part];
+      migration.offsets[thread * no_parts + part] = offset;
+      offset += count;
+    }
+  }
+  migration.parts[no_parts] = offset;
+
+  parallel_for(no_threads, migration.old.size, sort_keys, &migration);
+  parallel_for(no_threads, no_parts, insert_parts, &migration);
+
+  for (unsigned int part = 0; part < no_parts; part++) {
+    size_t first = migration.parts[part];
+    for (size_t i = first; i < first + migration.overflow[part]; i++) {
+      unsigned int key = migration.keys[i];
+      size_t bin = find_free_linear(table, home(table, key));
+      table->keys[bin] = key;
+      set_bin_state(table, bin, BIN_LIVE);
+      if (migration.counts)
+        table->counts[bin] = migration.counts[i];
+    }
+  }
+
+  deallocate(allocator, migration.counts, keys_size);
+  deallocate(allocator, migration.keys, keys_size);
+  deallocate(allocator, migration.overflow, overflow_size);
+  deallocate(allocator, migration.parts, parts_size);
+  deallocate(allocator, migration.offsets, offsets_size);
+  free_bins(&migration.old);
+}
+
+static void
+resize(struct hash_table *table, size_t new_size)
+{
+  table->resizes++;
+  // The parallel resize relies on linear probing
+  if (new_size >= PARALLEL_RESIZE_THRESHOLD &&
+      table->probe == LINEAR_PROBING) {
+    parallel_resize(table, new_size);
+    return;
+  }
+
   // remember the old bins until we have moved them.
-  struct bin *old_bins_begin = table->bins,
-             *old_bins_end = old_bins_begin + table->size;
+  struct hash_table old = *table;
 
   // Update table and copy the old active bins to it.
-  init_table(table, new_size, old_bins_begin, old_bins_end);
+  init_table(table, new_size, &old);
 
   // finally, free memory for old bins
-  free(old_bins_begin);
+  free_bins(&old);
 }
 
 struct hash_table *
-new_table()
+new_table_with_allocator(size_t keys, const struct allocator *allocator)
 {
-  struct hash_table *table = malloc(sizeof *table);
-  init_table(table, MIN_SIZE, NULL, NULL);
+  // We grow when more than half the bins are used
+  size_t size = MIN_SIZE;
+  while (keys > size / 2)
+    size *= 2;
+
+  struct hash_table *table = allocate(allocator, sizeof *table);
+  table->probe = LINEAR_PROBING;
+  table->resizes = 0;
+  table->allocator = allocator;
+  init_table(table, size, NULL);
+  TRACE(TRACE_NEW_TABLE, table, keys, false);
   return table;
 }
 
+struct hash_table *
+new_table_with_capacity(size_t keys)
+{
+  return new_table_with_allocator(keys, NULL);
+}
+
+struct hash_table *
+new_table()
+{
+  return new_table_with_capacity(0);
+}
+
 void
 delete_table(struct hash_table *table)
 {
-  free(table->bins);
-  free(table);
+  TRACE(TRACE_DELETE_TABLE, table, 0, false);
+  free_bins(table);
+  deallocate(table->allocator, table, sizeof *table);
 }
 
-// Find the bin containing key, or the first bin past the end of its probe
-struct bin *
-find_key(struct hash_table *table, unsigned int key)
+// The bin containing key, with *found set, or else the first bin without a
+// key in its probe sequence, which is where we would add it.
+static size_t
+find_slot(struct hash_table *table, unsigned int key, bool *found)
 {
-  for (unsigned int i = 0; i < table->size; i++) {
-    struct bin *bin = table->bins + p(key, i, table->size);
-    if (bin->key == key || !bin->in_probe)
+  if (table->probe == LINEAR_PROBING)
+    return find_slot_linear(table, home(table, key), key, found);
+
+  size_t free = table->size;
+  *found = false;
+  for (size_t i = 0; i < table->size; i++) {
+    size_t bin = p(table, key, i);
+    enum bin_state state = bin_state(table, bin);
+    if (state == BIN_LIVE && table->keys[bin] == key) {
+      *found = true;
       return bin;
+    }
+    if (state != BIN_LIVE && free == table->size)
+      free = bin;
+    if (state == BIN_EMPTY)
+      break;
   }
-  // The table is full. This should not happen!
-  assert(false);
+  return free;
 }
 
-// Find the first empty bin in its probe.
-struct bin *
-find_empty(struct hash_table *table, unsigned int key)
+// The bin containing key, or table->size if it isn't in the table
+static size_t
+find_key(struct hash_table *table, unsigned int key)
 {
-  for (unsigned int i = 0; i < table->size; i++) {
-    struct bin *bin = table->bins + p(key, i, table->size);
-    if (bin->is_empty)
-      return bin;
-  }
+  if (table->probe == LINEAR_PROBING)
+    return find_key_linear(table, home(table, key), key);
+
+  bool found;
+  size_t bin = find_slot(table, key, &found);
+  return found ? bin : table->size;
+}
+
+// The API functions are traced, so internally we use these instead.
+static bool
+has_key(struct hash_table *table, unsigned int key)
+{
+  return find_key(table, key) != table->size;
+}
+
+// Add key with the given count, if it isn't in the table already, and
+// set *added if we did. Returns the bin holding key.
+static size_t
+add_key(struct hash_table *table, unsigned int key, unsigned int count,
+        bool *added)
+{
+  bool found;
+  size_t bin = find_slot(table, key, &found);
+  *added = !found;
+  if (found)
+    return bin;
+
   // The table is full. This should not happen!
-  assert(false);
+  assert(bin != table->size);
+  put_key(table, bin, key, count);
+
+  if (table->used > table->size / 2) {
+    resize(table, table->size * 2);
+    bin = find_key(table, key); // The key moved
+  }
+  return bin;
+}
+
+bool
+try_insert(struct hash_table *table, unsigned int key)
+{
+  TRACE(TRACE_INSERT, table, key, false);
+  bool added;
+  add_key(table, key, 1, &added);
+  return added;
 }
 
 void
 insert_key(struct hash_table *table, unsigned int key)
 {
-  if (!contains_key(table, key)) {
-    struct bin *key_bin = find_empty(table, key);
-
-    table->active++;
-    if (!key_bin->in_probe)
-      table->used++; // We are using a new bin
+  try_insert(table, key);
+}
 
-    *key_bin = (struct bin){.in_probe = true, .is_empty = false, .key = key};
+unsigned int *
+find_or_insert(struct hash_table *table, unsigned int key, bool *inserted)
+{
+  TRACE(TRACE_INSERT, table, key, false);
+  if (!table->counts)
+    start_counting(table);
+  // Adding can resize the table, so only then look at the counts
+  size_t bin = add_key(table, key, 0, inserted);
+  return table->counts + bin;
+}
 
-    if (table->used > table->size / 2)
-      resize(table, table->size * 2);
-  }
+unsigned int
+key_count(struct hash_table *table, unsigned int key)
+{
+  size_t bin = find_key(table, key);
+  if (bin == table->size)
+    return 0;
+  return table->counts ? table->counts[bin] : 1;
 }
 
 bool
 contains_key(struct hash_table *table, unsigned int key)
 {
-  struct bin *bin = find_key(table, key);
-  return bin->key == key && !bin->is_empty;
+  bool found = has_key(table, key);
+  TRACE(TRACE_CONTAINS, table, key, found);
+  return found;
 }
 
-void
-delete_key(struct hash_table *table, unsigned int key)
+bool
+erase(struct hash_table *table, unsigned int key)
 {
-  struct bin *bin = find_key(table, key);
-  if (bin->key != key)
-    return; // Nothing more to do
+  TRACE(TRACE_DELETE, table, key, false);
+  size_t bin = find_key(table, key);
+  if (bin == table->size)
+    return false; // Nothing more to do
 
-  bin->is_empty = true; // Delete the bin
-  table->active--;      // Same bins in use but one less active
+  // Delete the key. The bin stays in use, but one less is active.
+  set_bin_state(table, bin, BIN_DELETED);
+  table->active--;
 
   if (table->active < table->size / 8 && table->size > MIN_SIZE)
     resize(table, table->size / 2);
+  return true;
+}
+
+void
+delete_key(struct hash_table *table, unsigned int key)
+{
+  erase(table, key);
+}
+
+bool
+set_probe(struct hash_table *table, enum probe probe)
+{
+  table->probe = probe;
+  resize(table, table->size);
+  return true;
+}
+
+struct probe_stats
+probe_stats(struct hash_table *table)
+{
+  struct probe_stats stats = {.mean = 0, .max = 0};
+  unsigned long long total = 0;
+  for (size_t bin = 0; bin < table->size; bin++) {
+    if (bin_state(table, bin) != BIN_LIVE)
+      continue;
+    unsigned int length = 1;
+    while (p(table, table->keys[bin], length - 1) != bin)
+      length++;
+    total += length;
+    if (length > stats.max)
+      stats.max = length;
+  }
+  if (table->active)
+    stats.mean = total / (double)table->active;
+  return stats;
+}
+
+struct memory_usage
+table_memory_usage(struct hash_table *table)
+{
+  struct memory_usage usage = {.table = sizeof *table,
+                               .bins = bins_memory(table)};
+  usage.total = usage.table + usage.bins;
+  return usage;
+}
+
+size_t
+no_keys(struct hash_table *table)
+{
+  return table->active;
+}
+
+void
+for_each_key(struct hash_table *table, void (*f)(unsigned int key, void *data),
+             void *data)
+{
+  for_each_key_in_bins(table, 0, table->size, f, data);
+}
+
+void
+for_each_key_count(struct hash_table *table,
+                   void (*f)(unsigned int key, unsigned int count, void *data),
+                   void *data)
+{
+  for (size_t bin = 0; bin < table->size; bin++) {
+    if (bin_state(table, bin) == BIN_LIVE)
+      f(table->keys[bin], table->counts ? table->counts[bin] : 1, data);
+  }
+}
+
+size_t
+no_bins(struct hash_table *table)
+{
+  return table->size;
+}
+
+void
+for_each_key_in_bins(struct hash_table *table, size_t begin, size_t end,
+                     void (*f)(unsigned int key, void *data), void *data)
+{
+  for (size_t bin = begin; bin < end; bin++) {
+    if (bin_state(table, bin) == BIN_LIVE)
+      f(table->keys[bin], data);
+  }
+}
+
+// We scan keys by their home bin, in reverse-binary order. With linear and
+// triangular probing, the keys with home bin `bin` are in the probe
+// sequence that starts there. With double hashing, keys with the same home
+// have different sequences, so we scan the bins in memory order instead
+// and start over after a resize.
+static size_t
+next_scan_bin(void *table, size_t bin)
+{
+  return next_reverse_binary(bin, ((struct hash_table *)table)->size - 1);
+}
+
+static void
+visit_scan_bin(void *table, size_t bin,
+               void (*f)(unsigned int key, void *data), void *data)
+{
+  struct hash_table *t = table;
+  size_t start = home(t, bin);
+  for (size_t i = 0; i < t->size; i++) {
+    size_t b = p(t, start, i);
+    enum bin_state state = bin_state(t, b);
+    if (state == BIN_EMPTY)
+      break;
+    if (state == BIN_LIVE && home(t, t->keys[b]) == start)
+      f(t->keys[b], data);
+  }
+}
+
+static size_t
+next_memory_bin(void *table, size_t bin)
+{
+  return (bin + 1 < ((struct hash_table *)table)->size) ? bin + 1 : 0;
+}
+
+static void
+visit_memory_bin(void *table, size_t bin,
+                 void (*f)(unsigned int key, void *data), void *data)
+{
+  struct hash_table *t = table;
+  if (bin_state(t, bin) == BIN_LIVE)
+    f(t->keys[bin], data);
+}
+
+unsigned int
+next_n(struct hash_table *table, struct cursor *cursor, unsigned int *keys,
+       unsigned int n)
+{
+  bool by_home = table->probe != DOUBLE_HASHING;
+  struct scan_bins bins = {
+      .table = table,
+      .stamp = table->resizes,
+      .restart_on_resize = !by_home,
+      .next = by_home ? next_scan_bin : next_memory_bin,
+      .visit = by_home ? visit_scan_bin : visit_memory_bin};
+  return scan_next_n(cursor, &bins, keys, n);
 }
 
 void
 print_table(struct hash_table *table)
 {
-  for (unsigned int i = 0; i < table->size; i++) {
+  for (size_t i = 0; i < table->size; i++) {
     if (i > 0 && i % 8 == 0) {
       printf("\n");
     }
-    struct bin *bin = table->bins + i;
-    if (bin->in_probe && !bin->is_empty) {
-      printf("[%u]", bin->key);
-    } else if (bin->in_probe && bin->is_empty) {
+    enum bin_state state = bin_state(table, i);
+    if (state == BIN_LIVE) {
+      printf("[%u]", table->keys[i]);
+    } else if (state == BIN_DELETED) {
       printf("[*]");
     } else {
       printf("[ ]");
@@ -3,25 +3,45 @@
 #define OPEN_ADDRESSING_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
 
-struct bin {
-  int in_probe : 1; // The bin is part of a sequence of used bins
-  int is_empty : 1; // The bin does not contain a value (but might still be in
-                    // a probe sequence)
-  unsigned int key;
-};
+#include "allocator.h"
+#include "counting.h"
+#include "cursor.h"
+
+// Probe sequences. Each visits every bin of the table, so insertion always
+// finds an empty bin. Triangular probing, k + i(i + 1)/2, only does that
+// for power-of-two sizes, so the prime table doesn't have it.
+enum probe { LINEAR_PROBING, TRIANGULAR_PROBING, DOUBLE_HASHING };
+
+// The keys and the bins' states are in separate arrays. A state takes two
+// bits, so a word of the state bitmap covers 32 bins. A bin joins a probe
+// sequence when it first gets a key and stays in it when the key is
+// deleted, so only empty bins end a lookup. Counting tables have a third
+// array with the keys' counts, which we only allocate when the table is
+// first used for counting; until then every key counts 1.
+enum bin_state { BIN_EMPTY = 0, BIN_DELETED = 1, BIN_LIVE = 3 };
 
 struct hash_table {
-  struct bin *bins;
-  unsigned int size;
-  unsigned int used;
-  unsigned int active;
-  // only used in primes code, but we share the header, so...
-  unsigned int primes_idx;
+  unsigned int *keys;
+  uint64_t *states;     // 2 bits per bin
+  unsigned int *counts; // NULL if we don't count
+  size_t size;
+  size_t used;
+  size_t active;
+  size_t resizes; // Bumped whenever the keys are put in new bins
+  enum probe probe;
+  const struct allocator *allocator;
 };
 
 struct hash_table *
 new_table(void);
+struct hash_table *
+new_table_with_capacity(size_t keys);
+struct hash_table *
+new_table_with_allocator(size_t keys, const struct allocator *allocator);
 void
 delete_table(struct hash_table *table);
 
@@ -32,8 +52,207 @@ contains_key(struct hash_table *table, unsigned int key);
 void
 delete_key(struct hash_table *table, unsigned int key);
 
+// insert_key and delete_key, telling us what they did: try_insert returns
+// false if the key was already there, and erase whether it was there.
+bool
+try_insert(struct hash_table *table, unsigned int key);
+bool
+erase(struct hash_table *table, unsigned int key);
+
+// Switch the table to a different probe sequence; new tables use linear
+// probing. This moves all the keys. Returns false if the table doesn't
+// support the probe.
+bool
+set_probe(struct hash_table *table, enum probe probe);
+
+// How many bins we look at to find the keys in the table
+struct probe_stats {
+  double mean;
+  unsigned int max;
+};
+struct probe_stats
+probe_stats(struct hash_table *table);
+
+// The bytes the table holds
+struct memory_usage
+table_memory_usage(struct hash_table *table);
+
+// Number of keys in the table
+size_t
+no_keys(struct hash_table *table);
+// Call f(key, data) for every key in the table
+void
+for_each_key(struct hash_table *table, void (*f)(unsigned int key, void *data),
+             void *data);
+// Bins and the keys in bins [begin, end)
+size_t
+no_bins(struct hash_table *table);
+void
+for_each_key_in_bins(struct hash_table *table, size_t begin, size_t end,
+                     void (*f)(unsigned int key, void *data), void *data);
+
 // For debugging
 void
 print_table(struct hash_table *table);
 
+// The rest is shared by the open addressing backends.
+
+static inline enum bin_state
+bin_state(struct hash_table *table, size_t bin)
+{
+  return (enum bin_state)((table->states[bin / 32] >> (2 * (bin % 32))) & 3);
+}
+static inline void
+set_bin_state(struct hash_table *table, size_t bin, enum bin_state state)
+{
+  uint64_t *word = table->states + bin / 32;
+  unsigned int shift = 2 * (bin % 32);
+  *word = (*word & ~((uint64_t)3 << shift)) | (uint64_t)state << shift;
+}
+
+// Bit 2j of the result is set if bin j of `word` has the given state
+static inline uint64_t
+state_mask(uint64_t word, enum bin_state state)
+{
+  uint64_t same = ~(word ^ (state * 0x5555555555555555u));
+  return same & (same >> 1) & 0x5555555555555555u;
+}
+
+// The states of the bins from `bin` to the end of its word, or of the
+// table, and the number n of those bins. The states of the bins past them
+// read as empty, so mask them out with valid_bins(n).
+static inline uint64_t
+states_from(struct hash_table *table, size_t bin, size_t *n)
+{
+  *n = 32 - bin % 32;
+  if (*n > table->size - bin)
+    *n = table->size - bin;
+  return table->states[bin / 32] >> (2 * (bin % 32));
+}
+static inline uint64_t
+valid_bins(size_t n)
+{
+  return 0x5555555555555555u >> (64 - 2 * n);
+}
+
+// Linear probing from `bin`, a word of states at a time. The bin holding
+// key, with *found set, or if we reach an empty bin first, the first bin
+// on the way that has no key. That is where we would add the key, so
+// adding takes one probe. Returns table->size if the table is full.
+static inline size_t
+find_slot_linear(struct hash_table *table, size_t bin, unsigned int key,
+                 bool *found)
+{
+  size_t free = table->size;
+  *found = false;
+  for (size_t seen = 0; seen < table->size;) {
+    size_t n;
+    uint64_t word = states_from(table, bin, &n);
+    uint64_t empty = state_mask(word, BIN_EMPTY) & valid_bins(n);
+    uint64_t live = state_mask(word, BIN_LIVE);
+    uint64_t open = ~live & valid_bins(n);
+    if (empty)
+      live &= (empty & -empty) - 1; // Only the bins before the empty one
+    for (; live; live &= live - 1) {
+      size_t i = bin + __builtin_ctzll(live) / 2;
+      if (table->keys[i] == key) {
+        *found = true;
+        return i;
+      }
+    }
+    if (free == table->size && open)
+      free = bin + __builtin_ctzll(open) / 2;
+    if (empty)
+      break;
+    seen += n;
+    bin = (bin + n == table->size) ? 0 : bin + n;
+  }
+  return free;
+}
+
+// The same for lookups, which don't need the free bin
+static inline size_t
+find_key_linear(struct hash_table *table, size_t bin, unsigned int key)
+{
+  for (size_t seen = 0; seen < table->size;) {
+    size_t n;
+    uint64_t word = states_from(table, bin, &n);
+    uint64_t empty = state_mask(word, BIN_EMPTY) & valid_bins(n);
+    uint64_t live = state_mask(word, BIN_LIVE);
+    if (empty)
+      live &= (empty & -empty) - 1;
+    for (; live; live &= live - 1) {
+      size_t i = bin + __builtin_ctzll(live) / 2;
+      if (table->keys[i] == key)
+        return i;
+    }
+    if (empty)
+      return table->size;
+    seen += n;
+    bin = (bin + n == table->size) ? 0 : bin + n;
+  }
+  return table->size;
+}
+
+// Add key to bin, which is free, with the given count
+static inline void
+put_key(struct hash_table *table, size_t bin, unsigned int key,
+        unsigned int count)
+{
+  table->active++;
+  if (bin_state(table, bin) == BIN_EMPTY)
+    table->used++; // We are using a new bin
+  table->keys[bin] = key;
+  set_bin_state(table, bin, BIN_LIVE);
+  if (table->counts)
+    table->counts[bin] = count;
+}
+
+// Allocate counts for a table used as a set so far
+static inline void
+start_counting(struct hash_table *table)
+{
+  table->counts =
+      allocate(table->allocator, table->size * sizeof *table->counts);
+  for (size_t bin = 0; bin < table->size; bin++) {
+    table->counts[bin] = 1;
+  }
+}
+
+// Bytes in the keys, states and counts arrays
+static inline size_t
+bins_memory(struct hash_table *table)
+{
+  size_t words = (table->size + 31) / 32;
+  return table->size * sizeof *table->keys + words * sizeof *table->states +
+         (table->counts ? table->size * sizeof *table->counts : 0);
+}
+
+static inline void
+free_bins(struct hash_table *table)
+{
+  size_t words = (table->size + 31) / 32;
+  deallocate(table->allocator, table->counts,
+             table->size * sizeof *table->counts);
+  deallocate(table->allocator, table->states, words * sizeof *table->states);
+  deallocate(table->allocator, table->keys, table->size * sizeof *table->keys);
+}
+
+// The first bin at or after `bin` without a key, or table->size if the
+// table is full.
+static inline size_t
+find_free_linear(struct hash_table *table, size_t bin)
+{
+  for (size_t seen = 0; seen < table->size;) {
+    size_t n;
+    uint64_t word = states_from(table, bin, &n);
+    uint64_t open = ~state_mask(word, BIN_LIVE) & valid_bins(n);
+    if (open)
+      return bin + __builtin_ctzll(open) / 2;
+    seen += n;
+    bin = (bin + n == table->size) ? 0 : bin + n;
+  }
+  return table->size;
+}
+
 #endif
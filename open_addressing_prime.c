@@ -1,161 +1,448 @@
 
 #include <assert.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 #include "open_addressing.h"
+#include "trace.h"
 
 #define UPPER_LOAD_LIMIT 0.5
 #define LOWER_LOAD_LIMIT 0.251
 
-// Primes for 1.66 growth
-int primes[] = {11,     19,      37,      67,      113,     191,     331,
-                557,    929,     1543,    2579,    4283,    7121,    11821,
-                19661,  32647,   54217,   90001,   149411,  248033,  411737,
-                683489, 1134607, 1883459, 3126547, 5190071, 8615527, 14301779};
+#define MIN_SIZE 11
 
-static size_t no_primes = (sizeof primes) / sizeof(*primes);
+// Tables grow by this factor, and shrink by it, to the nearest prime above
+#ifndef GROWTH_FACTOR
+#define GROWTH_FACTOR 1.66
+#endif
 
-static unsigned int
-p(unsigned int k, unsigned int i, unsigned int m)
+static inline uint64_t
+mul_mod(uint64_t a, uint64_t b, uint64_t m)
 {
+  return (unsigned __int128)a * b % m;
+}
+
+static uint64_t
+pow_mod(uint64_t a, uint64_t e, uint64_t m)
+{
+  uint64_t r = 1;
+  for (a %= m; e; e >>= 1) {
+    if (e & 1)
+      r = mul_mod(r, a, m);
+    a = mul_mod(a, a, m);
+  }
+  return r;
+}
+
+// Miller-Rabin with the first twelve primes as witnesses, which is exact
+// for all 64-bit n. The same primes as trial divisors weed out most
+// candidates before we get to the expensive part.
+static bool
+is_prime(uint64_t n)
+{
+  static const uint64_t witnesses[] = {2,  3,  5,  7,  11, 13,
+                                       17, 19, 23, 29, 31, 37};
+  for (size_t i = 0; i < sizeof witnesses / sizeof *witnesses; i++) {
+    if (n % witnesses[i] == 0)
+      return n == witnesses[i];
+  }
+  if (n < 2)
+    return false;
+
+  // n - 1 = d * 2^s with d odd
+  uint64_t d = n - 1;
+  unsigned int s = 0;
+  for (; d % 2 == 0; d /= 2)
+    s++;
+
+  for (size_t i = 0; i < sizeof witnesses / sizeof *witnesses; i++) {
+    uint64_t x = pow_mod(witnesses[i], d, n);
+    if (x == 1 || x == n - 1)
+      continue;
+    unsigned int r = 1;
+    for (; r < s; r++) {
+      x = mul_mod(x, x, n);
+      if (x == n - 1)
+        break;
+    }
+    if (r == s)
+      return false;
+  }
+  return true;
+}
+
+// The smallest prime >= n. Primes near n are about ln n apart, so this
+// only tests a few dozen candidates.
+static size_t
+next_prime(size_t n)
+{
+  if (n <= 2)
+    return 2;
+  n |= 1;
+  while (!is_prime(n))
+    n += 2;
+  return n;
+}
+
+static size_t
+grow_size(size_t size)
+{
+  return next_prime((size_t)(size * GROWTH_FACTOR));
+}
+static size_t
+shrink_size(size_t size)
+{
+  size_t new_size = next_prime((size_t)(size / GROWTH_FACTOR));
+  return new_size > MIN_SIZE ? new_size : MIN_SIZE;
+}
+
+// The i'th bin in the probe sequence for k. For double hashing the step is
+// between 1 and m - 1, so with m prime it is coprime with m.
+static size_t
+p(struct hash_table *table, unsigned int k, size_t i)
+{
+  size_t m = table->size;
+  if (table->probe == DOUBLE_HASHING)
+    return (k % m + mul_mod(i, 1 + k % (m - 1), m)) % m;
   return (k + i) % m;
 }
 
+static size_t
+add_key(struct hash_table *table, unsigned int key, unsigned int count,
+        bool *added);
+
 static void
-init_table(struct hash_table *table, unsigned int prime_idx, struct bin *begin,
-           struct bin *end)
-{
-  unsigned int size = primes[prime_idx];
-
-  // Initialize table members
-  struct bin *bins = malloc(size * sizeof *bins);
-  *table = (struct hash_table){.bins = bins,
-                               .size = size,
-                               .used = 0,
-                               .active = 0,
-                               .primes_idx = prime_idx};
-
-  // Initialize bins
-  struct bin empty_bin = {.in_probe = false, .is_empty = true};
-  for (unsigned int i = 0; i < table->size; i++) {
-    table->bins[i] = empty_bin;
-  }
+init_table(struct hash_table *table, size_t size, struct hash_table *old)
+{
+  // Initialize table members, with all bins empty
+  const struct allocator *allocator = table->allocator;
+  *table = (struct hash_table){
+      .keys = allocate(allocator, size * sizeof *table->keys),
+      .states =
+          allocate_zeroed(allocator, (size + 31) / 32 * sizeof *table->states),
+      .counts = (old && old->counts)
+                    ? allocate(allocator, size * sizeof *table->counts)
+                    : NULL,
+      .size = size,
+      .used = 0,
+      .active = 0,
+      .resizes = table->resizes,
+      .probe = table->probe,
+      .allocator = allocator};
 
   // Copy the old bins to the new table
-  for (struct bin *bin = begin; bin != end; bin++) {
-    if (!bin->is_empty) {
-      insert_key(table, bin->key);
-    }
+  bool added;
+  for (size_t bin = 0; old && bin < old->size; bin++) {
+    if (bin_state(old, bin) == BIN_LIVE)
+      add_key(table, old->keys[bin], old->counts ? old->counts[bin] : 1,
+              &added);
   }
 }
 
 struct hash_table *
-new_table()
+new_table_with_allocator(size_t keys, const struct allocator *allocator)
 {
-  struct hash_table *table = malloc(sizeof *table);
-  init_table(table, 0, NULL, NULL);
+  // We grow when more than half the bins are used
+  size_t size = MIN_SIZE;
+  while (keys > size / 2)
+    size = grow_size(size);
+
+  struct hash_table *table = allocate(allocator, sizeof *table);
+  table->probe = LINEAR_PROBING;
+  table->resizes = 0;
+  table->allocator = allocator;
+  init_table(table, size, NULL);
+  TRACE(TRACE_NEW_TABLE, table, keys, false);
   return table;
 }
 
+struct hash_table *
+new_table_with_capacity(size_t keys)
+{
+  return new_table_with_allocator(keys, NULL);
+}
+
+struct hash_table *
+new_table()
+{
+  return new_table_with_capacity(0);
+}
+
 static void
-resize(struct hash_table *table, unsigned int new_primes_idx)
+resize(struct hash_table *table, size_t new_size)
 {
+  table->resizes++;
   // remember the old bins until we have moved them.
-  struct bin *old_bins_begin = table->bins,
-             *old_bins_end = old_bins_begin + table->size;
+  struct hash_table old = *table;
 
   // Update table and copy the old active bins to it.
-  init_table(table, new_primes_idx, old_bins_begin, old_bins_end);
+  init_table(table, new_size, &old);
 
   // finally, free memory for old bins
-  free(old_bins_begin);
+  free_bins(&old);
 }
 void
 delete_table(struct hash_table *table)
 {
-  free(table->bins);
-  free(table);
+  TRACE(TRACE_DELETE_TABLE, table, 0, false);
+  free_bins(table);
+  deallocate(table->allocator, table, sizeof *table);
 }
 
-// Find the bin containing key, or the first bin past the end of its probe
-struct bin *
-find_key(struct hash_table *table, unsigned int key)
+// The bin containing key, with *found set, or else the first bin without a
+// key in its probe sequence, which is where we would add it.
+static size_t
+find_slot(struct hash_table *table, unsigned int key, bool *found)
 {
-  for (unsigned int i = 0; i < table->size; i++) {
-    struct bin *bin = table->bins + p(key, i, table->size);
-    if (bin->key == key || !bin->in_probe)
+  if (table->probe == LINEAR_PROBING)
+    return find_slot_linear(table, key % table->size, key, found);
+
+  size_t free = table->size;
+  *found = false;
+  for (size_t i = 0; i < table->size; i++) {
+    size_t bin = p(table, key, i);
+    enum bin_state state = bin_state(table, bin);
+    if (state == BIN_LIVE && table->keys[bin] == key) {
+      *found = true;
       return bin;
+    }
+    if (state != BIN_LIVE && free == table->size)
+      free = bin;
+    if (state == BIN_EMPTY)
+      break;
   }
-  // The table is full. This should not happen!
-  assert(false);
+  return free;
 }
 
-// Find the first empty bin in its probe.
-struct bin *
-find_empty(struct hash_table *table, unsigned int key)
+// The bin containing key, or table->size if it isn't in the table
+static size_t
+find_key(struct hash_table *table, unsigned int key)
 {
-  for (unsigned int i = 0; i < table->size; i++) {
-    struct bin *bin = table->bins + p(key, i, table->size);
-    if (bin->is_empty)
-      return bin;
-  }
+  if (table->probe == LINEAR_PROBING)
+    return find_key_linear(table, key % table->size, key);
+
+  bool found;
+  size_t bin = find_slot(table, key, &found);
+  return found ? bin : table->size;
+}
+
+// The API functions are traced, so internally we use these instead.
+static bool
+has_key(struct hash_table *table, unsigned int key)
+{
+  return find_key(table, key) != table->size;
+}
+
+// Add key with the given count, if it isn't in the table already, and
+// set *added if we did. Returns the bin holding key.
+static size_t
+add_key(struct hash_table *table, unsigned int key, unsigned int count,
+        bool *added)
+{
+  bool found;
+  size_t bin = find_slot(table, key, &found);
+  *added = !found;
+  if (found)
+    return bin;
+
   // The table is full. This should not happen!
-  assert(false);
+  assert(bin != table->size);
+  put_key(table, bin, key, count);
+
+  if (table->used > table->size / 2) {
+    resize(table, grow_size(table->size));
+    bin = find_key(table, key); // The key moved
+  }
+  return bin;
+}
+
+bool
+try_insert(struct hash_table *table, unsigned int key)
+{
+  TRACE(TRACE_INSERT, table, key, false);
+  bool added;
+  add_key(table, key, 1, &added);
+  return added;
 }
 
 void
 insert_key(struct hash_table *table, unsigned int key)
 {
-  if (!contains_key(table, key)) {
-    struct bin *key_bin = find_empty(table, key);
-
-    table->active++;
-    if (!key_bin->in_probe)
-      table->used++; // We are using a new bin
+  try_insert(table, key);
+}
 
-    *key_bin = (struct bin){.in_probe = true, .is_empty = false, .key = key};
+unsigned int *
+find_or_insert(struct hash_table *table, unsigned int key, bool *inserted)
+{
+  TRACE(TRACE_INSERT, table, key, false);
+  if (!table->counts)
+    start_counting(table);
+  // Adding can resize the table, so only then look at the counts
+  size_t bin = add_key(table, key, 0, inserted);
+  return table->counts + bin;
+}
 
-    if (table->used > table->size / 2) {
-      assert(table->primes_idx + 1 < no_primes);
-      resize(table, table->primes_idx + 1);
-    }
-  }
+unsigned int
+key_count(struct hash_table *table, unsigned int key)
+{
+  size_t bin = find_key(table, key);
+  if (bin == table->size)
+    return 0;
+  return table->counts ? table->counts[bin] : 1;
 }
 
 bool
 contains_key(struct hash_table *table, unsigned int key)
 {
-  struct bin *bin = find_key(table, key);
-  return bin->key == key && !bin->is_empty;
+  bool found = has_key(table, key);
+  TRACE(TRACE_CONTAINS, table, key, found);
+  return found;
+}
+
+bool
+erase(struct hash_table *table, unsigned int key)
+{
+  TRACE(TRACE_DELETE, table, key, false);
+  size_t bin = find_key(table, key);
+  if (bin == table->size)
+    return false; // Nothing more to do
+
+  // Delete the key. The bin stays in use, but one less is active.
+  set_bin_state(table, bin, BIN_DELETED);
+  table->active--;
+
+  if (table->active < table->size / 8 && table->size > MIN_SIZE)
+    resize(table, shrink_size(table->size));
+  return true;
 }
 
 void
 delete_key(struct hash_table *table, unsigned int key)
 {
-  struct bin *bin = find_key(table, key);
-  if (bin->key != key)
-    return; // Nothing more to do
+  erase(table, key);
+}
 
-  bin->is_empty = true; // Delete the bin
-  table->active--;      // Same bins in use but one less active
+bool
+set_probe(struct hash_table *table, enum probe probe)
+{
+  if (probe == TRIANGULAR_PROBING)
+    return false;
+  table->probe = probe;
+  resize(table, table->size);
+  return true;
+}
 
-  if (table->active < table->size / 8 && table->primes_idx > 0) {
-    resize(table, table->primes_idx - 1);
+struct probe_stats
+probe_stats(struct hash_table *table)
+{
+  struct probe_stats stats = {.mean = 0, .max = 0};
+  unsigned long long total = 0;
+  for (size_t bin = 0; bin < table->size; bin++) {
+    if (bin_state(table, bin) != BIN_LIVE)
+      continue;
+    unsigned int length = 1;
+    while (p(table, table->keys[bin], length - 1) != bin)
+      length++;
+    total += length;
+    if (length > stats.max)
+      stats.max = length;
   }
+  if (table->active)
+    stats.mean = total / (double)table->active;
+  return stats;
+}
+
+struct memory_usage
+table_memory_usage(struct hash_table *table)
+{
+  struct memory_usage usage = {.table = sizeof *table,
+                               .bins = bins_memory(table)};
+  usage.total = usage.table + usage.bins;
+  return usage;
+}
+
+size_t
+no_keys(struct hash_table *table)
+{
+  return table->active;
+}
+
+void
+for_each_key(struct hash_table *table, void (*f)(unsigned int key, void *data),
+             void *data)
+{
+  for_each_key_in_bins(table, 0, table->size, f, data);
+}
+
+void
+for_each_key_count(struct hash_table *table,
+                   void (*f)(unsigned int key, unsigned int count, void *data),
+                   void *data)
+{
+  for (size_t bin = 0; bin < table->size; bin++) {
+    if (bin_state(table, bin) == BIN_LIVE)
+      f(table->keys[bin], table->counts ? table->counts[bin] : 1, data);
+  }
+}
+
+size_t
+no_bins(struct hash_table *table)
+{
+  return table->size;
+}
+
+void
+for_each_key_in_bins(struct hash_table *table, size_t begin, size_t end,
+                     void (*f)(unsigned int key, void *data), void *data)
+{
+  for (size_t bin = begin; bin < end; bin++) {
+    if (bin_state(table, bin) == BIN_LIVE)
+      f(table->keys[bin], data);
+  }
+}
+
+// With prime sizes, a resize moves keys to unrelated bins, so we scan
+// the bins in memory order and start over after a resize, including the
+// one set_probe does.
+static size_t
+next_scan_bin(void *table, size_t bin)
+{
+  return (bin + 1 < ((struct hash_table *)table)->size) ? bin + 1 : 0;
+}
+
+static void
+visit_scan_bin(void *table, size_t bin,
+               void (*f)(unsigned int key, void *data), void *data)
+{
+  struct hash_table *t = table;
+  if (bin_state(t, bin) == BIN_LIVE)
+    f(t->keys[bin], data);
+}
+
+unsigned int
+next_n(struct hash_table *table, struct cursor *cursor, unsigned int *keys,
+       unsigned int n)
+{
+  struct scan_bins bins = {.table = table,
+                           .stamp = table->resizes,
+                           .restart_on_resize = true,
+                           .next = next_scan_bin,
+                           .visit = visit_scan_bin};
+  return scan_next_n(cursor, &bins, keys, n);
 }
 
 void
 print_table(struct hash_table *table)
 {
-  for (unsigned int i = 0; i < table->size; i++) {
+  for (size_t i = 0; i < table->size; i++) {
     if (i > 0 && i % 8 == 0) {
       printf("\n");
     }
-    struct bin *bin = table->bins + i;
-    if (bin->in_probe && !bin->is_empty) {
-      printf("[%u]", bin->key);
-    } else if (bin->in_probe && bin->is_empty) {
+    enum bin_state state = bin_state(table, i);
+    if (state == BIN_LIVE) {
+      printf("[%u]", table->keys[i]);
+    } else if (state == BIN_DELETED) {
       printf("[*]");
     } else {
       printf("[ ]");
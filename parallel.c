@@ -0,0 +1,66 @@
+
+#include "parallel.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define MAX_THREADS 256
+
+struct task {
+  void (*f)(unsigned int thread, size_t begin, size_t end, void *data);
+  void *data;
+  unsigned int thread;
+  size_t begin, end;
+};
+
+unsigned int
+no_cpus()
+{
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  return cpus > 0 ? (unsigned int)cpus : 1;
+}
+
+static void *
+run_task(void *arg)
+{
+  struct task *task = arg;
+  task->f(task->thread, task->begin, task->end, task->data);
+  return NULL;
+}
+
+void
+parallel_for(unsigned int no_threads, size_t n,
+             void (*f)(unsigned int thread, size_t begin, size_t end,
+                       void *data),
+             void *data)
+{
+  if (no_threads == 0)
+    no_threads = no_cpus();
+  if (no_threads > MAX_THREADS)
+    no_threads = MAX_THREADS;
+
+  struct task tasks[MAX_THREADS];
+  pthread_t threads[MAX_THREADS];
+  for (unsigned int t = 0; t < no_threads; t++) {
+    tasks[t] = (struct task){.f = f,
+                             .data = data,
+                             .thread = t,
+                             .begin = range_begin(t, no_threads, n),
+                             .end = range_begin(t + 1, no_threads, n)};
+  }
+
+  // If we cannot get a thread, the task runs on this one instead.
+  unsigned int started = 1;
+  for (; started < no_threads; started++) {
+    if (pthread_create(&threads[started], NULL, run_task, &tasks[started]))
+      break;
+  }
+  for (unsigned int t = started; t < no_threads; t++) {
+    run_task(&tasks[t]);
+  }
+  run_task(&tasks[0]);
+  for (unsigned int t = 1; t < started; t++) {
+    pthread_join(threads[t], NULL);
+  }
+}
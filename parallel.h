@@ -0,0 +1,30 @@
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stddef.h>
+
+// Number of online CPUs
+unsigned int
+no_cpus(void);
+
+// Split [0, n) into no_threads consecutive ranges and call
+// f(thread, begin, end, data) for each range on its own thread. The
+// calling thread takes range 0. With no_threads == 0 we use one thread per
+// CPU. The split only depends on n and no_threads, so two calls with the
+// same arguments see the same ranges.
+void
+parallel_for(unsigned int no_threads, size_t n,
+             void (*f)(unsigned int thread, size_t begin, size_t end,
+                       void *data),
+             void *data);
+
+// The range thread gets when [0, n) is split between no_threads
+// (n * thread / no_threads, without overflowing n * thread)
+static inline size_t
+range_begin(unsigned int thread, unsigned int no_threads, size_t n)
+{
+  return n / no_threads * thread + n % no_threads * thread / no_threads;
+}
+
+#endif
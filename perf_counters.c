@@ -0,0 +1,137 @@
+
+#include "perf_counters.h"
+
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define CACHE_EVENT(cache, op, result)                                         \
+  ((cache) | (op) << 8 | (result) << 16)
+
+static const struct {
+  uint32_t type;
+  uint64_t config;
+  const char *name;
+} events[NO_PERF_COUNTERS] = {
+    [PERF_CYCLES] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "cycles"},
+    [PERF_INSTRUCTIONS] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS,
+                           "instr"},
+    [PERF_L1D_MISSES] = {PERF_TYPE_HW_CACHE,
+                         CACHE_EVENT(PERF_COUNT_HW_CACHE_L1D,
+                                     PERF_COUNT_HW_CACHE_OP_READ,
+                                     PERF_COUNT_HW_CACHE_RESULT_MISS),
+                         "L1d-miss"},
+    [PERF_LLC_MISSES] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES,
+                         "LLC-miss"},
+    [PERF_DTLB_MISSES] = {PERF_TYPE_HW_CACHE,
+                          CACHE_EVENT(PERF_COUNT_HW_CACHE_DTLB,
+                                      PERF_COUNT_HW_CACHE_OP_READ,
+                                      PERF_COUNT_HW_CACHE_RESULT_MISS),
+                          "dTLB-miss"},
+    [PERF_BRANCH_MISSES] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES,
+                            "br-miss"},
+    [PERF_PAGE_FAULTS] = {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS,
+                          "faults"},
+};
+
+static int
+open_event(uint32_t type, uint64_t config)
+{
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof attr);
+  attr.size = sizeof attr;
+  attr.type = type;
+  attr.config = config;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  // We open the counters one by one, so the CPU may have to multiplex
+  // them. Then we scale by how long each was actually counting.
+  attr.read_format =
+      PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+void
+open_perf_counters(struct perf_counters *counters)
+{
+  for (int i = 0; i < NO_PERF_COUNTERS; i++) {
+    counters->fds[i] = open_event(events[i].type, events[i].config);
+    counters->values[i] = 0;
+  }
+  counters->seconds = 0;
+}
+
+void
+close_perf_counters(struct perf_counters *counters)
+{
+  for (int i = 0; i < NO_PERF_COUNTERS; i++) {
+    if (counters->fds[i] >= 0)
+      close(counters->fds[i]);
+    counters->fds[i] = -1;
+  }
+}
+
+void
+start_perf_counters(struct perf_counters *counters)
+{
+  for (int i = 0; i < NO_PERF_COUNTERS; i++) {
+    if (counters->fds[i] >= 0) {
+      ioctl(counters->fds[i], PERF_EVENT_IOC_RESET, 0);
+      ioctl(counters->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &counters->begin);
+}
+
+void
+stop_perf_counters(struct perf_counters *counters)
+{
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  counters->seconds = (end.tv_sec - counters->begin.tv_sec) +
+                      (end.tv_nsec - counters->begin.tv_nsec) / 1e9;
+
+  for (int i = 0; i < NO_PERF_COUNTERS; i++) {
+    if (counters->fds[i] < 0)
+      continue;
+    ioctl(counters->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+    uint64_t data[3]; // value, time enabled, time running
+    if (read(counters->fds[i], data, sizeof data) != sizeof data ||
+        data[2] == 0) {
+      counters->values[i] = 0;
+      continue;
+    }
+    counters->values[i] =
+        (uint64_t)((double)data[0] * data[1] / (double)data[2]);
+  }
+}
+
+void
+print_perf_header(void)
+{
+  printf("%-16s %10s %9s", "phase", "ops", "ns/op");
+  for (int i = 0; i < NO_PERF_COUNTERS; i++) {
+    printf(" %9s", events[i].name);
+  }
+  printf("\n");
+}
+
+void
+print_perf_counters(const char *phase, struct perf_counters *counters,
+                    uint64_t ops)
+{
+  double per_op = ops ? 1.0 / ops : 0;
+  printf("%-16s %10llu %9.2f", phase, (unsigned long long)ops,
+         counters->seconds * 1e9 * per_op);
+  for (int i = 0; i < NO_PERF_COUNTERS; i++) {
+    if (counters->fds[i] >= 0)
+      printf(" %9.3f", counters->values[i] * per_op);
+    else
+      printf(" %9s", "-");
+  }
+  printf("\n");
+}
@@ -0,0 +1,51 @@
+
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+// Hardware performance counters for the benchmarks, read with Linux'
+// perf_event_open. We count user-space events in the calling thread only,
+// which the default perf_event_paranoid setting allows, so work on other
+// threads (parallel resizes) isn't counted. Counters the kernel or the CPU
+// don't give us are reported as missing; wall-clock time is always there.
+enum perf_counter {
+  PERF_CYCLES,
+  PERF_INSTRUCTIONS,
+  PERF_L1D_MISSES,
+  PERF_LLC_MISSES,
+  PERF_DTLB_MISSES,
+  PERF_BRANCH_MISSES,
+  PERF_PAGE_FAULTS, // A software event; a proxy for allocator cost
+  NO_PERF_COUNTERS
+};
+
+struct perf_counters {
+  int fds[NO_PERF_COUNTERS]; // -1 for counters we don't have
+  uint64_t values[NO_PERF_COUNTERS];
+  struct timespec begin;
+  double seconds;
+};
+
+void
+open_perf_counters(struct perf_counters *counters);
+void
+close_perf_counters(struct perf_counters *counters);
+
+// Count the events between start and stop.
+void
+start_perf_counters(struct perf_counters *counters);
+void
+stop_perf_counters(struct perf_counters *counters);
+
+// Print a header line, and then a line per phase with time and events per
+// operation.
+void
+print_perf_header(void);
+void
+print_perf_counters(const char *phase, struct perf_counters *counters,
+                    uint64_t ops);
+
+#endif
@@ -0,0 +1,284 @@
+
+#include "hash_table.h"
+#include "perf_counters.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Time and memory per key for a backend at a realistic size, checked
+// against the numbers in a baselines file. A phase regresses when it takes
+// more than (1 + time_tolerance) times its baseline time, and the table
+// when it uses more than (1 + memory_tolerance) times its baseline bytes
+// per key. Getting faster or smaller is fine.
+//
+// Every backend and size we run needs its baselines, and they only apply
+// to the build type they were recorded with, which the file gives on a
+// "build_type" line. With "-" for the baselines file, we print the numbers
+// in the file's format instead, so the baselines can be recorded with
+//   perf_regression_<backend> <backend> <keys> - >> perf_baselines.txt
+
+// The CMake build type we were built with
+#ifndef BUILD_TYPE
+#define BUILD_TYPE ""
+#endif
+
+// We run the workload this many times and keep the fastest time for each
+// phase, which is the one the least disturbed by everything else. When a
+// phase still looks slow, we give it up to MAX_ROUNDS rounds of REPEATS
+// runs before we call it a regression.
+#ifndef REPEATS
+#define REPEATS 3
+#endif
+#ifndef MAX_ROUNDS
+#define MAX_ROUNDS 3
+#endif
+
+enum phase { INSERT, LOOKUP_HIT, LOOKUP_MISS, DELETE, NO_PHASES };
+static const char *phase_names[NO_PHASES] = {
+    [INSERT] = "insert",
+    [LOOKUP_HIT] = "lookup_hit",
+    [LOOKUP_MISS] = "lookup_miss",
+    [DELETE] = "delete",
+};
+
+// A bijection on 32-bit words that scrambles the bits (the MurmurHash3
+// finaliser). Key i is mix(i), so the keys are distinct and use all 32
+// bits, and the misses come from indices after the keys'.
+static uint32_t
+mix(uint32_t x)
+{
+  x ^= x >> 16;
+  x *= 0x85ebca6bU;
+  x ^= x >> 13;
+  x *= 0xc2b2ae35U;
+  x ^= x >> 16;
+  return x;
+}
+
+struct workload {
+  unsigned int *keys;
+  unsigned int *misses;
+  int no_elms;
+  struct perf_counters counters;
+  double ns_per_op[NO_PHASES]; // The fastest so far
+  double bytes_per_key;
+};
+
+// Run one phase, keeping its time if it is the fastest so far
+static void
+run_phase(enum phase phase, struct hash_table *table,
+          struct workload *workload)
+{
+  const unsigned int *keys = workload->keys, *misses = workload->misses;
+  int no_elms = workload->no_elms;
+  unsigned int found = 0;
+  start_perf_counters(&workload->counters);
+  for (int i = 0; i < no_elms; ++i) {
+    switch (phase) {
+    case INSERT:
+      insert_key(table, keys[i]);
+      break;
+    case LOOKUP_HIT:
+      found += contains_key(table, keys[i]);
+      break;
+    case LOOKUP_MISS:
+      found += contains_key(table, misses[i]);
+      break;
+    case DELETE:
+      delete_key(table, keys[i]);
+      break;
+    default:
+      break;
+    }
+  }
+  stop_perf_counters(&workload->counters);
+
+  // Use found, so the lookups aren't optimised away
+  if (phase == LOOKUP_HIT && found < (unsigned int)no_elms) {
+    printf("The table lost keys\n");
+    exit(EXIT_FAILURE);
+  }
+  if (phase == LOOKUP_MISS && found > 0) {
+    printf("The table found keys it doesn't have\n");
+    exit(EXIT_FAILURE);
+  }
+  double ns = 1e9 * workload->counters.seconds / no_elms;
+  if (ns < workload->ns_per_op[phase])
+    workload->ns_per_op[phase] = ns;
+}
+
+// The baseline for backend and measure at no_elms keys, or a negative
+// number if the file doesn't have one
+static double
+find_baseline(FILE *file, const char *backend, int no_elms,
+              const char *measure)
+{
+  char line[256], name[64], what[64];
+  int keys;
+  double value;
+  rewind(file);
+  while (fgets(line, sizeof line, file)) {
+    if (line[0] == '#')
+      continue;
+    if (sscanf(line, "%63s %d %63s %lf", name, &keys, what, &value) == 4 &&
+        strcmp(name, backend) == 0 && keys == no_elms &&
+        strcmp(what, measure) == 0)
+      return value;
+  }
+  return -1;
+}
+
+// Whether the baselines were recorded with our build type. The default
+// build type is empty, and so is the rest of its build_type line.
+static bool
+same_build_type(FILE *file)
+{
+  char line[256], type[64];
+  rewind(file);
+  while (fgets(line, sizeof line, file)) {
+    if (strncmp(line, "build_type", 10) != 0)
+      continue;
+    if (sscanf(line + 10, "%63s", type) != 1)
+      type[0] = '\0';
+    if (strcmp(type, BUILD_TYPE) == 0)
+      return true;
+    printf("The baselines are for the \"%s\" build type, not \"%s\"\n", type,
+           BUILD_TYPE);
+    return false;
+  }
+  printf("The baselines don't give their build type\n");
+  return false;
+}
+
+// Compare a measurement to its baseline, returning whether it regressed.
+// A missing baseline counts as a regression, since it means we check
+// nothing.
+static bool
+check(FILE *baselines, const char *backend, int no_elms, const char *measure,
+      double value, double tolerance)
+{
+  if (!baselines) {
+    printf("%s %d %s %.2f\n", backend, no_elms, measure, value);
+    return false;
+  }
+  double baseline = find_baseline(baselines, backend, no_elms, measure);
+  if (baseline < 0) {
+    printf("%-14s %10.2f %10s  MISSING\n", measure, value, "-");
+    return true;
+  }
+  bool regressed = value > baseline * (1 + tolerance);
+  printf("%-14s %10.2f %10.2f %+7.1f%%%s\n", measure, value, baseline,
+         100 * (value / baseline - 1), regressed ? "  REGRESSED" : "");
+  return regressed;
+}
+
+static void
+run_workload(struct workload *workload)
+{
+  for (int run = 0; run < REPEATS; run++) {
+    struct hash_table *table = new_table();
+    for (int phase = 0; phase < NO_PHASES; phase++) {
+      run_phase(phase, table, workload);
+      if (phase == INSERT)
+        workload->bytes_per_key =
+            table_memory_usage(table).total / (double)no_keys(table);
+    }
+    if (no_keys(table) != 0) {
+      printf("The table kept deleted keys\n");
+      exit(EXIT_FAILURE);
+    }
+    delete_table(table);
+  }
+}
+
+static void
+time_measure(enum phase phase, char *measure, size_t size)
+{
+  snprintf(measure, size, "%s_ns", phase_names[phase]);
+}
+
+// Whether any phase is slower than its baseline allows
+static bool
+slow_phases(FILE *baselines, const char *backend, struct workload *workload,
+            double tolerance)
+{
+  for (int phase = 0; phase < NO_PHASES; phase++) {
+    char measure[64];
+    time_measure(phase, measure, sizeof measure);
+    double baseline =
+        find_baseline(baselines, backend, workload->no_elms, measure);
+    if (baseline >= 0 &&
+        workload->ns_per_op[phase] > baseline * (1 + tolerance))
+      return true;
+  }
+  return false;
+}
+
+int
+main(int argc, const char *argv[])
+{
+  if (argc != 4 && argc != 6) {
+    printf("Usage: %s backend no_elements baselines "
+           "[time_tolerance memory_tolerance]\n",
+           argv[0]);
+    return EXIT_FAILURE;
+  }
+  const char *backend = argv[1];
+  int no_elms = atoi(argv[2]);
+  double time_tolerance = argc == 6 ? atof(argv[4]) : 0.5;
+  double memory_tolerance = argc == 6 ? atof(argv[5]) : 0.05;
+
+  FILE *baselines = NULL;
+  if (strcmp(argv[3], "-") != 0) {
+    baselines = fopen(argv[3], "r");
+    if (!baselines) {
+      perror(argv[3]);
+      return EXIT_FAILURE;
+    }
+    if (!same_build_type(baselines))
+      return EXIT_FAILURE;
+  }
+
+  struct workload workload = {
+      .keys = malloc(no_elms * sizeof *workload.keys),
+      .misses = malloc(no_elms * sizeof *workload.misses),
+      .no_elms = no_elms};
+  for (int i = 0; i < no_elms; ++i) {
+    workload.keys[i] = mix((uint32_t)i);
+    workload.misses[i] = mix((uint32_t)(no_elms + i));
+  }
+  for (int phase = 0; phase < NO_PHASES; phase++) {
+    workload.ns_per_op[phase] = 1e30;
+  }
+
+  open_perf_counters(&workload.counters);
+  run_workload(&workload);
+  for (int round = 1; round < MAX_ROUNDS; round++) {
+    if (!baselines ||
+        !slow_phases(baselines, backend, &workload, time_tolerance))
+      break;
+    run_workload(&workload);
+  }
+  close_perf_counters(&workload.counters);
+
+  if (baselines)
+    printf("%s, %d keys\n%-14s %10s %10s %8s\n", backend, no_elms, "measure",
+           "value", "baseline", "change");
+  bool regressed = false;
+  for (int phase = 0; phase < NO_PHASES; phase++) {
+    char measure[64];
+    time_measure(phase, measure, sizeof measure);
+    regressed |= check(baselines, backend, no_elms, measure,
+                       workload.ns_per_op[phase], time_tolerance);
+  }
+  regressed |= check(baselines, backend, no_elms, "bytes_per_key",
+                     workload.bytes_per_key, memory_tolerance);
+
+  if (baselines)
+    fclose(baselines);
+  free(workload.misses);
+  free(workload.keys);
+  return regressed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,60 @@
+
+#include "hash_table.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// The prime table picks its sizes with Miller-Rabin. Check them against
+// trial division.
+static bool
+is_prime(size_t n)
+{
+  if (n < 2)
+    return false;
+  for (size_t d = 2; d * d <= n; d++) {
+    if (n % d == 0)
+      return false;
+  }
+  return true;
+}
+
+int
+main(int argc, const char *argv[])
+{
+  if (argc != 2) {
+    printf("Usage: %s max_keys\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  size_t max_keys = strtoull(argv[1], NULL, 10);
+
+  // Tables sized for a capacity have a prime size and room for the keys
+  for (size_t keys = 0; keys <= max_keys; keys = keys * 5 / 4 + 1) {
+    struct hash_table *table = new_table_with_capacity(keys);
+    size_t bins = no_bins(table);
+    assert(is_prime(bins));
+    assert(keys <= bins / 2);
+    delete_table(table);
+  }
+
+  // Growing and shrinking keeps prime sizes
+  struct hash_table *table = new_table();
+  size_t last_bins = no_bins(table);
+  for (unsigned int key = 0; key < max_keys; key++) {
+    insert_key(table, key);
+    if (no_bins(table) != last_bins) {
+      last_bins = no_bins(table);
+      assert(is_prime(last_bins));
+      printf("%zu keys: %zu bins\n", no_keys(table), last_bins);
+    }
+  }
+  for (unsigned int key = 0; key < max_keys; key++) {
+    delete_key(table, key);
+    assert(is_prime(no_bins(table)));
+  }
+  assert(no_keys(table) == 0);
+  delete_table(table);
+
+  return EXIT_SUCCESS;
+}
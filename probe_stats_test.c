@@ -0,0 +1,123 @@
+
+#include "open_addressing.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Mean and max probe lengths for each probe sequence on a few key
+// distributions. Keys are used directly as hashes, so structured keys
+// show up as clusters.
+
+// MurmurHash3's 32-bit finaliser. It is a bijection, so the keys are
+// random-looking but distinct.
+static unsigned int
+mix(unsigned int x)
+{
+  x ^= x >> 16;
+  x *= 0x85ebca6bU;
+  x ^= x >> 13;
+  x *= 0xc2b2ae35U;
+  x ^= x >> 16;
+  return x;
+}
+
+static unsigned int
+uniform_key(unsigned int i)
+{
+  return mix(i);
+}
+static unsigned int
+sequential_key(unsigned int i)
+{
+  return i;
+}
+// Runs of 32 consecutive keys at random places
+static unsigned int
+clustered_key(unsigned int i)
+{
+  return mix(i / 32) << 5 | i % 32;
+}
+static unsigned int
+strided_key(unsigned int i)
+{
+  return i * 64;
+}
+
+static const struct {
+  const char *name;
+  unsigned int (*key)(unsigned int i);
+} distributions[] = {{"uniform", uniform_key},
+                     {"sequential", sequential_key},
+                     {"clustered", clustered_key},
+                     {"strided", strided_key}};
+
+static const struct {
+  const char *name;
+  enum probe probe;
+} probes[] = {{"linear", LINEAR_PROBING},
+              {"triangular", TRIANGULAR_PROBING},
+              {"double", DOUBLE_HASHING}};
+
+#define NO_DISTRIBUTIONS (sizeof distributions / sizeof *distributions)
+#define NO_PROBES (sizeof probes / sizeof *probes)
+
+int
+main(int argc, const char *argv[])
+{
+  if (argc != 2) {
+    printf("Usage: %s no_elements\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  unsigned int no_elms = atoi(argv[1]);
+  unsigned int *keys = malloc(no_elms * sizeof *keys);
+
+  printf("%-12s %-12s %8s %8s %8s\n", "keys", "probe", "load", "mean", "max");
+  for (unsigned int d = 0; d < NO_DISTRIBUTIONS; d++) {
+    for (unsigned int i = 0; i < no_elms; i++) {
+      keys[i] = distributions[d].key(i);
+    }
+
+    for (unsigned int s = 0; s < NO_PROBES; s++) {
+      struct hash_table *table = new_table();
+      if (!set_probe(table, probes[s].probe)) {
+        delete_table(table);
+        continue;
+      }
+      for (unsigned int i = 0; i < no_elms; i++) {
+        insert_key(table, keys[i]);
+      }
+      for (unsigned int i = 0; i < no_elms; i++) {
+        assert(contains_key(table, keys[i]));
+      }
+
+      // A cursor sees every key once
+      struct cursor cursor = NEW_CURSOR;
+      unsigned int key, scanned = 0;
+      while (next_key(table, &cursor, &key)) {
+        scanned++;
+      }
+      assert(scanned == no_keys(table));
+
+      struct probe_stats stats = probe_stats(table);
+      printf("%-12s %-12s %8.3f %8.3f %8u\n", distributions[d].name,
+             probes[s].name, no_keys(table) / (double)no_bins(table),
+             stats.mean, stats.max);
+
+      // Switching probes keeps the keys, and so does deleting half of them
+      // with tombstones in the sequences.
+      set_probe(table, LINEAR_PROBING);
+      set_probe(table, probes[s].probe);
+      for (unsigned int i = 0; i < no_elms; i += 2) {
+        delete_key(table, keys[i]);
+      }
+      for (unsigned int i = 1; i < no_elms; i += 2) {
+        assert(contains_key(table, keys[i]));
+      }
+      delete_table(table);
+    }
+  }
+
+  free(keys);
+  return EXIT_SUCCESS;
+}
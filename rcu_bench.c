@@ -0,0 +1,135 @@
+
+#include "parallel.h"
+#include "rcu_open_addressing.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Reader throughput with and without a writer that keeps growing and
+// shrinking the table, for readers that take a shared lock around every
+// lookup and for lock-free readers. With the lock, readers wait while the
+// writer resizes; lock-free readers shouldn't notice the writer.
+
+static unsigned int
+key(unsigned int i)
+{
+  return i * 2654435761U;
+}
+
+struct workload {
+  struct hash_table *table;
+  pthread_rwlock_t lock;
+  bool locked;  // Readers and the writer take the lock
+  bool writing; // Thread 0 is a writer
+  unsigned int no_keys;
+  unsigned int ops; // Lookups per reader
+  atomic_int readers_left;
+  atomic_int missing;
+};
+
+static void
+churn(struct workload *workload)
+{
+  // Churn keys are odd, the keys readers look up even
+  for (unsigned int i = 0; atomic_load(&workload->readers_left); i++) {
+    unsigned int churn = key(2 * (i % (4 * workload->no_keys)) + 1);
+    bool growing = (i / (4 * workload->no_keys)) % 2 == 0;
+    if (workload->locked)
+      pthread_rwlock_wrlock(&workload->lock);
+    if (growing)
+      insert_key(workload->table, churn);
+    else
+      delete_key(workload->table, churn);
+    if (workload->locked)
+      pthread_rwlock_unlock(&workload->lock);
+  }
+}
+
+static void
+look_up(struct workload *workload)
+{
+  struct rcu_reader *reader = register_reader(workload->table);
+  unsigned int found = 0;
+  for (unsigned int i = 0; i < workload->ops; i++) {
+    unsigned int k = key(2 * (i % workload->no_keys));
+    if (workload->locked) {
+      pthread_rwlock_rdlock(&workload->lock);
+      found += contains_key(workload->table, k);
+      pthread_rwlock_unlock(&workload->lock);
+    } else {
+      found += reader_contains_key(reader, k);
+    }
+  }
+  unregister_reader(reader);
+  atomic_fetch_add(&workload->missing, workload->ops - found);
+  atomic_fetch_sub(&workload->readers_left, 1);
+}
+
+static void
+run(unsigned int thread, size_t begin, size_t end, void *data)
+{
+  struct workload *workload = data;
+  if (thread == 0 && workload->writing)
+    churn(workload);
+  else
+    look_up(workload);
+}
+
+// Millions of lookups per second over all the readers
+static double
+reader_throughput(struct workload *workload, unsigned int readers)
+{
+  atomic_init(&workload->readers_left, readers);
+  unsigned int threads = readers + workload->writing;
+  struct timespec begin, end;
+  clock_gettime(CLOCK_MONOTONIC, &begin);
+  parallel_for(threads, threads, run, workload);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double time =
+      (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9;
+  return (double)readers * workload->ops / time / 1e6;
+}
+
+int
+main(int argc, const char *argv[])
+{
+  if (argc != 4) {
+    printf("Usage: %s no_keys ops_per_reader max_readers\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  unsigned int no_keys = atoi(argv[1]);
+  unsigned int ops = atoi(argv[2]);
+  unsigned int max_readers = atoi(argv[3]);
+
+  struct workload workload = {.table = new_table(),
+                              .lock = PTHREAD_RWLOCK_INITIALIZER,
+                              .no_keys = no_keys,
+                              .ops = ops};
+  atomic_init(&workload.missing, 0);
+  for (unsigned int i = 0; i < no_keys; i++) {
+    insert_key(workload.table, key(2 * i));
+  }
+
+  printf("readers\trwlock\trwlock+writer\trcu\trcu+writer\t(Mlookups/s)\n");
+  for (unsigned int readers = 1; readers <= max_readers; readers *= 2) {
+    double results[4];
+    for (int mode = 0; mode < 4; mode++) {
+      workload.locked = mode < 2;
+      workload.writing = mode % 2;
+      results[mode] = reader_throughput(&workload, readers);
+    }
+    printf("%u\t%.2f\t%.2f\t%.2f\t%.2f\n", readers, results[0], results[1],
+           results[2], results[3]);
+  }
+
+  delete_table(workload.table);
+  if (atomic_load(&workload.missing)) {
+    printf("Readers missed %d keys\n", atomic_load(&workload.missing));
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,512 @@
+
+#include "rcu_open_addressing.h"
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "trace.h"
+
+#define MIN_SIZE 8
+
+// Bin states, two bits each, as in open_addressing.h
+enum bin_state { BIN_EMPTY = 0, BIN_DELETED = 1, BIN_LIVE = 3 };
+
+struct bins {
+  size_t size;
+  _Atomic unsigned int *keys;
+  _Atomic uint64_t *states; // 2 bits per bin
+  _Atomic uint32_t *seqs;   // One sequence number per stripe of 32 bins
+};
+
+// Each reader has its own cache line, so announcing epochs doesn't bounce
+// lines between readers.
+struct rcu_reader {
+  alignas(64) atomic_ulong epoch; // 0 when the reader isn't in a lookup
+  atomic_bool registered;
+  struct hash_table *table;
+};
+
+// Bins we swapped out and will free once every reader has moved on
+struct retired {
+  struct bins *bins;
+  unsigned long epoch; // The first epoch that can't see the bins
+  struct retired *next;
+};
+
+struct hash_table {
+  _Atomic(struct bins *) bins;
+  size_t used;    // Bins that have held a key since the last resize
+  size_t active;  // Keys in the table
+  size_t resizes; // Bumped by the writer whenever it replaces the bins
+  atomic_ulong epoch;
+  struct retired *retired;
+  const struct allocator *allocator;
+  void *memory; // What we allocated for the table, before aligning it
+  struct rcu_reader readers[MAX_READERS];
+};
+
+// We align the table by hand, since allocators only promise malloc's
+// alignment.
+#define TABLE_MEMORY                                                           \
+  (sizeof(struct hash_table) + alignof(struct hash_table) - 1)
+
+static struct bins *
+new_bins(struct hash_table *table, size_t size)
+{
+  const struct allocator *allocator = table->allocator;
+  struct bins *bins = allocate(allocator, sizeof *bins);
+  size_t stripes = (size + 31) / 32;
+  *bins = (struct bins){
+      .size = size,
+      .keys = allocate(allocator, size * sizeof *bins->keys),
+      .states = allocate_zeroed(allocator, stripes * sizeof *bins->states),
+      .seqs = allocate_zeroed(allocator, stripes * sizeof *bins->seqs)};
+  return bins;
+}
+
+// Bytes in bins, including the struct
+static size_t
+bins_memory(struct bins *bins)
+{
+  size_t stripes = (bins->size + 31) / 32;
+  return sizeof *bins + bins->size * sizeof *bins->keys +
+         stripes * (sizeof *bins->states + sizeof *bins->seqs);
+}
+
+static void
+free_bins(struct hash_table *table, struct bins *bins)
+{
+  const struct allocator *allocator = table->allocator;
+  size_t stripes = (bins->size + 31) / 32;
+  deallocate(allocator, bins->seqs, stripes * sizeof *bins->seqs);
+  deallocate(allocator, bins->states, stripes * sizeof *bins->states);
+  deallocate(allocator, bins->keys, bins->size * sizeof *bins->keys);
+  deallocate(allocator, bins, sizeof *bins);
+}
+
+// Only the writer changes the bins pointer, so it can read it relaxed
+static inline struct bins *
+writer_bins(struct hash_table *table)
+{
+  return atomic_load_explicit(&table->bins, memory_order_relaxed);
+}
+
+static inline enum bin_state
+bin_state(struct bins *bins, size_t bin)
+{
+  uint64_t word =
+      atomic_load_explicit(bins->states + bin / 32, memory_order_relaxed);
+  return (enum bin_state)((word >> (2 * (bin % 32))) & 3);
+}
+
+static inline unsigned int
+bin_key(struct bins *bins, size_t bin)
+{
+  return atomic_load_explicit(bins->keys + bin, memory_order_relaxed);
+}
+
+// Bit 2j of the result is set if bin j of `word` has the given state
+static inline uint64_t
+state_mask(uint64_t word, enum bin_state state)
+{
+  uint64_t same = ~(word ^ (state * 0x5555555555555555u));
+  return same & (same >> 1) & 0x5555555555555555u;
+}
+
+// The number of bins from `bin` to the end of its stripe, or of the table
+static inline size_t
+stripe_rest(struct bins *bins, size_t bin)
+{
+  size_t n = 32 - bin % 32;
+  return (n < bins->size - bin) ? n : bins->size - bin;
+}
+
+// Update a bin as the writer. The sequence number is odd while we do, as
+// in a seqlock.
+static void
+set_bin(struct bins *bins, size_t bin, unsigned int key, enum bin_state state)
+{
+  _Atomic uint32_t *seq = bins->seqs + bin / 32;
+  uint32_t s = atomic_load_explicit(seq, memory_order_relaxed);
+  atomic_store_explicit(seq, s + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+
+  atomic_store_explicit(bins->keys + bin, key, memory_order_relaxed);
+  _Atomic uint64_t *word = bins->states + bin / 32;
+  unsigned int shift = 2 * (bin % 32);
+  uint64_t w = atomic_load_explicit(word, memory_order_relaxed);
+  w = (w & ~((uint64_t)3 << shift)) | (uint64_t)state << shift;
+  atomic_store_explicit(word, w, memory_order_relaxed);
+
+  atomic_store_explicit(seq, s + 2, memory_order_release);
+}
+
+// Look for key in the n bins from `bin` in one stripe. Returns its bin or
+// bins->size, and sets *end if the probe ends in the stripe.
+static size_t
+scan_stripe(struct bins *bins, size_t bin, size_t n, unsigned int key,
+            bool *end)
+{
+  uint64_t word =
+      atomic_load_explicit(bins->states + bin / 32, memory_order_relaxed) >>
+      (2 * (bin % 32));
+  uint64_t valid = 0x5555555555555555u >> (64 - 2 * n);
+  uint64_t empty = state_mask(word, BIN_EMPTY) & valid;
+  uint64_t live = state_mask(word, BIN_LIVE);
+  if (empty)
+    live &= (empty & -empty) - 1; // Only the bins before the empty one
+  *end = empty != 0;
+  for (; live; live &= live - 1) {
+    size_t i = bin + __builtin_ctzll(live) / 2;
+    if (bin_key(bins, i) == key)
+      return i;
+  }
+  return bins->size;
+}
+
+// The bin holding key, or bins->size. Every stripe is read under its
+// sequence number, so the writer can change the bins while we look.
+static size_t
+find_key(struct bins *bins, unsigned int key)
+{
+  size_t bin = key & (bins->size - 1);
+  for (size_t seen = 0; seen < bins->size;) {
+    size_t n = stripe_rest(bins, bin);
+    _Atomic uint32_t *seq = bins->seqs + bin / 32;
+    uint32_t before;
+    size_t found;
+    bool end;
+    do {
+      before = atomic_load_explicit(seq, memory_order_acquire);
+      found = scan_stripe(bins, bin, n, key, &end);
+      atomic_thread_fence(memory_order_acquire);
+    } while ((before & 1) ||
+             before != atomic_load_explicit(seq, memory_order_relaxed));
+
+    if (found != bins->size || end)
+      return found;
+    seen += n;
+    bin = (bin + n == bins->size) ? 0 : bin + n;
+  }
+  return bins->size;
+}
+
+// The first bin without a key in key's probe. Only the writer uses this,
+// so it doesn't need the sequence numbers.
+static size_t
+find_empty(struct bins *bins, unsigned int key)
+{
+  size_t bin = key & (bins->size - 1);
+  while (bin_state(bins, bin) == BIN_LIVE)
+    bin = (bin + 1) & (bins->size - 1);
+  return bin;
+}
+
+// Free the retired bins that no reader can still be using: those where
+// every reader is outside a lookup or started it after the swap.
+static void
+reclaim(struct hash_table *table)
+{
+  struct retired **next = &table->retired;
+  while (*next) {
+    struct retired *retired = *next;
+    bool in_use = false;
+    for (int i = 0; i < MAX_READERS && !in_use; i++) {
+      unsigned long epoch = atomic_load(&table->readers[i].epoch);
+      in_use = epoch != 0 && epoch < retired->epoch;
+    }
+    if (in_use) {
+      next = &retired->next;
+    } else {
+      *next = retired->next;
+      free_bins(table, retired->bins);
+      deallocate(table->allocator, retired, sizeof *retired);
+    }
+  }
+}
+
+static void
+resize(struct hash_table *table, size_t new_size)
+{
+  struct bins *old = writer_bins(table), *bins = new_bins(table, new_size);
+  for (size_t bin = 0; bin < old->size; bin++) {
+    if (bin_state(old, bin) == BIN_LIVE) {
+      unsigned int key = bin_key(old, bin);
+      set_bin(bins, find_empty(bins, key), key, BIN_LIVE);
+    }
+  }
+  table->used = table->active;
+  table->resizes++;
+
+  // Readers that saw the old epoch may still be using the old bins
+  atomic_store(&table->bins, bins);
+  struct retired *retired = allocate(table->allocator, sizeof *retired);
+  *retired = (struct retired){.bins = old,
+                              .epoch = atomic_fetch_add(&table->epoch, 1) + 1,
+                              .next = table->retired};
+  table->retired = retired;
+  reclaim(table);
+}
+
+struct hash_table *
+new_table_with_allocator(size_t keys, const struct allocator *allocator)
+{
+  // We grow when more than half the bins are used
+  size_t size = MIN_SIZE;
+  while (keys > size / 2)
+    size *= 2;
+
+  void *memory = allocate(allocator, TABLE_MEMORY);
+  uintptr_t align = alignof(struct hash_table);
+  struct hash_table *table =
+      (struct hash_table *)(((uintptr_t)memory + align - 1) & ~(align - 1));
+  table->memory = memory;
+  table->allocator = allocator;
+  table->used = table->active = 0;
+  table->resizes = 0;
+  table->retired = NULL;
+  atomic_init(&table->bins, new_bins(table, size));
+  atomic_init(&table->epoch, 1); // Readers use 0 for "not reading"
+  for (int i = 0; i < MAX_READERS; i++) {
+    atomic_init(&table->readers[i].epoch, 0);
+    atomic_init(&table->readers[i].registered, false);
+    table->readers[i].table = table;
+  }
+  TRACE(TRACE_NEW_TABLE, table, keys, false);
+  return table;
+}
+
+struct hash_table *
+new_table_with_capacity(size_t keys)
+{
+  return new_table_with_allocator(keys, NULL);
+}
+
+struct hash_table *
+new_table()
+{
+  return new_table_with_capacity(0);
+}
+
+void
+delete_table(struct hash_table *table)
+{
+  TRACE(TRACE_DELETE_TABLE, table, 0, false);
+  while (table->retired) {
+    struct retired *retired = table->retired;
+    table->retired = retired->next;
+    free_bins(table, retired->bins);
+    deallocate(table->allocator, retired, sizeof *retired);
+  }
+  free_bins(table, writer_bins(table));
+  deallocate(table->allocator, table->memory, TABLE_MEMORY);
+}
+
+struct memory_usage
+table_memory_usage(struct hash_table *table)
+{
+  struct memory_usage usage = {.table = TABLE_MEMORY,
+                               .bins = bins_memory(writer_bins(table))};
+  for (struct retired *retired = table->retired; retired;
+       retired = retired->next) {
+    usage.bins += bins_memory(retired->bins) + sizeof *retired;
+  }
+  usage.total = usage.table + usage.bins;
+  return usage;
+}
+
+// The API functions are traced, so internally we use these instead.
+static bool
+has_key(struct hash_table *table, unsigned int key)
+{
+  struct bins *bins = writer_bins(table);
+  return find_key(bins, key) != bins->size;
+}
+
+static bool
+add_key(struct hash_table *table, unsigned int key)
+{
+  if (has_key(table, key))
+    return false;
+
+  struct bins *bins = writer_bins(table);
+  size_t bin = find_empty(bins, key);
+  table->active++;
+  if (bin_state(bins, bin) == BIN_EMPTY)
+    table->used++; // We are using a new bin
+  set_bin(bins, bin, key, BIN_LIVE);
+
+  if (table->used > bins->size / 2)
+    resize(table, bins->size * 2);
+  return true;
+}
+
+bool
+try_insert(struct hash_table *table, unsigned int key)
+{
+  TRACE(TRACE_INSERT, table, key, false);
+  if (table->retired)
+    reclaim(table);
+  return add_key(table, key);
+}
+
+void
+insert_key(struct hash_table *table, unsigned int key)
+{
+  try_insert(table, key);
+}
+
+bool
+contains_key(struct hash_table *table, unsigned int key)
+{
+  bool found = has_key(table, key);
+  TRACE(TRACE_CONTAINS, table, key, found);
+  return found;
+}
+
+bool
+erase(struct hash_table *table, unsigned int key)
+{
+  TRACE(TRACE_DELETE, table, key, false);
+  if (table->retired)
+    reclaim(table);
+
+  struct bins *bins = writer_bins(table);
+  size_t bin = find_key(bins, key);
+  if (bin == bins->size)
+    return false; // Nothing more to do
+
+  // Delete the key. The bin stays in use, but one less is active.
+  set_bin(bins, bin, key, BIN_DELETED);
+  table->active--;
+
+  if (table->active < bins->size / 8 && bins->size > MIN_SIZE)
+    resize(table, bins->size / 2);
+  return true;
+}
+
+void
+delete_key(struct hash_table *table, unsigned int key)
+{
+  erase(table, key);
+}
+
+struct rcu_reader *
+register_reader(struct hash_table *table)
+{
+  for (int i = 0; i < MAX_READERS; i++) {
+    bool registered = false;
+    if (atomic_compare_exchange_strong(&table->readers[i].registered,
+                                       &registered, true))
+      return table->readers + i;
+  }
+  return NULL;
+}
+
+void
+unregister_reader(struct rcu_reader *reader)
+{
+  atomic_store(&reader->epoch, 0);
+  atomic_store(&reader->registered, false);
+}
+
+bool
+reader_contains_key(struct rcu_reader *reader, unsigned int key)
+{
+  struct hash_table *table = reader->table;
+  // Announce the epoch before we load the bins. If the writer doesn't see
+  // our epoch, it swapped the bins before we load them.
+  atomic_store(&reader->epoch, atomic_load(&table->epoch));
+  struct bins *bins = atomic_load(&table->bins);
+  bool found = find_key(bins, key) != bins->size;
+  atomic_store_explicit(&reader->epoch, 0, memory_order_release);
+  return found;
+}
+
+size_t
+no_keys(struct hash_table *table)
+{
+  return table->active;
+}
+
+void
+for_each_key(struct hash_table *table, void (*f)(unsigned int key, void *data),
+             void *data)
+{
+  for_each_key_in_bins(table, 0, no_bins(table), f, data);
+}
+
+size_t
+no_bins(struct hash_table *table)
+{
+  return writer_bins(table)->size;
+}
+
+void
+for_each_key_in_bins(struct hash_table *table, size_t begin, size_t end,
+                     void (*f)(unsigned int key, void *data), void *data)
+{
+  struct bins *bins = writer_bins(table);
+  for (size_t bin = begin; bin < end; bin++) {
+    if (bin_state(bins, bin) == BIN_LIVE)
+      f(bin_key(bins, bin), data);
+  }
+}
+
+// We scan keys by their home bin, in reverse-binary order, as in
+// open_addressing.c.
+static size_t
+next_scan_bin(void *table, size_t bin)
+{
+  return next_reverse_binary(bin, no_bins(table) - 1);
+}
+
+static void
+visit_scan_bin(void *table, size_t bin,
+               void (*f)(unsigned int key, void *data), void *data)
+{
+  struct bins *bins = writer_bins(table);
+  size_t mask = bins->size - 1, start = bin & mask;
+  for (size_t i = start;; i = (i + 1) & mask) {
+    enum bin_state state = bin_state(bins, i);
+    if (state == BIN_EMPTY)
+      break;
+    if (state == BIN_LIVE && (bin_key(bins, i) & mask) == start)
+      f(bin_key(bins, i), data);
+  }
+}
+
+unsigned int
+next_n(struct hash_table *table, struct cursor *cursor, unsigned int *keys,
+       unsigned int n)
+{
+  struct scan_bins bins = {.table = table,
+                           .stamp = table->resizes,
+                           .restart_on_resize = false,
+                           .next = next_scan_bin,
+                           .visit = visit_scan_bin};
+  return scan_next_n(cursor, &bins, keys, n);
+}
+
+void
+print_table(struct hash_table *table)
+{
+  struct bins *bins = writer_bins(table);
+  for (size_t i = 0; i < bins->size; i++) {
+    if (i > 0 && i % 8 == 0) {
+      printf("\n");
+    }
+    enum bin_state state = bin_state(bins, i);
+    if (state == BIN_LIVE) {
+      printf("[%u]", bin_key(bins, i));
+    } else if (state == BIN_DELETED) {
+      printf("[*]");
+    } else {
+      printf("[ ]");
+    }
+  }
+  printf("\n----------------------\n");
+}
@@ -0,0 +1,88 @@
+
+#ifndef RCU_OPEN_ADDRESSING_H
+#define RCU_OPEN_ADDRESSING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "allocator.h"
+#include "cursor.h"
+
+// Open addressing with linear probing, as in open_addressing.c, for one
+// writer thread and any number of reader threads, without locks.
+//
+// The writer uses the usual hash_table.h functions. Readers register a
+// handle and look keys up with reader_contains_key. Bins are split into
+// stripes of 32, one word of states, and each stripe has a sequence
+// number that the writer makes odd while it updates a bin in the stripe.
+// A reader retries a stripe if the number was odd or changed while it read
+// it, so readers only ever wait for a single bin update.
+//
+// A resize builds new bins and swaps the table's pointer to them, so
+// readers keep using the old bins until they are done (as in RCU). Each
+// reader announces the epoch it started in, and the writer only frees the
+// old bins when no reader from before the swap is left.
+struct hash_table; // Forward declaration
+
+struct hash_table *
+new_table(void);
+struct hash_table *
+new_table_with_capacity(size_t keys);
+struct hash_table *
+new_table_with_allocator(size_t keys, const struct allocator *allocator);
+// There must be no registered readers left
+void
+delete_table(struct hash_table *table);
+
+// Only the writer may call these
+void
+insert_key(struct hash_table *table, unsigned int key);
+bool
+contains_key(struct hash_table *table, unsigned int key);
+void
+delete_key(struct hash_table *table, unsigned int key);
+// insert_key and delete_key, telling us what they did: try_insert returns
+// false if the key was already there, and erase whether it was there.
+bool
+try_insert(struct hash_table *table, unsigned int key);
+bool
+erase(struct hash_table *table, unsigned int key);
+
+// Number of keys in the table
+size_t
+no_keys(struct hash_table *table);
+// Call f(key, data) for every key in the table
+void
+for_each_key(struct hash_table *table, void (*f)(unsigned int key, void *data),
+             void *data);
+// Bins and the keys in bins [begin, end)
+size_t
+no_bins(struct hash_table *table);
+void
+for_each_key_in_bins(struct hash_table *table, size_t begin, size_t end,
+                     void (*f)(unsigned int key, void *data), void *data);
+
+// The bytes the table holds. The bins include old bins that readers may
+// still be using.
+struct memory_usage
+table_memory_usage(struct hash_table *table);
+
+// At most this many readers can be registered at a time
+#define MAX_READERS 64
+
+// A reader handle belongs to one thread. Returns NULL if there are already
+// MAX_READERS readers.
+struct rcu_reader *
+register_reader(struct hash_table *table);
+void
+unregister_reader(struct rcu_reader *reader);
+
+// Safe to call while the writer changes the table
+bool
+reader_contains_key(struct rcu_reader *reader, unsigned int key);
+
+// For debugging
+void
+print_table(struct hash_table *table);
+
+#endif
@@ -0,0 +1,101 @@
+
+#include "parallel.h"
+#include "rcu_open_addressing.h"
+
+#include <assert.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Distinct keys: even indices for keys we keep in the table, odd ones for
+// keys the writer inserts and deletes again.
+static unsigned int
+key(unsigned int i)
+{
+  return i * 2654435761U;
+}
+
+// The writer repeatedly grows the table with churn keys and shrinks it
+// again, while readers check that the stable keys are always there and
+// that keys we never insert never are.
+struct race {
+  struct hash_table *table;
+  unsigned int no_stable;
+  unsigned int rounds;
+  atomic_int done;
+  atomic_int errors;
+};
+
+static void
+race_thread(unsigned int thread, size_t begin, size_t end, void *data)
+{
+  struct race *race = data;
+  if (thread == 0) {
+    for (unsigned int round = 0; round < race->rounds; round++) {
+      for (unsigned int i = 0; i < 4 * race->no_stable; i++) {
+        insert_key(race->table, key(2 * i + 1));
+      }
+      for (unsigned int i = 0; i < 4 * race->no_stable; i++) {
+        delete_key(race->table, key(2 * i + 1));
+      }
+      sched_yield();
+    }
+    atomic_store(&race->done, 1);
+    return;
+  }
+
+  struct rcu_reader *reader = register_reader(race->table);
+  assert(reader);
+  for (unsigned int i = 0; !atomic_load(&race->done); i++) {
+    unsigned int stable = i % race->no_stable;
+    if (!reader_contains_key(reader, key(2 * stable)))
+      atomic_fetch_add(&race->errors, 1);
+    if (reader_contains_key(reader, key(2 * (race->no_stable + stable))))
+      atomic_fetch_add(&race->errors, 1);
+  }
+  unregister_reader(reader);
+}
+
+int
+main(int argc, const char *argv[])
+{
+  if (argc != 3) {
+    printf("Usage: %s no_elements no_readers\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  unsigned int no_elms = atoi(argv[1]);
+  unsigned int no_readers = atoi(argv[2]);
+
+  struct race race = {.table = new_table(), .no_stable = no_elms, .rounds = 20};
+  atomic_init(&race.done, 0);
+  atomic_init(&race.errors, 0);
+  for (unsigned int i = 0; i < no_elms; i++) {
+    insert_key(race.table, key(2 * i));
+  }
+
+  parallel_for(no_readers + 1, no_readers + 1, race_thread, &race);
+  printf("errors: %d\n", atomic_load(&race.errors));
+  assert(atomic_load(&race.errors) == 0);
+
+  // The writer's own view agrees
+  assert(no_keys(race.table) == no_elms);
+  for (unsigned int i = 0; i < no_elms; i++) {
+    assert(contains_key(race.table, key(2 * i)));
+    assert(!contains_key(race.table, key(2 * i + 1)));
+  }
+
+  // Readers are limited to MAX_READERS
+  struct rcu_reader *readers[MAX_READERS];
+  for (int i = 0; i < MAX_READERS; i++) {
+    readers[i] = register_reader(race.table);
+    assert(readers[i]);
+  }
+  assert(!register_reader(race.table));
+  for (int i = 0; i < MAX_READERS; i++) {
+    unregister_reader(readers[i]);
+  }
+
+  delete_table(race.table);
+  return EXIT_SUCCESS;
+}
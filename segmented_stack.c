@@ -0,0 +1,166 @@
+
+#include "segmented_stack.h"
+
+#include <assert.h>
+#include <stdalign.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef SEGMENT_BYTES
+#define SEGMENT_BYTES (64 * 1024)
+#endif
+
+struct segment {
+  struct segment *below;
+  alignas(max_align_t) unsigned char elements[];
+};
+
+static inline unsigned char *
+element_at(struct segmented_stack *stack, struct segment *segment, size_t i)
+{
+  return segment->elements + i * stack->element_size;
+}
+
+// Bytes in a segment, with its elements
+static inline size_t
+segment_bytes(struct segmented_stack *stack)
+{
+  return sizeof(struct segment) +
+         stack->segment_elements * stack->element_size;
+}
+
+static void
+free_segment(struct segmented_stack *stack, struct segment *segment)
+{
+  deallocate(stack->allocator, segment, segment_bytes(stack));
+}
+
+struct segmented_stack *
+new_segmented_stack_with_allocator(size_t element_size,
+                                   const struct allocator *allocator)
+{
+  assert(element_size > 0);
+  size_t segment_elements = SEGMENT_BYTES / element_size;
+  struct segmented_stack *stack = allocate(allocator, sizeof *stack);
+  *stack = (struct segmented_stack){
+      .top = NULL,
+      .spare = NULL,
+      .element_size = element_size,
+      .segment_elements = segment_elements ? segment_elements : 1,
+      .used = 0,
+      .size = 0,
+      .allocator = allocator};
+  return stack;
+}
+
+struct segmented_stack *
+new_segmented_stack(size_t element_size)
+{
+  return new_segmented_stack_with_allocator(element_size, NULL);
+}
+
+void
+free_segmented_stack(struct segmented_stack *stack)
+{
+  while (stack->top) {
+    struct segment *below = stack->top->below;
+    free_segment(stack, stack->top);
+    stack->top = below;
+  }
+  free_segment(stack, stack->spare);
+  deallocate(stack->allocator, stack, sizeof *stack);
+}
+
+// Put a new, empty segment on top, reusing the spare if we have one.
+static void
+add_segment(struct segmented_stack *stack)
+{
+  struct segment *segment = stack->spare;
+  if (segment) {
+    stack->spare = NULL;
+  } else {
+    segment = allocate(stack->allocator, segment_bytes(stack));
+  }
+  segment->below = stack->top;
+  stack->top = segment;
+  stack->used = 0;
+}
+
+// Remove the empty top segment and keep it as the spare.
+static void
+remove_segment(struct segmented_stack *stack)
+{
+  assert(stack->used == 0);
+  struct segment *segment = stack->top;
+  stack->top = segment->below;
+  stack->used = stack->top ? stack->segment_elements : 0;
+  free_segment(stack, stack->spare);
+  stack->spare = segment;
+}
+
+void
+push_element(struct segmented_stack *stack, const void *element)
+{
+  push_n(stack, element, 1);
+}
+
+void
+pop_element(struct segmented_stack *stack, void *element)
+{
+  assert(stack->size > 0);
+  stack->used--;
+  stack->size--;
+  if (element)
+    memcpy(element, element_at(stack, stack->top, stack->used),
+           stack->element_size);
+  if (stack->used == 0)
+    remove_segment(stack);
+}
+
+void *
+top_element(struct segmented_stack *stack)
+{
+  assert(stack->size > 0);
+  return element_at(stack, stack->top, stack->used - 1);
+}
+
+void
+push_n(struct segmented_stack *stack, const void *elements, size_t n)
+{
+  const unsigned char *from = elements;
+  while (n > 0) {
+    if (!stack->top || stack->used == stack->segment_elements)
+      add_segment(stack);
+    size_t room = stack->segment_elements - stack->used;
+    size_t chunk = n < room ? n : room;
+    memcpy(element_at(stack, stack->top, stack->used), from,
+           chunk * stack->element_size);
+    stack->used += chunk;
+    stack->size += chunk;
+    from += chunk * stack->element_size;
+    n -= chunk;
+  }
+}
+
+size_t
+pop_n(struct segmented_stack *stack, void *elements, size_t n)
+{
+  if (n > stack->size)
+    n = stack->size;
+
+  // The top element goes last, so we fill the array from the back.
+  unsigned char *to = (unsigned char *)elements + n * stack->element_size;
+  size_t left = n;
+  while (left > 0) {
+    size_t chunk = left < stack->used ? left : stack->used;
+    stack->used -= chunk;
+    stack->size -= chunk;
+    to -= chunk * stack->element_size;
+    memcpy(to, element_at(stack, stack->top, stack->used),
+           chunk * stack->element_size);
+    left -= chunk;
+    if (stack->used == 0)
+      remove_segment(stack);
+  }
+  return n;
+}
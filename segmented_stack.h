@@ -0,0 +1,64 @@
+
+#ifndef SEGMENTED_STACK_H
+#define SEGMENTED_STACK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "allocator.h"
+
+// A stack of elements of any size, stored in a linked list of fixed-size
+// segments. Growing never copies elements, so a pointer to an element
+// stays valid until the element is popped. We keep the last segment we
+// emptied as a spare, so pushing and popping around a segment boundary
+// doesn't allocate each time.
+struct segment;
+struct segmented_stack {
+  struct segment *top;   // The segment with the top element
+  struct segment *spare; // An empty segment, or NULL
+  size_t element_size;
+  size_t segment_elements; // Elements in a segment
+  size_t used;             // Elements in the top segment
+  size_t size;             // Elements in the stack
+  const struct allocator *allocator;
+};
+
+struct segmented_stack *
+new_segmented_stack(size_t element_size);
+struct segmented_stack *
+new_segmented_stack_with_allocator(size_t element_size,
+                                   const struct allocator *allocator);
+void
+free_segmented_stack(struct segmented_stack *stack);
+
+// Copy the element at `element` onto the stack
+void
+push_element(struct segmented_stack *stack, const void *element);
+// Copy the top element to `element` (unless it is NULL) and pop it
+void
+pop_element(struct segmented_stack *stack, void *element);
+// The top element. The stack must not be empty.
+void *
+top_element(struct segmented_stack *stack);
+
+// Push the n elements in the array `elements`; the last becomes the top.
+void
+push_n(struct segmented_stack *stack, const void *elements, size_t n);
+// Pop the top n elements (or all, if there are fewer) into the array
+// `elements`, in the order they were pushed, and return how many we
+// popped. push_n followed by pop_n gives you back the same array.
+size_t
+pop_n(struct segmented_stack *stack, void *elements, size_t n);
+
+static inline size_t
+stack_size(struct segmented_stack *stack)
+{
+  return stack->size;
+}
+static inline bool
+is_stack_empty(struct segmented_stack *stack)
+{
+  return stack->size == 0;
+}
+
+#endif
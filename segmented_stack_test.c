@@ -0,0 +1,111 @@
+
+#include "segmented_stack.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+struct frame {
+  unsigned int node;
+  unsigned int edge;
+  double weight;
+};
+
+// Enough ints to fill several segments
+#define N 100000
+
+static void
+test_single(void)
+{
+  struct segmented_stack *stack = new_segmented_stack(sizeof(int));
+  assert(is_stack_empty(stack));
+
+  int first = -1;
+  push_element(stack, &first);
+  int *bottom = top_element(stack);
+
+  for (int i = 0; i < N; ++i) {
+    push_element(stack, &i);
+    assert(*(int *)top_element(stack) == i);
+  }
+  assert(stack_size(stack) == N + 1);
+  assert(*bottom == -1); // Pushing didn't move the first element
+
+  for (int i = N - 1; i >= 0; --i) {
+    int value;
+    pop_element(stack, &value);
+    assert(value == i);
+  }
+  assert(top_element(stack) == bottom);
+
+  // Fill the first segment and go back and forth over its end
+  for (size_t i = 1; i < stack->segment_elements; ++i) {
+    push_element(stack, &first);
+  }
+  for (int i = 0; i < 10; ++i) {
+    push_element(stack, &i);
+    assert(stack->spare == NULL);
+    pop_element(stack, NULL);
+    assert(stack->spare != NULL);
+  }
+  while (stack_size(stack) > 1) {
+    pop_element(stack, NULL);
+  }
+  pop_element(stack, &first);
+  assert(first == -1);
+  assert(is_stack_empty(stack));
+
+  free_segmented_stack(stack);
+}
+
+static void
+test_bulk(void)
+{
+  struct segmented_stack *stack = new_segmented_stack(sizeof(struct frame));
+  struct frame *frames = malloc(N * sizeof *frames);
+  struct frame *popped = malloc(N * sizeof *popped);
+  for (unsigned int i = 0; i < N; ++i) {
+    frames[i] = (struct frame){.node = i, .edge = 2 * i, .weight = i / 2.0};
+  }
+
+  // Push in uneven chunks, so they straddle segments
+  unsigned int pushed = 0;
+  for (unsigned int chunk = 1; pushed < N; chunk = 2 * chunk + 1) {
+    unsigned int n = (N - pushed < chunk) ? N - pushed : chunk;
+    push_n(stack, frames + pushed, n);
+    pushed += n;
+  }
+  assert(stack_size(stack) == N);
+  assert(((struct frame *)top_element(stack))->node == N - 1);
+
+  // Pop the top half in one go and get them back in push order. pop_n
+  // goes outside the asserts, so it still pops when NDEBUG takes them out.
+  size_t got = pop_n(stack, popped, N / 2);
+  assert(got == N / 2);
+  for (unsigned int i = 0; i < got; ++i) {
+    assert(popped[i].node == N - N / 2 + i);
+    assert(popped[i].edge == 2 * popped[i].node);
+  }
+
+  // Asking for more than we have pops the rest
+  got = pop_n(stack, popped, N);
+  assert(got == N - N / 2);
+  for (unsigned int i = 0; i < got; ++i) {
+    assert(popped[i].node == i);
+    assert(popped[i].weight == i / 2.0);
+  }
+  assert(is_stack_empty(stack));
+  got = pop_n(stack, popped, 1);
+  assert(got == 0);
+
+  free(popped);
+  free(frames);
+  free_segmented_stack(stack);
+}
+
+int
+main()
+{
+  test_single();
+  test_bulk();
+  return 0;
+}
@@ -0,0 +1,128 @@
+
+#include "set_algebra.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "parallel.h"
+
+// Tables with fewer bins than this are scanned on the calling thread
+#ifndef PARALLEL_SCAN_THRESHOLD
+#define PARALLEL_SCAN_THRESHOLD (1 << 16)
+#endif
+
+// Keys found by one thread
+struct key_buffer {
+  unsigned int *keys;
+  size_t used;
+  size_t size;
+};
+
+static void
+push_key(struct key_buffer *buffer, unsigned int key)
+{
+  if (buffer->used == buffer->size) {
+    buffer->size = buffer->size ? 2 * buffer->size : 1024;
+    buffer->keys = realloc(buffer->keys, buffer->size * sizeof *buffer->keys);
+  }
+  buffer->keys[buffer->used++] = key;
+}
+
+// Scan one table and collect the keys that are (or are not) in the other.
+struct scan {
+  struct hash_table *scanned;
+  struct hash_table *probed;
+  bool keep_found;
+  struct key_buffer *buffers; // One per thread
+};
+
+struct scan_thread {
+  struct scan *scan;
+  struct key_buffer *buffer;
+};
+
+static void
+filter_key(unsigned int key, void *data)
+{
+  struct scan_thread *thread = data;
+  if (contains_key(thread->scan->probed, key) == thread->scan->keep_found)
+    push_key(thread->buffer, key);
+}
+
+static void
+scan_bins(unsigned int thread, size_t begin, size_t end, void *data)
+{
+  struct scan *scan = data;
+  struct scan_thread scan_thread = {.scan = scan,
+                                    .buffer = scan->buffers + thread};
+  for_each_key_in_bins(scan->scanned, begin, end, filter_key, &scan_thread);
+}
+
+static void
+insert_into(unsigned int key, void *table)
+{
+  insert_key(table, key);
+}
+
+// Collect the keys from `scanned` whose presence in `probed` is
+// `keep_found`, and insert them into a new table sized for the result.
+// If `copy` is not NULL, its keys are inserted as well.
+static struct hash_table *
+filter_table(struct hash_table *scanned, struct hash_table *probed,
+             bool keep_found, struct hash_table *copy)
+{
+  size_t bins = no_bins(scanned);
+  unsigned int no_threads = (bins >= PARALLEL_SCAN_THRESHOLD) ? no_cpus() : 1;
+
+  struct scan scan = {.scanned = scanned,
+                      .probed = probed,
+                      .keep_found = keep_found,
+                      .buffers = calloc(no_threads, sizeof *scan.buffers)};
+  parallel_for(no_threads, bins, scan_bins, &scan);
+
+  size_t found = 0;
+  for (unsigned int t = 0; t < no_threads; t++) {
+    found += scan.buffers[t].used;
+  }
+
+  size_t copied = copy ? no_keys(copy) : 0;
+  struct hash_table *result = new_table_with_capacity(found + copied);
+  if (copy)
+    for_each_key(copy, insert_into, result);
+  for (unsigned int t = 0; t < no_threads; t++) {
+    struct key_buffer *buffer = scan.buffers + t;
+    for (size_t i = 0; i < buffer->used; i++) {
+      insert_key(result, buffer->keys[i]);
+    }
+    free(buffer->keys);
+  }
+  free(scan.buffers);
+
+  return result;
+}
+
+struct hash_table *
+table_union(struct hash_table *a, struct hash_table *b)
+{
+  // Copy the larger table and add the keys only in the smaller.
+  if (no_keys(a) < no_keys(b))
+    return filter_table(a, b, false, b);
+  else
+    return filter_table(b, a, false, a);
+}
+
+struct hash_table *
+table_intersect(struct hash_table *a, struct hash_table *b)
+{
+  // Scan the smaller table and probe the larger.
+  if (no_keys(a) < no_keys(b))
+    return filter_table(a, b, true, NULL);
+  else
+    return filter_table(b, a, true, NULL);
+}
+
+struct hash_table *
+table_difference(struct hash_table *a, struct hash_table *b)
+{
+  return filter_table(a, b, false, NULL);
+}
@@ -0,0 +1,21 @@
+
+#ifndef SET_ALGEBRA_H
+#define SET_ALGEBRA_H
+
+#include "hash_table.h"
+
+// Set operations on tables from the same backend. They return new tables,
+// sized for their result up front, and leave the arguments unchanged.
+//
+// Large tables are scanned in parallel, one range of bins per thread, with
+// each key looked up in the other table. Lookups must therefore not modify
+// the tables, so leave set_reorder at NO_REORDER for chaining backends.
+struct hash_table *
+table_union(struct hash_table *a, struct hash_table *b);
+struct hash_table *
+table_intersect(struct hash_table *a, struct hash_table *b);
+// The keys in a that are not in b
+struct hash_table *
+table_difference(struct hash_table *a, struct hash_table *b);
+
+#endif
@@ -0,0 +1,104 @@
+
+#include "set_algebra.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Keys from a small range, so the two tables overlap
+static unsigned int
+random_key(unsigned int range)
+{
+  unsigned int key = (unsigned int)rand() % range;
+  return key;
+}
+
+static void
+count_key(unsigned int key, void *data)
+{
+  (*(unsigned int *)data)++;
+}
+
+// The table holds exactly the keys in [0, range) for which pred holds
+static void
+check_result(struct hash_table *result, struct hash_table *a,
+             struct hash_table *b, unsigned int range,
+             bool (*pred)(bool in_a, bool in_b))
+{
+  unsigned int expected = 0;
+  for (unsigned int key = 0; key < range; key++) {
+    bool in = pred(contains_key(a, key), contains_key(b, key));
+    assert(contains_key(result, key) == in);
+    expected += in;
+  }
+  unsigned int counted = 0;
+  for_each_key(result, count_key, &counted);
+  assert(no_keys(result) == expected);
+  assert(counted == expected);
+}
+
+static bool
+in_union(bool in_a, bool in_b)
+{
+  return in_a || in_b;
+}
+static bool
+in_intersection(bool in_a, bool in_b)
+{
+  return in_a && in_b;
+}
+static bool
+in_difference(bool in_a, bool in_b)
+{
+  return in_a && !in_b;
+}
+
+int
+main(int argc, const char *argv[])
+{
+  if (argc != 2) {
+    printf("Usage: %s no_elements\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  int no_elms = atoi(argv[1]);
+  unsigned int range = 2 * no_elms + 1;
+
+  // b is twice the size of a, to check both argument orders
+  struct hash_table *a = new_table(), *b = new_table();
+  for (int i = 0; i < no_elms; ++i) {
+    insert_key(a, random_key(range));
+    insert_key(b, random_key(range));
+    insert_key(b, random_key(range));
+  }
+
+  clock_t start = clock();
+  struct hash_table *ab_union = table_union(a, b),
+                    *ab_intersection = table_intersect(a, b),
+                    *ab_difference = table_difference(a, b),
+                    *ba_difference = table_difference(b, a);
+  clock_t end = clock();
+  printf("%g\n", (end - start) / (double)CLOCKS_PER_SEC);
+
+  check_result(ab_union, a, b, range, in_union);
+  check_result(ab_intersection, a, b, range, in_intersection);
+  check_result(ab_difference, a, b, range, in_difference);
+  check_result(ba_difference, b, a, range, in_difference);
+
+  struct hash_table *ba_union = table_union(b, a),
+                    *ba_intersection = table_intersect(b, a);
+  check_result(ba_union, a, b, range, in_union);
+  check_result(ba_intersection, a, b, range, in_intersection);
+
+  delete_table(ba_intersection);
+  delete_table(ba_union);
+  delete_table(ba_difference);
+  delete_table(ab_difference);
+  delete_table(ab_intersection);
+  delete_table(ab_union);
+  delete_table(b);
+  delete_table(a);
+
+  return EXIT_SUCCESS;
+}
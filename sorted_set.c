@@ -0,0 +1,183 @@
+
+#include "sorted_set.h"
+
+#include <limits.h>
+#include <stdlib.h>
+
+#define CACHE_LINE 64
+
+// Tree indices are unsigned long since a search goes down to 2n + 1,
+// which can overflow an unsigned int.
+
+// Descend from the root, going right while keys[k] < key, and return the
+// path as the index of the empty leaf where it ends. The loop has no
+// branches besides the loop test. While we compare at k we prefetch k's
+// descendants four levels down; they are 16 consecutive keys in one
+// cache line.
+static inline unsigned long
+descend(struct sorted_set *set, unsigned int key)
+{
+  unsigned long k = 1;
+  while (k <= set->n) {
+    __builtin_prefetch(set->keys + 16 * k);
+    k = 2 * k + (set->keys[k] < key);
+  }
+  return k;
+}
+
+// The first key >= key is the last node where the path went left, so we
+// strip the trailing right turns and that left turn. Returns 0 if all keys
+// are smaller.
+static inline unsigned long
+lower_bound(struct sorted_set *set, unsigned int key)
+{
+  unsigned long k = descend(set, key);
+  return k >> __builtin_ffsl(~k);
+}
+
+// The first key > key
+static inline unsigned long
+upper_bound(struct sorted_set *set, unsigned int key)
+{
+  return key == UINT_MAX ? 0 : lower_bound(set, key + 1);
+}
+
+// The last key <= key is the last node where the path for key + 1 went
+// right. For the largest key, it is the rightmost node.
+static inline unsigned long
+last_at_most(struct sorted_set *set, unsigned int key)
+{
+  if (key == UINT_MAX) {
+    unsigned long k = 1;
+    while (k <= set->n)
+      k = 2 * k + 1;
+    return k >> 1;
+  }
+  unsigned long k = descend(set, key + 1);
+  return k >> __builtin_ffsl(k);
+}
+
+// Position of node k in sorted order. In a perfect tree of height h, the
+// node at depth d and position p in its level is number
+// (2p + 1) * 2^(h - 1 - d) - 1 in order. The bottom level of our tree is
+// only filled up to `bottom` nodes, and we subtract the missing bottom
+// nodes that would come before k. Node 0 ranks after all keys.
+static unsigned long
+rank(struct sorted_set *set, unsigned long k)
+{
+  if (k == 0)
+    return set->n;
+
+  int height = 64 - __builtin_clzl(set->n);
+  int depth = 63 - __builtin_clzl(k);
+  unsigned long p = k - (1UL << depth);
+  unsigned long i = ((2 * p + 1) << (height - 1 - depth)) - 1;
+
+  unsigned long bottom = set->n - ((1UL << (height - 1)) - 1);
+  // Bottom positions whose in-order index is less than i
+  unsigned long before = (i + 1) / 2;
+  return before > bottom ? i - (before - bottom) : i;
+}
+
+// The next node in sorted order, or 0 after the last
+static inline unsigned long
+next(struct sorted_set *set, unsigned long k)
+{
+  if (2 * k + 1 <= set->n) {
+    // Leftmost node in the right subtree
+    k = 2 * k + 1;
+    while (2 * k <= set->n)
+      k = 2 * k;
+    return k;
+  }
+  // Up past the ancestors we are a right child of, then one more
+  return k >> __builtin_ffsl(~k);
+}
+
+static void
+collect_key(unsigned int key, void *data)
+{
+  unsigned int **next = data;
+  *(*next)++ = key;
+}
+
+static int
+compare_keys(const void *a, const void *b)
+{
+  unsigned int x = *(const unsigned int *)a, y = *(const unsigned int *)b;
+  return (x > y) - (x < y);
+}
+
+struct sorted_set *
+new_sorted_set(struct hash_table *table)
+{
+  unsigned int n = no_keys(table);
+  unsigned int *sorted = malloc((n + 1) * sizeof *sorted), *next = sorted;
+  for_each_key(table, collect_key, &next);
+  qsort(sorted, n, sizeof *sorted, compare_keys);
+
+  // Align keys[0] with a cache line so keys[16k..16k+15] share one.
+  size_t bytes = ((n + 1) * sizeof(unsigned int) + CACHE_LINE - 1) /
+                 CACHE_LINE * CACHE_LINE;
+  struct sorted_set *set = malloc(sizeof *set);
+  *set = (struct sorted_set){.keys = aligned_alloc(CACHE_LINE, bytes), .n = n};
+  for (unsigned long k = 1; k <= n; k++) {
+    set->keys[k] = sorted[rank(set, k)];
+  }
+
+  free(sorted);
+  return set;
+}
+
+void
+delete_sorted_set(struct sorted_set *set)
+{
+  free(set->keys);
+  free(set);
+}
+
+bool
+sorted_set_contains(struct sorted_set *set, unsigned int key)
+{
+  unsigned long k = lower_bound(set, key);
+  return k && set->keys[k] == key;
+}
+
+bool
+sorted_set_successor(struct sorted_set *set, unsigned int key,
+                     unsigned int *result)
+{
+  unsigned long k = lower_bound(set, key);
+  if (k)
+    *result = set->keys[k];
+  return k;
+}
+
+bool
+sorted_set_predecessor(struct sorted_set *set, unsigned int key,
+                       unsigned int *result)
+{
+  unsigned long k = last_at_most(set, key);
+  if (k)
+    *result = set->keys[k];
+  return k;
+}
+
+unsigned int
+sorted_set_range_count(struct sorted_set *set, unsigned int low,
+                       unsigned int high)
+{
+  if (low > high)
+    return 0;
+  return rank(set, upper_bound(set, high)) - rank(set, lower_bound(set, low));
+}
+
+void
+sorted_set_range(struct sorted_set *set, unsigned int low, unsigned int high,
+                 void (*f)(unsigned int key, void *data), void *data)
+{
+  for (unsigned long k = lower_bound(set, low); k && set->keys[k] <= high;
+       k = next(set, k)) {
+    f(set->keys[k], data);
+  }
+}
@@ -0,0 +1,45 @@
+
+#ifndef SORTED_SET_H
+#define SORTED_SET_H
+
+#include <stdbool.h>
+
+#include "hash_table.h"
+
+// A static sorted set built from any backend. The keys are stored in
+// Eytzinger order: the sorted array laid out as an implicit binary search
+// tree in breadth-first order, with the root at index 1 and the children
+// of k at 2k and 2k + 1. A search then reads one path from the root, and
+// the top levels stay in cache.
+struct sorted_set {
+  unsigned int *keys; // keys[1..n]; keys[0] is unused
+  unsigned int n;
+};
+
+struct sorted_set *
+new_sorted_set(struct hash_table *table);
+void
+delete_sorted_set(struct sorted_set *set);
+
+bool
+sorted_set_contains(struct sorted_set *set, unsigned int key);
+
+// The smallest key >= key and the largest key <= key. They return false
+// if there is no such key.
+bool
+sorted_set_successor(struct sorted_set *set, unsigned int key,
+                     unsigned int *result);
+bool
+sorted_set_predecessor(struct sorted_set *set, unsigned int key,
+                       unsigned int *result);
+
+// Number of keys in [low, high]
+unsigned int
+sorted_set_range_count(struct sorted_set *set, unsigned int low,
+                       unsigned int high);
+// Call f(key, data) for the keys in [low, high] in increasing order
+void
+sorted_set_range(struct sorted_set *set, unsigned int low, unsigned int high,
+                 void (*f)(unsigned int key, void *data), void *data);
+
+#endif
@@ -0,0 +1,119 @@
+
+#include "sorted_set.h"
+
+#include <assert.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static unsigned int
+random_key()
+{
+  unsigned int key = (unsigned int)rand();
+  return key;
+}
+
+static int
+compare_keys(const void *a, const void *b)
+{
+  unsigned int x = *(const unsigned int *)a, y = *(const unsigned int *)b;
+  return (x > y) - (x < y);
+}
+
+// Index of the first key >= key in the sorted array
+static int
+first_at_least(unsigned int *sorted, int n, unsigned int key)
+{
+  int i = 0;
+  while (i < n && sorted[i] < key)
+    i++;
+  return i;
+}
+
+struct range_check {
+  unsigned int *expected;
+  int seen;
+};
+
+static void
+check_next(unsigned int key, void *data)
+{
+  struct range_check *check = data;
+  assert(check->expected[check->seen] == key);
+  check->seen++;
+}
+
+int
+main(int argc, const char *argv[])
+{
+  if (argc != 2) {
+    printf("Usage: %s no_elements\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  int no_elms = atoi(argv[1]);
+  struct hash_table *table = new_table();
+  for (int i = 0; i < no_elms; ++i) {
+    insert_key(table, random_key());
+  }
+  insert_key(table, UINT_MAX); // Check the edge cases as well
+
+  clock_t start = clock();
+  struct sorted_set *set = new_sorted_set(table);
+  clock_t end = clock();
+  printf("building: %g\n", (end - start) / (double)CLOCKS_PER_SEC);
+
+  // The reference is the sorted list of keys; the set iterates them in
+  // order.
+  int n = (int)set->n;
+  assert(set->n == no_keys(table));
+  unsigned int *sorted = malloc(n * sizeof *sorted);
+  struct range_check check = {.expected = sorted, .seen = 0};
+  for (int i = 0; i < n; ++i) {
+    sorted[i] = set->keys[i + 1];
+  }
+  qsort(sorted, n, sizeof *sorted, compare_keys);
+  sorted_set_range(set, 0, UINT_MAX, check_next, &check);
+  assert(check.seen == n);
+  assert(sorted_set_range_count(set, 0, UINT_MAX) == set->n);
+
+  start = clock();
+  for (int i = 0; i < n; ++i) {
+    assert(sorted_set_contains(set, sorted[i]));
+  }
+  end = clock();
+  printf("lookups: %g\n", (end - start) / (double)CLOCKS_PER_SEC);
+
+  // Queries are checked against a linear scan, so keep them few.
+  for (int q = 0; q < 100; ++q) {
+    unsigned int low = random_key(), high = random_key(), result;
+    int i = first_at_least(sorted, n, low);
+
+    assert(sorted_set_contains(set, low) == (i < n && sorted[i] == low));
+    assert(sorted_set_successor(set, low, &result) == (i < n));
+    if (i < n)
+      assert(result == sorted[i]);
+
+    int j = (i < n && sorted[i] == low) ? i : i - 1;
+    assert(sorted_set_predecessor(set, low, &result) == (j >= 0));
+    if (j >= 0)
+      assert(result == sorted[j]);
+
+    int k = first_at_least(sorted, n, high);
+    if (k < n && sorted[k] == high)
+      k++;
+    unsigned int count = (low <= high) ? k - i : 0;
+    assert(sorted_set_range_count(set, low, high) == count);
+
+    check = (struct range_check){.expected = sorted + i, .seen = 0};
+    sorted_set_range(set, low, high, check_next, &check);
+    assert(check.seen == (int)count);
+  }
+
+  free(sorted);
+  delete_sorted_set(set);
+  delete_table(table);
+
+  return EXIT_SUCCESS;
+}
@@ -5,27 +5,37 @@
 #include <stdlib.h>
 
 struct stack *
-new_stack()
+new_stack_with_allocator(const struct allocator *allocator)
 {
-  struct stack *stack = malloc(sizeof *stack);
+  struct stack *stack = allocate(allocator, sizeof *stack);
   *stack = (struct stack){.size = 1,
                           .used = 0,
-                          .array = malloc(sizeof *stack->array)};
+                          .array = allocate(allocator, sizeof *stack->array),
+                          .allocator = allocator};
   return stack;
 }
 
+struct stack *
+new_stack()
+{
+  return new_stack_with_allocator(NULL);
+}
+
 void
 free_stack(struct stack *stack)
 {
-  free(stack->array);
-  free(stack);
+  deallocate(stack->allocator, stack->array,
+             stack->size * sizeof *stack->array);
+  deallocate(stack->allocator, stack, sizeof *stack);
 }
 
 static void
 resize(struct stack *stack, unsigned int new_size)
 {
   assert(new_size >= stack->used);
-  stack->array = realloc(stack->array, new_size * sizeof *stack->array);
+  stack->array = reallocate(stack->allocator, stack->array,
+                            stack->size * sizeof *stack->array,
+                            new_size * sizeof *stack->array);
   stack->size = new_size;
 }
 
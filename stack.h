@@ -4,14 +4,19 @@
 
 #include <stdbool.h>
 
+#include "allocator.h"
+
 struct stack {
   int *array;
   unsigned int size;
   unsigned int used;
+  const struct allocator *allocator;
 };
 
 struct stack *
 new_stack(void);
+struct stack *
+new_stack_with_allocator(const struct allocator *allocator);
 void
 free_stack(struct stack *stack);
 
@@ -0,0 +1,91 @@
+
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BUFFER_SIZE (1 << 20)
+
+static FILE *trace_file;
+static bool failed; // We couldn't open the trace, so don't try again
+
+// The live tables, indexed by their number. Most programs use a handful of
+// tables, so we search linearly, but look at the last one first.
+static const void **tables;
+static unsigned int no_tables;
+static unsigned int last_table;
+
+static void
+close_trace(void)
+{
+  fclose(trace_file);
+  free(tables);
+}
+
+static bool
+open_trace(void)
+{
+  const char *path = getenv("HASH_TRACE");
+  if (!path)
+    path = "hash_trace.bin";
+  trace_file = fopen(path, "wb");
+  if (!trace_file) {
+    perror(path);
+    failed = true;
+    return false;
+  }
+  setvbuf(trace_file, NULL, _IOFBF, BUFFER_SIZE);
+  fwrite(TRACE_MAGIC, 1, TRACE_MAGIC_SIZE, trace_file);
+  tables = calloc(MAX_TRACED_TABLES, sizeof *tables);
+  atexit(close_trace);
+  return true;
+}
+
+// The number of a new table: the first free one
+static unsigned int
+add_table(const void *table)
+{
+  unsigned int i = 0;
+  while (i < no_tables && tables[i])
+    i++;
+  if (i == no_tables) {
+    if (no_tables == MAX_TRACED_TABLES) {
+      fprintf(stderr, "Too many tables to trace\n");
+      exit(EXIT_FAILURE);
+    }
+    no_tables++;
+  }
+  tables[i] = table;
+  return i;
+}
+
+static unsigned int
+table_number(const void *table)
+{
+  if (last_table < no_tables && tables[last_table] == table)
+    return last_table;
+  for (unsigned int i = 0; i < no_tables; i++) {
+    if (tables[i] == table)
+      return i;
+  }
+  // A table we didn't see created; give it a number now.
+  return add_table(table);
+}
+
+void
+trace_operation(enum trace_op op, const void *table, unsigned int key,
+                bool result)
+{
+  if (!trace_file && (failed || !open_trace()))
+    return;
+
+  unsigned int number =
+      (op == TRACE_NEW_TABLE) ? add_table(table) : table_number(table);
+  last_table = number;
+  if (op == TRACE_DELETE_TABLE)
+    tables[number] = NULL;
+
+  struct trace_record record = {
+      .key = key, .table = (uint16_t)number, .op = op, .result = result};
+  fwrite(&record, sizeof record, 1, trace_file);
+}
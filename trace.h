@@ -0,0 +1,47 @@
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Traces of table operations, so we can replay real workloads with
+// hash_replay. A backend compiled with TRACE_OPERATIONS appends every call
+// to its public API to the file named by the HASH_TRACE environment
+// variable, or hash_trace.bin if it isn't set. Tracing is not thread-safe,
+// but neither are the tables.
+//
+// A trace is TRACE_MAGIC followed by fixed-size records, so a reader can
+// map the file and use it as an array.
+#define TRACE_MAGIC "HTRACE01"
+#define TRACE_MAGIC_SIZE 8
+
+enum trace_op {
+  TRACE_NEW_TABLE, // key is the capacity asked for, or 0
+  TRACE_DELETE_TABLE,
+  TRACE_INSERT,
+  TRACE_CONTAINS,
+  TRACE_DELETE
+};
+
+struct trace_record {
+  uint32_t key;
+  uint16_t table; // Tables are numbered in order of creation, and a
+                  // number is reused once its table is deleted
+  uint8_t op;
+  uint8_t result; // Whether contains_key found the key
+};
+
+#define MAX_TRACED_TABLES (UINT16_MAX + 1)
+
+void
+trace_operation(enum trace_op op, const void *table, unsigned int key,
+                bool result);
+
+#ifdef TRACE_OPERATIONS
+#define TRACE(op, table, key, result) trace_operation(op, table, key, result)
+#else
+#define TRACE(op, table, key, result) ((void)0)
+#endif
+
+#endif
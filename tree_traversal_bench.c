@@ -0,0 +1,177 @@
+
+#include "deque.h"
+#include "parallel.h"
+
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// An unbalanced tree, generated on the fly. A node is an int with its
+// depth in the low bits, and its number of children comes from a hash of
+// the node, so some subtrees are much larger than others and workers run
+// out of work at different times.
+#define DEPTH_BITS 5
+#define MAX_CHILDREN 4
+#define NODE_WORK 200 // Hash rounds per node, so a node costs something
+
+static unsigned int
+hash(unsigned int x)
+{
+  x ^= x >> 16;
+  x *= 0x7feb352dU;
+  x ^= x >> 15;
+  x *= 0x846ca68bU;
+  x ^= x >> 16;
+  return x;
+}
+
+static unsigned int
+depth(int node)
+{
+  return (unsigned int)node & ((1U << DEPTH_BITS) - 1);
+}
+
+// Does the work for a node and returns its number of children
+static unsigned int
+visit(int node, unsigned int max_depth, int *children)
+{
+  unsigned int h = (unsigned int)node;
+  for (int i = 0; i < NODE_WORK; i++) {
+    h = hash(h);
+  }
+  if (depth(node) == max_depth)
+    return 0;
+
+  // Between 0 and 3 children, 1.5 on average, so many subtrees die out
+  // early and the rest grow exponentially.
+  unsigned int no_children = h % MAX_CHILDREN;
+  for (unsigned int i = 0; i < no_children; i++) {
+    unsigned int id = hash(h + i) >> DEPTH_BITS;
+    children[i] = (int)((id << DEPTH_BITS) | (depth(node) + 1));
+  }
+  return no_children;
+}
+
+static unsigned long
+sequential_count(int root, unsigned int max_depth)
+{
+  int children[MAX_CHILDREN];
+  unsigned long count = 1;
+  unsigned int n = visit(root, max_depth, children);
+  for (unsigned int i = 0; i < n; i++) {
+    count += sequential_count(children[i], max_depth);
+  }
+  return count;
+}
+
+struct traversal {
+  struct deque **deques;
+  unsigned int no_threads;
+  unsigned int max_depth;
+  atomic_long pending; // Nodes pushed but not visited yet
+  atomic_ulong visited;
+};
+
+static void
+worker(unsigned int thread, size_t begin, size_t end, void *data)
+{
+  struct traversal *traversal = data;
+  struct deque *own = traversal->deques[thread];
+  unsigned int seed = thread + 1;
+  unsigned long visited = 0;
+
+  while (atomic_load_explicit(&traversal->pending, memory_order_acquire) > 0) {
+    int node;
+    if (!deque_pop(own, &node)) {
+      // Out of work, so try a random victim
+      seed = hash(seed);
+      unsigned int victim = seed % traversal->no_threads;
+      if (victim == thread || !deque_steal(traversal->deques[victim], &node)) {
+        sched_yield();
+        continue;
+      }
+    }
+
+    int children[MAX_CHILDREN];
+    unsigned int n = visit(node, traversal->max_depth, children);
+    // Count the children before the node is done, so pending can't drop
+    // to zero while there is still work.
+    atomic_fetch_add_explicit(&traversal->pending, n, memory_order_relaxed);
+    for (unsigned int i = 0; i < n; i++) {
+      deque_push(own, children[i]);
+    }
+    atomic_fetch_sub_explicit(&traversal->pending, 1, memory_order_release);
+    visited++;
+  }
+  atomic_fetch_add(&traversal->visited, visited);
+}
+
+static unsigned long
+parallel_count(int root, unsigned int max_depth, unsigned int no_threads)
+{
+  struct traversal traversal = {.no_threads = no_threads,
+                                .max_depth = max_depth};
+  traversal.deques = malloc(no_threads * sizeof *traversal.deques);
+  for (unsigned int t = 0; t < no_threads; t++) {
+    traversal.deques[t] = new_deque();
+  }
+  atomic_init(&traversal.pending, 1);
+  atomic_init(&traversal.visited, 0);
+  deque_push(traversal.deques[0], root);
+
+  parallel_for(no_threads, no_threads, worker, &traversal);
+
+  for (unsigned int t = 0; t < no_threads; t++) {
+    free_deque(traversal.deques[t]);
+  }
+  free(traversal.deques);
+  return atomic_load(&traversal.visited);
+}
+
+int
+main(int argc, const char *argv[])
+{
+  if (argc != 3) {
+    printf("Usage: %s max_depth max_threads\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  unsigned int max_depth = atoi(argv[1]);
+  unsigned int max_threads = atoi(argv[2]);
+  if (max_depth >= (1U << DEPTH_BITS)) {
+    printf("max_depth must be less than %u\n", 1U << DEPTH_BITS);
+    return EXIT_FAILURE;
+  }
+
+  // Many subtrees are tiny, so skip roots until we get one that isn't
+  int root = 0;
+  unsigned long nodes = 0;
+  for (unsigned int id = 1; nodes <= max_depth; id++) {
+    root = (int)(id << DEPTH_BITS);
+    nodes = sequential_count(root, max_depth);
+  }
+
+  clock_t start = clock();
+  sequential_count(root, max_depth);
+  clock_t end = clock();
+  printf("nodes: %lu, sequential: %g\n", nodes,
+         (end - start) / (double)CLOCKS_PER_SEC);
+
+  // clock() adds up the time of all threads, so use wall time here.
+  for (unsigned int threads = 1; threads <= max_threads; threads *= 2) {
+    struct timespec begin, finish;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    unsigned long count = parallel_count(root, max_depth, threads);
+    clock_gettime(CLOCK_MONOTONIC, &finish);
+    if (count != nodes) {
+      printf("%u threads visited %lu nodes, expected %lu\n", threads, count,
+             nodes);
+      return EXIT_FAILURE;
+    }
+    printf("%u threads: %g\n", threads,
+           (finish.tv_sec - begin.tv_sec) +
+               (finish.tv_nsec - begin.tv_nsec) / 1e9);
+  }
+
+  return EXIT_SUCCESS;
+}
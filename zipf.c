@@ -0,0 +1,47 @@
+
+#include "zipf.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+struct zipf *
+new_zipf(unsigned int n, double s)
+{
+  struct zipf *zipf = malloc(sizeof *zipf);
+  *zipf = (struct zipf){.cdf = malloc(n * sizeof *zipf->cdf), .n = n};
+
+  double sum = 0.0;
+  for (unsigned int r = 0; r < n; r++) {
+    sum += 1.0 / pow(r + 1, s);
+    zipf->cdf[r] = sum;
+  }
+  for (unsigned int r = 0; r < n; r++) {
+    zipf->cdf[r] /= sum;
+  }
+
+  return zipf;
+}
+
+void
+free_zipf(struct zipf *zipf)
+{
+  free(zipf->cdf);
+  free(zipf);
+}
+
+unsigned int
+zipf_sample(struct zipf *zipf)
+{
+  double u = rand() / ((double)RAND_MAX + 1);
+
+  // Binary search for the first rank whose cdf exceeds u
+  unsigned int low = 0, high = zipf->n - 1;
+  while (low < high) {
+    unsigned int mid = low + (high - low) / 2;
+    if (zipf->cdf[mid] <= u)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return low;
+}
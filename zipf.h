@@ -0,0 +1,21 @@
+
+#ifndef ZIPF_H
+#define ZIPF_H
+
+// Sampling ranks from a Zipf distribution, where rank r in [0, n) is
+// drawn with probability proportional to 1 / (r + 1)^s. Rank 0 is the
+// most frequent.
+struct zipf {
+  double *cdf;
+  unsigned int n;
+};
+
+struct zipf *
+new_zipf(unsigned int n, double s);
+void
+free_zipf(struct zipf *zipf);
+
+unsigned int
+zipf_sample(struct zipf *zipf);
+
+#endif
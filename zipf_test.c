@@ -0,0 +1,82 @@
+
+#include "hash_table.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "zipf.h"
+
+static unsigned int
+random_key()
+{
+  unsigned int key = (unsigned int)rand();
+  return key;
+}
+
+static double
+lookup_time(unsigned int *keys, int no_elms, unsigned int *lookups,
+            int no_lookups, enum reorder reorder)
+{
+  struct hash_table *table = new_table();
+  set_reorder(table, reorder);
+  for (int i = 0; i < no_elms; ++i) {
+    insert_key(table, keys[i]);
+  }
+
+  clock_t start = clock();
+  for (int i = 0; i < no_lookups; ++i) {
+    bool found = contains_key(table, lookups[i]);
+    assert(found);
+    (void)found;
+  }
+  clock_t end = clock();
+
+  // Reordering must not lose keys
+  for (int i = 0; i < no_elms; ++i) {
+    assert(contains_key(table, keys[i]));
+  }
+
+  delete_table(table);
+  return (end - start) / (double)CLOCKS_PER_SEC;
+}
+
+int
+main(int argc, const char *argv[])
+{
+  if (argc < 2) {
+    printf("Usage: %s no_elements [no_lookups] [exponent]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  int no_elms = atoi(argv[1]);
+  int no_lookups = (argc > 2) ? atoi(argv[2]) : 10 * no_elms;
+  double s = (argc > 3) ? atof(argv[3]) : 1.0;
+
+  unsigned int *keys = malloc(no_elms * sizeof *keys);
+  for (int i = 0; i < no_elms; ++i) {
+    keys[i] = random_key();
+  }
+
+  // Rank r is keys[r], so the popular keys are inserted first and end up
+  // at the back of their chains.
+  struct zipf *zipf = new_zipf(no_elms, s);
+  unsigned int *lookups = malloc(no_lookups * sizeof *lookups);
+  for (int i = 0; i < no_lookups; ++i) {
+    lookups[i] = keys[zipf_sample(zipf)];
+  }
+
+  printf("no reordering: %g\n",
+         lookup_time(keys, no_elms, lookups, no_lookups, NO_REORDER));
+  printf("move-to-front: %g\n",
+         lookup_time(keys, no_elms, lookups, no_lookups, MOVE_TO_FRONT));
+  printf("transpose:     %g\n",
+         lookup_time(keys, no_elms, lookups, no_lookups, TRANSPOSE));
+
+  free(lookups);
+  free_zipf(zipf);
+  free(keys);
+
+  return EXIT_SUCCESS;
+}